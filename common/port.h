@@ -48,6 +48,8 @@ GNU General Public License for more details.
 		#else
 			#include <dlfcn.h>
 			#define HAVE_DUP
+			#define HAVE_MMAP
+			#define HAVE_PREAD
 			#define O_BINARY 0
 		#endif
 		#define O_TEXT 0
@@ -76,6 +78,7 @@ GNU General Public License for more details.
 	#define OS_LIB_EXT "dll"
 	#define VGUI_SUPPORT_DLL "../vgui_support." OS_LIB_EXT
 	#define HAVE_DUP
+	#define HAVE_MMAP
 #endif //WIN32
 
 #ifndef XASH_LOW_MEMORY
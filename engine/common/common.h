@@ -382,6 +382,21 @@ void _Mem_Check( const char *filename, int fileline );
 qboolean Mem_IsAllocatedExt( poolhandle_t poolptr, void *data );
 void Mem_PrintList( size_t minallocationsize );
 void Mem_PrintStats( void );
+void Mem_FlushThreadCache( void );
+void _Mem_ScratchFree( void *data, const char *filename, int fileline );
+void *_Mem_ScratchAlloc( size_t size, qboolean clear, const char *filename, int fileline )
+	ALLOC_CHECK( 1 ) MALLOC_LIKE( _Mem_ScratchFree, 1 ) WARN_UNUSED_RESULT;
+void Mem_ScratchReset( void );
+typedef enum
+{
+	MEMPROFILE_ALLOCS = 0,
+	MEMPROFILE_BYTES,
+	MEMPROFILE_LIVE,
+} memprofilesort_t;
+void Mem_ProfileEnable( qboolean enable );
+void Mem_ProfileReset( void );
+void Mem_ProfileFrame( void );
+void Mem_ProfilePrint( int count, memprofilesort_t sort );
 
 #define Mem_Malloc( pool, size ) _Mem_Alloc( pool, size, false, __FILE__, __LINE__ )
 #define Mem_Calloc( pool, size ) _Mem_Alloc( pool, size, true, __FILE__, __LINE__ )
@@ -392,6 +407,9 @@ void Mem_PrintStats( void );
 #define Mem_EmptyPool( pool ) _Mem_EmptyPool( pool, __FILE__, __LINE__ )
 #define Mem_IsAllocated( mem ) Mem_IsAllocatedExt( NULL, mem )
 #define Mem_Check() _Mem_Check( __FILE__, __LINE__ )
+#define Mem_ScratchAlloc( size ) _Mem_ScratchAlloc( size, false, __FILE__, __LINE__ )
+#define Mem_ScratchCalloc( size ) _Mem_ScratchAlloc( size, true, __FILE__, __LINE__ )
+#define Mem_ScratchFree( mem ) _Mem_ScratchFree( mem, __FILE__, __LINE__ )
 
 //
 // filesystem_engine.c
@@ -408,6 +426,9 @@ byte *FS_LoadFile( const char *path, fs_offset_t *filesizeptr, qboolean gamediro
 	MALLOC_LIKE( _Mem_Free, 1 ) WARN_UNUSED_RESULT;
 byte *FS_LoadDirectFile( const char *path, fs_offset_t *filesizeptr )
 	MALLOC_LIKE( _Mem_Free, 1 ) WARN_UNUSED_RESULT;
+void FS_UnmapFile( byte *data );
+byte *FS_MapFile( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly )
+	MALLOC_LIKE( FS_UnmapFile, 1 ) WARN_UNUSED_RESULT;
 
 //
 // cmd.c
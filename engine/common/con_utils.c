@@ -850,17 +850,439 @@ static qboolean Cmd_GetCDList( const char *s, char *completedname, int length )
 	return true;
 }
 
-static qboolean Cmd_CheckMapsList_R( qboolean fRefresh, qboolean onlyingamedir )
+/*
+=======================================================================
+
+			MAPS LIST GENERATION
+
+Maps are probed by worker threads, results are cached in maps.dat by
+file time and size, so unchanged maps aren't opened again. Search over
+all game directories has it's own cache, so gamedir search and fallback
+to it don't overwrite each other
+
+=======================================================================
+*/
+#define MAPLIST_THREADS		4
+#define MAPLIST_MIN_JOBS		16	// per thread, don't start threads for a few maps
+#define MAPLIST_CACHE		"maps.dat"
+#define MAPLIST_CACHE_ALL		"maps_all.dat"	// when search isn't limited by gamedir
+#define MAPLIST_CACHE_IDENT		(('C'<<24)+('P'<<16)+('A'<<8)+'M') // little-endian "MAPC"
+#define MAPLIST_CACHE_VERSION		1
+#define MAPLIST_CACHE_HASH		1024	// must be power of two
+
+// same conditions as in net_ws.c, threads library is only linked then
+#if XASH_WIN32
+#include <windows.h>
+#define HAVE_MAPLIST_THREADS
+typedef CRITICAL_SECTION maplist_mutex_t;
+typedef HANDLE           maplist_thread_t;
+#define mutex_create( x )   InitializeCriticalSection( &( x ))
+#define mutex_destroy( x )  DeleteCriticalSection( &( x ))
+#define mutex_lock( x )     EnterCriticalSection( &( x ))
+#define mutex_unlock( x )   LeaveCriticalSection( &( x ))
+#define create_thread( thread, pfn, arg ) ((( thread ) = CreateThread( NULL, 0, ( pfn ), ( arg ), 0, NULL )) != NULL )
+#define join_thread( x )    ( WaitForSingleObject(( x ), INFINITE ), CloseHandle(( x )))
+#define THREAD_RETURN_TYPE  DWORD WINAPI
+#define THREAD_RETURN_VALUE 0
+#elif !XASH_EMSCRIPTEN && !XASH_DOS4GW && !defined XASH_NO_ASYNC_NS_RESOLVE
+#include <pthread.h>
+#define HAVE_MAPLIST_THREADS
+typedef pthread_mutex_t maplist_mutex_t;
+typedef pthread_t       maplist_thread_t;
+#define mutex_create( x )   pthread_mutex_init( &( x ), NULL )
+#define mutex_destroy( x )  pthread_mutex_destroy( &( x ))
+#define mutex_lock( x )     pthread_mutex_lock( &( x ))
+#define mutex_unlock( x )   pthread_mutex_unlock( &( x ))
+#define create_thread( thread, pfn, arg ) !pthread_create( &( thread ), NULL, ( pfn ), ( arg ))
+#define join_thread( x )    pthread_join(( x ), NULL )
+#define THREAD_RETURN_TYPE  void *
+#define THREAD_RETURN_VALUE NULL
+#endif
+
+typedef struct maplist_entry_s
+{
+	struct maplist_entry_s	*next;		// in cache hash table
+	int			filetime;
+	int			enttime;		// -1 if there is no .ent file
+	fs_offset_t		filesize;
+	qboolean			spawnpoints;	// goes to maps.lst
+	qboolean			cached;
+	string			filename;
+	string			message;
+} maplist_entry_t;
+
+typedef struct
+{
+	int	ident;
+	int	version;
+	int	numentries;
+	int	gamemode;		// results depend on these gameinfo fields
+	int	use_filter;
+	char	mp_entity[32];
+} dmaplist_header_t;
+
+typedef struct
+{
+	int	filetime;
+	int	enttime;
+	int64_t	filesize;
+	int	spawnpoints;
+	word	namelen;
+	word	messagelen;
+	// followed by name and message, without terminators
+} dmaplist_entry_t;
+
+typedef struct
+{
+	maplist_entry_t	*jobs;
+	int		numjobs;
+	int		nextjob;
+	maplist_entry_t	*cached;
+	int		numcached;
+	maplist_entry_t	*hash[MAPLIST_CACHE_HASH];
+	qboolean		onlyingamedir;
+	qboolean		use_filter;
+#ifdef HAVE_MAPLIST_THREADS
+	maplist_mutex_t	joblock;
+	maplist_mutex_t	modlock;	// Mod_TestBmodelLumps uses globals
+#endif
+} maplist_state_t;
+
+static void Cmd_InitMapsListCacheHeader( maplist_state_t *state, dmaplist_header_t *hdr )
+{
+	memset( hdr, 0, sizeof( *hdr ));
+	hdr->ident = MAPLIST_CACHE_IDENT;
+	hdr->version = MAPLIST_CACHE_VERSION;
+	hdr->gamemode = GI->gamemode;
+	hdr->use_filter = state->use_filter;
+	Q_strncpy( hdr->mp_entity, GI->mp_entity, sizeof( hdr->mp_entity ));
+}
+
+static const char *Cmd_MapsListCacheName( const maplist_state_t *state )
+{
+	return state->onlyingamedir ? MAPLIST_CACHE : MAPLIST_CACHE_ALL;
+}
+
+/*
+=====================================
+Cmd_LoadMapsListCache
+
+=====================================
+*/
+static void Cmd_LoadMapsListCache( maplist_state_t *state )
+{
+	dmaplist_header_t	hdr, expected;
+	fs_offset_t	size, pos;
+	byte		*data;
+	int		i;
+
+	if(( data = FS_LoadFile( Cmd_MapsListCacheName( state ), &size, true )) == NULL )
+		return;
+
+	Cmd_InitMapsListCacheHeader( state, &expected );
+
+	if( size < sizeof( hdr ))
+	{
+		Mem_Free( data );
+		return;
+	}
+
+	memcpy( &hdr, data, sizeof( hdr ));
+	expected.numentries = hdr.numentries;
+
+	// gameinfo was changed, everything must be probed again
+	if( memcmp( &hdr, &expected, sizeof( hdr )) || hdr.numentries <= 0 )
+	{
+		Mem_Free( data );
+		return;
+	}
+
+	state->cached = Mem_Calloc( host.mempool, sizeof( maplist_entry_t ) * hdr.numentries );
+
+	for( i = 0, pos = sizeof( hdr ); i < hdr.numentries; i++ )
+	{
+		maplist_entry_t	*entry = &state->cached[state->numcached];
+		dmaplist_entry_t	in;
+		uint		hash;
+
+		if( pos + sizeof( in ) > size )
+			break;
+
+		memcpy( &in, data + pos, sizeof( in ));
+		pos += sizeof( in );
+
+		if( pos + in.namelen + in.messagelen > size || in.namelen >= sizeof( entry->filename ) || in.messagelen >= sizeof( entry->message ))
+			break;
+
+		entry->filetime = in.filetime;
+		entry->enttime = in.enttime;
+		entry->filesize = in.filesize;
+		entry->spawnpoints = in.spawnpoints;
+		memcpy( entry->filename, data + pos, in.namelen );
+		memcpy( entry->message, data + pos + in.namelen, in.messagelen );
+		pos += in.namelen + in.messagelen;
+
+		hash = COM_HashKey( entry->filename, MAPLIST_CACHE_HASH );
+		entry->next = state->hash[hash];
+		state->hash[hash] = entry;
+		state->numcached++;
+	}
+
+	Mem_Free( data );
+}
+
+/*
+=====================================
+Cmd_SaveMapsListCache
+
+=====================================
+*/
+static void Cmd_SaveMapsListCache( maplist_state_t *state )
+{
+	dmaplist_header_t	hdr;
+	file_t		*f;
+	int		i;
+
+	if(( f = FS_Open( Cmd_MapsListCacheName( state ), "wb", true )) == NULL )
+		return;
+
+	Cmd_InitMapsListCacheHeader( state, &hdr );
+	hdr.numentries = state->numjobs;
+	FS_Write( f, &hdr, sizeof( hdr ));
+
+	for( i = 0; i < state->numjobs; i++ )
+	{
+		const maplist_entry_t	*job = &state->jobs[i];
+		dmaplist_entry_t	out;
+
+		out.filetime = job->filetime;
+		out.enttime = job->enttime;
+		out.filesize = job->filesize;
+		out.spawnpoints = job->spawnpoints;
+		out.namelen = Q_strlen( job->filename );
+		out.messagelen = Q_strlen( job->message );
+
+		FS_Write( f, &out, sizeof( out ));
+		FS_Write( f, job->filename, out.namelen );
+		FS_Write( f, job->message, out.messagelen );
+	}
+
+	FS_Close( f );
+}
+
+/*
+=====================================
+Cmd_TestMap
+
+returns true if map has spawn points for this game and its title in message
+=====================================
+*/
+static qboolean Cmd_TestMap( maplist_state_t *state, const char *filename, const char *entfilename, char *message, size_t len )
 {
-	qboolean	use_filter = false;
+	qboolean	have_spawnpoints = false;
 	byte	buf[MAX_SYSPATH];
+	char	*ents = NULL, *pfile;
+	int	lumpofs = 0, lumplen = 0;
+	dlump_t	entities;
+	qboolean	valid;
+	file_t	*f;
+
+	if(( f = FS_Open( filename, "rb", state->onlyingamedir )) == NULL )
+		return false;
+
+	memset( buf, 0, MAX_SYSPATH );
+	FS_Read( f, buf, MAX_SYSPATH );
+
+	// check all the lumps and some other errors
+#ifdef HAVE_MAPLIST_THREADS
+	mutex_lock( state->modlock );
+#endif
+	valid = Mod_TestBmodelLumps( f, filename, buf, true, &entities );
+#ifdef HAVE_MAPLIST_THREADS
+	mutex_unlock( state->modlock );
+#endif
+
+	if( !valid )
+	{
+		FS_Close( f );
+		return false;
+	}
+
+	// after call Mod_TestBmodelLumps we gurantee what map is valid
+	lumpofs = entities.fileofs;
+	lumplen = entities.filelen;
+
+	ents = (char *)FS_LoadFile( entfilename, NULL, true );
+
+	if( !ents && lumplen >= 10 )
+	{
+		FS_Seek( f, lumpofs, SEEK_SET );
+		ents = Z_Calloc( lumplen + 1 );
+		FS_Read( f, ents, lumplen );
+	}
+
+	FS_Close( f );
+
+	if( ents )
+	{
+		// if there are entities to parse, a missing message key just
+		// means there is no title, so clear the message string now
+		char	token[MAX_TOKEN];
+		qboolean	worldspawn = true;
+
+		Q_strncpy( message, "No Title", len );
+		pfile = ents;
+
+		while(( pfile = COM_ParseFile( pfile, token, sizeof( token ))) != NULL )
+		{
+			if( token[0] == '}' && worldspawn )
+			{
+				worldspawn = false;
+
+				// if mod has mp_filter set up, then it's a mod that
+				// might not have valid mp_entity set in GI
+				// if mod is multiplayer only, assume all maps are valid
+				if( state->use_filter || GI->gamemode == GAME_MULTIPLAYER_ONLY )
+				{
+					have_spawnpoints = true;
+					break;
+				}
+			}
+			else if( !Q_strcmp( token, "message" ) && worldspawn )
+			{
+				// get the message contents
+				pfile = COM_ParseFile( pfile, message, len );
+			}
+			else if( !Q_strcmp( token, "classname" ))
+			{
+				pfile = COM_ParseFile( pfile, token, sizeof( token ));
+
+				if( !Q_strcmp( token, GI->mp_entity ))
+				{
+					have_spawnpoints = true;
+					break;
+				}
+			}
+
+			if( have_spawnpoints )
+				break; // valid map
+		}
+		Mem_Free( ents );
+	}
+
+	return have_spawnpoints;
+}
+
+/*
+=====================================
+Cmd_ProbeMap
+
+fills the job from cache or by reading the map
+=====================================
+*/
+static void Cmd_ProbeMap( maplist_state_t *state, maplist_entry_t *job )
+{
+	const maplist_entry_t	*entry;
+	string		entfilename;
+
+	Q_strncpy( entfilename, job->filename, sizeof( entfilename ));
+	COM_ReplaceExtension( entfilename, ".ent", sizeof( entfilename ));
+
+	job->filetime = FS_FileTime( job->filename, state->onlyingamedir );
+	job->filesize = FS_FileSize( job->filename, state->onlyingamedir );
+	job->enttime = FS_FileTime( entfilename, true );
+
+	for( entry = state->hash[COM_HashKey( job->filename, MAPLIST_CACHE_HASH )]; entry; entry = entry->next )
+	{
+		if( entry->filetime != job->filetime || entry->filesize != job->filesize || entry->enttime != job->enttime )
+			continue;
+
+		if( Q_stricmp( entry->filename, job->filename ))
+			continue;
+
+		job->spawnpoints = entry->spawnpoints;
+		Q_strncpy( job->message, entry->message, sizeof( job->message ));
+		job->cached = true;
+		return;
+	}
+
+	job->spawnpoints = Cmd_TestMap( state, job->filename, entfilename, job->message, sizeof( job->message ));
+}
+
+static void Cmd_ProbeMapsWorker( maplist_state_t *state )
+{
+	while( true )
+	{
+		int i;
+
+#ifdef HAVE_MAPLIST_THREADS
+		mutex_lock( state->joblock );
+		i = state->nextjob++;
+		mutex_unlock( state->joblock );
+#else
+		i = state->nextjob++;
+#endif
+
+		if( i >= state->numjobs )
+			break;
+
+		Cmd_ProbeMap( state, &state->jobs[i] );
+	}
+}
+
+#ifdef HAVE_MAPLIST_THREADS
+static THREAD_RETURN_TYPE Cmd_ProbeMapsThread( void *arg )
+{
+	Cmd_ProbeMapsWorker( arg );
+	Mem_FlushThreadCache();
+	return THREAD_RETURN_VALUE;
+}
+#endif
+
+/*
+=====================================
+Cmd_ProbeMaps
+
+probes all jobs, spreading them across threads
+=====================================
+*/
+static void Cmd_ProbeMaps( maplist_state_t *state )
+{
+#ifdef HAVE_MAPLIST_THREADS
+	maplist_thread_t	threads[MAPLIST_THREADS];
+	int		i, numthreads = 0;
+
+	mutex_create( state->joblock );
+	mutex_create( state->modlock );
+
+	while( numthreads < MAPLIST_THREADS && state->numjobs >= MAPLIST_MIN_JOBS * ( numthreads + 2 ))
+	{
+		if( !create_thread( threads[numthreads], Cmd_ProbeMapsThread, state ))
+			break;
+		numthreads++;
+	}
+
+	// main thread takes part too
+	Cmd_ProbeMapsWorker( state );
+
+	for( i = 0; i < numthreads; i++ )
+		join_thread( threads[i] );
+
+	mutex_destroy( state->joblock );
+	mutex_destroy( state->modlock );
+#else
+	Cmd_ProbeMapsWorker( state );
+#endif
+}
+
+static qboolean Cmd_CheckMapsList_R( qboolean fRefresh, qboolean onlyingamedir )
+{
+	maplist_state_t	*state;
 	string	mpfilter;
 	char	*buffer;
-	size_t	buffersize;
-	string	result;
-	int	i, size;
+	size_t	buffersize, size;
+	int	i, numcached;
 	search_t	*t;
-	file_t	*f;
 
 	if( FS_FileSize( "maps.lst", onlyingamedir ) > 0 && !fRefresh )
 		return true; // exist
@@ -879,119 +1301,59 @@ static qboolean Cmd_CheckMapsList_R( qboolean fRefresh, qboolean onlyingamedir )
 		return false;
 	}
 
-	buffersize = t->numfilenames * 2 * sizeof( result );
-	buffer = Mem_Calloc( host.mempool, buffersize );
-	use_filter = COM_CheckStringEmpty( GI->mp_filter ) ? true : false;
+	state = Mem_Calloc( host.mempool, sizeof( *state ));
+	state->onlyingamedir = onlyingamedir;
+	state->use_filter = COM_CheckStringEmpty( GI->mp_filter ) ? true : false;
+	state->jobs = Mem_Calloc( host.mempool, sizeof( maplist_entry_t ) * t->numfilenames );
 
 	for( i = 0; i < t->numfilenames; i++ )
 	{
-		char		*ents = NULL, *pfile;
-		int		lumpofs = 0, lumplen = 0;
-		string		mapname, message, entfilename;
-
 		if( Q_stricmp( COM_FileExtension( t->filenames[i] ), "bsp" ))
 			continue;
 
-		if( use_filter && Q_stristr( t->filenames[i], mpfilter ))
+		if( state->use_filter && Q_stristr( t->filenames[i], mpfilter ))
 			continue;
 
-		f = FS_Open( t->filenames[i], "rb", onlyingamedir );
-		COM_FileBase( t->filenames[i], mapname, sizeof( mapname ));
-
-		if( f )
-		{
-			qboolean  have_spawnpoints = false;
-			dlump_t   entities;
-
-			memset( buf, 0, MAX_SYSPATH );
-			FS_Read( f, buf, MAX_SYSPATH );
-
-			// check all the lumps and some other errors
-			if( !Mod_TestBmodelLumps( f, t->filenames[i], buf, true, &entities ))
-			{
-				FS_Close( f );
-				continue;
-			}
-
-			// after call Mod_TestBmodelLumps we gurantee what map is valid
-			lumpofs = entities.fileofs;
-			lumplen = entities.filelen;
-
-			Q_strncpy( entfilename, t->filenames[i], sizeof( entfilename ));
-			COM_ReplaceExtension( entfilename, ".ent", sizeof( entfilename ));
-			ents = (char *)FS_LoadFile( entfilename, NULL, true );
+		Q_strncpy( state->jobs[state->numjobs].filename, t->filenames[i], sizeof( state->jobs[0].filename ));
+		state->numjobs++;
+	}
 
-			if( !ents && lumplen >= 10 )
-			{
-				FS_Seek( f, lumpofs, SEEK_SET );
-				ents = Z_Calloc( lumplen + 1 );
-				FS_Read( f, ents, lumplen );
-			}
+	Mem_Free( t ); // free search result
 
-			if( ents )
-			{
-				// if there are entities to parse, a missing message key just
-				// means there is no title, so clear the message string now
-				char	token[MAX_TOKEN];
-				qboolean	worldspawn = true;
-
-				Q_strncpy( message, "No Title", sizeof( message ));
-				pfile = ents;
+	Cmd_LoadMapsListCache( state );
+	Cmd_ProbeMaps( state );
 
-				while(( pfile = COM_ParseFile( pfile, token, sizeof( token ))) != NULL )
-				{
-					if( token[0] == '}' && worldspawn )
-					{
-						worldspawn = false;
-
-						// if mod has mp_filter set up, then it's a mod that
-						// might not have valid mp_entity set in GI
-						// if mod is multiplayer only, assume all maps are valid
-						if( use_filter || GI->gamemode == GAME_MULTIPLAYER_ONLY )
-						{
-							have_spawnpoints = true;
-							break;
-						}
-					}
-					else if( !Q_strcmp( token, "message" ) && worldspawn )
-					{
-						// get the message contents
-						pfile = COM_ParseFile( pfile, message, sizeof( message ));
-					}
-					else if( !Q_strcmp( token, "classname" ))
-					{
-						pfile = COM_ParseFile( pfile, token, sizeof( token ));
+	buffersize = state->numjobs * 2 * sizeof( string ) + 1;
+	buffer = Mem_Calloc( host.mempool, buffersize );
 
-						if( !Q_strcmp( token, GI->mp_entity ))
-						{
-							have_spawnpoints = true;
-							break;
-						}
-					}
+	for( i = 0, size = 0, numcached = 0; i < state->numjobs; i++ )
+	{
+		const maplist_entry_t *job = &state->jobs[i];
+		string mapname;
 
-					if( have_spawnpoints )
-						break; // valid map
-				}
-				Mem_Free( ents );
-			}
+		if( job->cached )
+			numcached++;
 
-			if( f ) FS_Close( f );
+		if( !job->spawnpoints )
+			continue;
 
-			if( have_spawnpoints )
-			{
-				// format: mapname "maptitle"\n
-				Q_snprintf( result, sizeof( result ), "%s \"%s\"\n", mapname, message );
-				Q_strncat( buffer, result, buffersize ); // add new string
-			}
-		}
+		// format: mapname "maptitle"\n
+		COM_FileBase( job->filename, mapname, sizeof( mapname ));
+		size += Q_snprintf( buffer + size, buffersize - size, "%s \"%s\"\n", mapname, job->message );
 	}
 
-	if( t ) Mem_Free( t ); // free search result
-	size = Q_strlen( buffer );
+	// nothing changed since last time
+	if( numcached != state->numjobs || numcached != state->numcached )
+		Cmd_SaveMapsListCache( state );
+
+	if( state->cached )
+		Mem_Free( state->cached );
+	Mem_Free( state->jobs );
+	Mem_Free( state );
 
 	if( !size )
 	{
-		if( buffer ) Mem_Free( buffer );
+		Mem_Free( buffer );
 
 		if( onlyingamedir )
 			return Cmd_CheckMapsList_R( fRefresh, false );
@@ -999,11 +1361,13 @@ static qboolean Cmd_CheckMapsList_R( qboolean fRefresh, qboolean onlyingamedir )
 	}
 
 	// write generated maps.lst
-	if( FS_WriteFile( "maps.lst", buffer, size))
+	if( FS_WriteFile( "maps.lst", buffer, size ))
 	{
-		if( buffer ) Mem_Free( buffer );
+		Mem_Free( buffer );
 		return true;
 	}
+
+	Mem_Free( buffer );
 	return false;
 }
 
@@ -1552,3 +1916,163 @@ void Key_EnumCmds_f( void )
 	else Con_Printf( S_ERROR "couldn't write help.txt.\n");
 	FS_AllowDirectPaths( false );
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+#define TEST_MAPS 40 // enough to start threads
+
+static void Test_SetLump( dheader_t *hdr, int lump, int fileofs, int filelen )
+{
+	hdr->lumps[lump].fileofs = fileofs;
+	hdr->lumps[lump].filelen = filelen;
+}
+
+static void Test_WriteMap( const char *filename, int version, const char *ents )
+{
+	byte	data[256]; // shared by all lumps map can't go without
+	int	entslen = Q_strlen( ents );
+	int	dataofs = sizeof( dheader_t ) + entslen;
+	dheader_t	hdr;
+	file_t	*f;
+
+	memset( &hdr, 0, sizeof( hdr ));
+	memset( data, 0, sizeof( data ));
+	hdr.version = version;
+	Test_SetLump( &hdr, LUMP_ENTITIES, sizeof( hdr ), entslen );
+	Test_SetLump( &hdr, LUMP_PLANES, dataofs, sizeof( dplane_t ));
+	Test_SetLump( &hdr, LUMP_TEXTURES, dataofs, sizeof( int ));
+	Test_SetLump( &hdr, LUMP_NODES, dataofs, sizeof( dnode_t ));
+	Test_SetLump( &hdr, LUMP_LEAFS, dataofs, sizeof( dleaf_t ));
+	Test_SetLump( &hdr, LUMP_MODELS, dataofs, sizeof( dmodel_t ));
+
+	if(( f = FS_Open( filename, "wb", true )) == NULL )
+		return;
+
+	FS_Write( f, &hdr, sizeof( hdr ));
+	FS_Write( f, ents, entslen );
+	FS_Write( f, data, sizeof( data ));
+	FS_Close( f );
+}
+
+static void Test_WriteMaps( int seed )
+{
+	char	filename[64], ents[256];
+	int	i;
+
+	for( i = 0; i < TEST_MAPS; i++ )
+	{
+		Q_snprintf( filename, sizeof( filename ), "maps/test%02d.bsp", i );
+
+		if( i % 3 == 0 ) // singleplayer map
+			Q_snprintf( ents, sizeof( ents ), "{\n\"classname\" \"worldspawn\"\n}\n{\n\"classname\" \"info_player_start\"\n}\n" );
+		else if( i % 3 == 1 ) // deathmatch map with title
+			Q_snprintf( ents, sizeof( ents ), "{\n\"message\" \"Test map %d-%d\"\n\"classname\" \"worldspawn\"\n}\n{\n\"classname\" \"info_player_deathmatch\"\n}\n", i, seed );
+		else // deathmatch map without title
+			Q_snprintf( ents, sizeof( ents ), "{\n\"classname\" \"worldspawn\"\n}\n{\n\"classname\" \"info_player_deathmatch\"\n}\n" );
+
+		Test_WriteMap( filename, i == 5 ? 12345 : HLBSP_VERSION, ents );
+	}
+}
+
+static char *Test_BuildMapsList( void )
+{
+	char *list;
+
+	TASSERT( Cmd_CheckMapsList_R( true, true ));
+	list = (char *)FS_LoadFile( "maps.lst", NULL, true );
+	TASSERT( list != NULL );
+
+	return list;
+}
+
+void Test_RunMapsList( void )
+{
+	gameinfo_t	gameinfo, *oldgameinfo = GI;
+	char		*ref, *list;
+	byte		*cache, *cache2;
+	fs_offset_t	cachesize, cachesize2;
+	string		filename;
+	int		i;
+
+	// gameinfo isn't loaded yet
+	memset( &gameinfo, 0, sizeof( gameinfo ));
+	Q_strncpy( gameinfo.mp_entity, "info_player_deathmatch", sizeof( gameinfo.mp_entity ));
+	FI->GameInfo = &gameinfo;
+
+	FS_AddGameDirectory( "test_maps/", FS_GAMEDIR_PATH );
+	FS_Delete( MAPLIST_CACHE );
+	FS_Delete( MAPLIST_CACHE_ALL );
+	Test_WriteMaps( 0 );
+
+	// no cache
+	ref = Test_BuildMapsList();
+	TASSERT( FS_FileExists( MAPLIST_CACHE, true ));
+
+	if( ref )
+	{
+		TASSERT( Q_strstr( ref, "test01 \"Test map 1-0\"\ntest02 \"No Title\"\ntest04 \"Test map 4-0\"\ntest07 \"Test map 7-0\"\n" ) == ref );
+		TASSERT( Q_strstr( ref, "test00" ) == NULL );
+		TASSERT( Q_strstr( ref, "test05" ) == NULL );
+	}
+
+	// everything is cached, result must be the same
+	list = Test_BuildMapsList();
+	if( ref && list )
+	{
+		TASSERT_STR( list, ref );
+	}
+
+	if( list )
+		Mem_Free( list );
+
+	// search over all paths has it's own cache and keeps gamedir one
+	cache = FS_LoadFile( MAPLIST_CACHE, &cachesize, true );
+	TASSERT( Cmd_CheckMapsList_R( true, false ));
+	TASSERT( FS_FileExists( MAPLIST_CACHE_ALL, true ));
+	cache2 = FS_LoadFile( MAPLIST_CACHE, &cachesize2, true );
+	TASSERT( cache != NULL && cache2 != NULL );
+
+	if( cache && cache2 )
+	{
+		TASSERT( cachesize == cachesize2 && !memcmp( cache, cache2, cachesize ));
+	}
+
+	if( cache )
+		Mem_Free( cache );
+	if( cache2 )
+		Mem_Free( cache2 );
+
+	// changed maps must be probed again
+	Test_WriteMaps( 10 ); // size changes too, file time may stay the same within a second
+	list = Test_BuildMapsList();
+	if( list )
+	{
+		TASSERT( Q_strstr( list, "test01 \"Test map 1-10\"\n" ) == list );
+		Mem_Free( list );
+	}
+
+	// and cache must be ignored after gameinfo changes
+	Q_strncpy( gameinfo.mp_entity, "info_player_start", sizeof( gameinfo.mp_entity ));
+	list = Test_BuildMapsList();
+	if( list )
+	{
+		TASSERT( Q_strstr( list, "test00 \"No Title\"\ntest03 \"No Title\"\n" ) == list );
+		Mem_Free( list );
+	}
+
+	if( ref )
+		Mem_Free( ref );
+
+	for( i = 0; i < TEST_MAPS; i++ )
+	{
+		Q_snprintf( filename, sizeof( filename ), "maps/test%02d.bsp", i );
+		FS_Delete( filename );
+	}
+	FS_Delete( MAPLIST_CACHE );
+	FS_Delete( MAPLIST_CACHE_ALL );
+	FS_Delete( "maps.lst" );
+
+	FI->GameInfo = oldgameinfo;
+}
+#endif /* XASH_ENGINE_TESTS */
@@ -52,6 +52,16 @@ byte *FS_LoadDirectFile( const char *path, fs_offset_t *filesizeptr )
 	return g_fsapi.LoadDirectFile( path, filesizeptr );
 }
 
+void FS_UnmapFile( byte *data )
+{
+	g_fsapi.UnmapFile( data );
+}
+
+byte *FS_MapFile( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly )
+{
+	return g_fsapi.MapFile( path, filesizeptr, gamedironly );
+}
+
 static void COM_StripDirectorySlash( char *pname )
 {
 	size_t len;
@@ -98,6 +108,8 @@ static const fs_interface_t fs_memfuncs =
 	_Mem_Free,
 
 	Sys_GetNativeObject,
+
+	Mem_FlushThreadCache,
 };
 
 static void FS_UnloadProgs( void )
@@ -124,6 +124,7 @@ static void Sys_PrintUsage( const char *exename )
 	O("-bugcomp [opts]  ", "enable precise bug compatibility")
 	O("                 ", "will break games that don't require it")
 	O("                 ", "refer to engine documentation for more info")
+	O("-memprofile      ", "profile allocations from startup, see memprofile command")
 	O("-disablehelp     ", "disable this message")
 #if !XASH_DEDICATED
 	O("-dedicated       ", "run engine in dedicated mode")
@@ -501,6 +502,45 @@ static void Host_MemStats_f( void )
 	}
 }
 
+/*
+===============
+Host_MemProfile_f
+===============
+*/
+static void Host_MemProfile_f( void )
+{
+	const char *cmd = Cmd_Argv( 1 );
+
+	if( !Q_stricmp( cmd, "start" ))
+	{
+		Mem_ProfileEnable( true );
+	}
+	else if( !Q_stricmp( cmd, "stop" ))
+	{
+		Mem_ProfileEnable( false );
+	}
+	else if( !Q_stricmp( cmd, "reset" ))
+	{
+		Mem_ProfileReset();
+	}
+	else if( !Q_stricmp( cmd, "print" ))
+	{
+		memprofilesort_t sort = MEMPROFILE_ALLOCS;
+		int count = Cmd_Argc() > 2 ? Q_atoi( Cmd_Argv( 2 )) : 20;
+
+		if( !Q_stricmp( Cmd_Argv( 3 ), "bytes" ))
+			sort = MEMPROFILE_BYTES;
+		else if( !Q_stricmp( Cmd_Argv( 3 ), "live" ))
+			sort = MEMPROFILE_LIVE;
+
+		Mem_ProfilePrint( count, sort );
+	}
+	else
+	{
+		Con_Printf( S_USAGE "memprofile <start|stop|reset|print> [count] [allocs|bytes|live]\n" );
+	}
+}
+
 static void Host_Minimize_f( void )
 {
 #ifdef XASH_SDL
@@ -758,6 +798,9 @@ void Host_Frame( double time )
 	Host_ServerFrame (); // server frame
 	Host_ClientFrame (); // client frame
 	HTTP_Run();			 // both server and client
+	FS_ProcessAsync( false ); // deliver files loaded by I/O threads
+	Mem_ScratchReset();	 // release transient buffers
+	Mem_ProfileFrame();
 
 	host.framecount++;
 	host.pureframetime = Sys_DoubleTime() - t1;
@@ -1005,6 +1048,10 @@ static void Host_InitCommon( int argc, char **argv, const char *progname, qboole
 
 	Memory_Init(); // init memory subsystem
 
+	// count allocations from the very start
+	if( Sys_CheckParm( "-memprofile" ))
+		Mem_ProfileEnable( true );
+
 	host.mempool = Mem_AllocPool( "Zone Engine" );
 
 	host.allow_console = DEFAULT_ALLOWCONSOLE;
@@ -1097,6 +1144,7 @@ static void Host_InitCommon( int argc, char **argv, const char *progname, qboole
 
 	Cmd_AddCommand( "exec", Host_Exec_f, "execute a script file" );
 	Cmd_AddCommand( "memlist", Host_MemStats_f, "prints memory pool information" );
+	Cmd_AddCommand( "memprofile", Host_MemProfile_f, "profiles allocations by pool and call site" );
 	Cmd_AddRestrictedCommand( "userconfigd", Host_Userconfigd_f, "execute all scripts from userconfig.d" );
 
 	Image_Init();
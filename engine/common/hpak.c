@@ -17,6 +17,7 @@ GNU General Public License for more details.
 #include "hpak.h"
 
 #define HPAK_MAX_ENTRIES	0x8000
+#define HPAK_INDEX_HASH	1024	// must be power of two
 
 typedef struct hash_pack_queue_s
 {
@@ -27,9 +28,23 @@ typedef struct hash_pack_queue_s
 	struct hash_pack_queue_s	*next;
 } hash_pack_queue_t;
 
+typedef struct hpak_index_s
+{
+	string			pakname;
+	int			filetime;
+	fs_offset_t		filesize;
+	int			infotableofs;
+	int			count;
+	hpak_lump_t		*entries;			// copy of directory
+	int			*chain;			// next entry with same hash or -1
+	int			buckets[HPAK_INDEX_HASH];	// first entry with this hash or -1
+	struct hpak_index_s		*next;
+} hpak_index_t;
+
 static CVAR_DEFINE( hpk_maxsize, "hpk_max_size", "64", FCVAR_ARCHIVE|FCVAR_PRIVILEGED, "set limit by size for all HPK-files in megabytes ( 0 - unlimited )" );
 CVAR_DEFINE_AUTO( hpk_custom_file, "custom.hpk", FCVAR_ARCHIVE|FCVAR_PRIVILEGED, "set custom path for players customizations cache file" );
 static hash_pack_queue_t	*gp_hpak_queue = NULL;
+static hpak_index_t	*gp_hpak_index = NULL;
 static hpak_header_t	hash_pack_header;
 static hpak_info_t	hash_pack_info;
 
@@ -65,6 +80,339 @@ static inline void HPAK_ResourceFromCompat( resource_t *dest, dresource_t *src )
 	dest->pNext = dest->pPrev = (void*)0xDEADBEEF;
 }
 
+/*
+==============================================================================
+
+HPAK INDEX
+
+Directories of opened HPAKs are kept in memory and hashed by MD5, so
+lookups don't read the whole directory. Writers update the index with
+the directory they just wrote, file time and size catch everything else
+
+==============================================================================
+*/
+static uint HPAK_HashMD5( const byte *md5 )
+{
+	uint	hash;
+
+	// MD5 is uniform enough already
+	memcpy( &hash, md5, sizeof( hash ));
+	return hash & ( HPAK_INDEX_HASH - 1 );
+}
+
+static void HPAK_FreeIndex( hpak_index_t *index )
+{
+	if( index->entries )
+		Mem_Free( index->entries );
+	if( index->chain )
+		Mem_Free( index->chain );
+	Mem_Free( index );
+}
+
+static void HPAK_InvalidateIndex( const char *pakname )
+{
+	hpak_index_t	**prev, *index;
+
+	for( prev = &gp_hpak_index; *prev != NULL; prev = &( *prev )->next )
+	{
+		index = *prev;
+
+		if( !Q_stricmp( index->pakname, pakname ))
+		{
+			*prev = index->next;
+			HPAK_FreeIndex( index );
+			return;
+		}
+	}
+}
+
+/*
+=================
+HPAK_SetIndex
+
+Replaces index of the pak with a copy of directory, must be called after the file was written
+=================
+*/
+static hpak_index_t *HPAK_SetIndex( const char *pakname, int infotableofs, const hpak_lump_t *entries, int count )
+{
+	hpak_index_t	*index;
+	int		i;
+
+	HPAK_InvalidateIndex( pakname );
+
+	index = Z_Malloc( sizeof( *index ));
+	Q_strncpy( index->pakname, pakname, sizeof( index->pakname ));
+	index->filetime = FS_FileTime( pakname, true );
+	index->filesize = FS_FileSize( pakname, true );
+	index->infotableofs = infotableofs;
+	index->count = count;
+	index->entries = Z_Malloc( sizeof( hpak_lump_t ) * count );
+	index->chain = Z_Malloc( sizeof( int ) * count );
+	memcpy( index->entries, entries, sizeof( hpak_lump_t ) * count );
+
+	for( i = 0; i < HPAK_INDEX_HASH; i++ )
+		index->buckets[i] = -1;
+
+	// link backwards, so first entry in directory is found first
+	for( i = count - 1; i >= 0; i-- )
+	{
+		uint hash = HPAK_HashMD5( entries[i].resource.rgucMD5_hash );
+
+		index->chain[i] = index->buckets[hash];
+		index->buckets[hash] = i;
+	}
+
+	index->next = gp_hpak_index;
+	gp_hpak_index = index;
+
+	return index;
+}
+
+/*
+=================
+HPAK_GetIndex
+
+Returns index of the pak, reads its directory if it's not indexed yet or was changed
+=================
+*/
+static hpak_index_t *HPAK_GetIndex( const char *pakname )
+{
+	hpak_header_t	header;
+	hpak_info_t	directory;
+	hpak_index_t	*index;
+	file_t		*f;
+
+	for( index = gp_hpak_index; index != NULL; index = index->next )
+	{
+		if( Q_stricmp( index->pakname, pakname ))
+			continue;
+
+		if( index->filetime == FS_FileTime( pakname, true ) && index->filesize == FS_FileSize( pakname, true ))
+			return index;
+
+		HPAK_InvalidateIndex( pakname );
+		break;
+	}
+
+	f = FS_Open( pakname, "rb", true );
+	if( !f ) return NULL;
+
+	FS_Read( f, &header, sizeof( header ));
+
+	if( header.ident != IDHPAKHEADER || header.version != IDHPAK_VERSION )
+	{
+		FS_Close( f );
+		return NULL;
+	}
+
+	FS_Seek( f, header.infotableofs, SEEK_SET );
+	FS_Read( f, &directory.count, sizeof( directory.count ));
+
+	if( directory.count < 1 || directory.count > HPAK_MAX_ENTRIES )
+	{
+		FS_Close( f );
+		return NULL;
+	}
+
+	directory.entries = Z_Malloc( sizeof( hpak_lump_t ) * directory.count );
+
+	if( FS_Read( f, directory.entries, sizeof( hpak_lump_t ) * directory.count ) != sizeof( hpak_lump_t ) * directory.count )
+	{
+		Mem_Free( directory.entries );
+		FS_Close( f );
+		return NULL;
+	}
+
+	FS_Close( f );
+
+	index = HPAK_SetIndex( pakname, header.infotableofs, directory.entries, directory.count );
+	Mem_Free( directory.entries );
+
+	return index;
+}
+
+/*
+=================
+HPAK_IndexLookup
+
+Returns first lump with this hash, if needdata is set the lump must also have data
+=================
+*/
+static const hpak_lump_t *HPAK_IndexLookup( const hpak_index_t *index, const byte *hash, qboolean needdata )
+{
+	int	i;
+
+	for( i = index->buckets[HPAK_HashMD5( hash )]; i >= 0; i = index->chain[i] )
+	{
+		const hpak_lump_t *entry = &index->entries[i];
+
+		if( memcmp( entry->resource.rgucMD5_hash, hash, 16 ))
+			continue;
+
+		if( needdata && ( entry->filepos <= 0 || entry->disksize <= 0 ))
+			continue;
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+/*
+=================
+HPAK_UnusedSpace
+
+Lumps and directories are always appended, so removed lumps and old
+directories stay in file, returns how many bytes can be freed by HPAK_Compact
+=================
+*/
+static fs_offset_t HPAK_UnusedSpace( const hpak_index_t *index )
+{
+	fs_offset_t	used;
+	int		i;
+
+	used = sizeof( hpak_header_t ) + sizeof( index->count ) + sizeof( hpak_lump_t ) * index->count;
+
+	for( i = 0; i < index->count; i++ )
+		used += index->entries[i].disksize;
+
+	return index->filesize - used;
+}
+
+/*
+=================
+HPAK_WriteDirectory
+
+Writes directory at infotableofs of already opened pak, header goes last,
+so it points to the previous directory until the new one is complete
+=================
+*/
+static void HPAK_WriteDirectory( file_t *f, int infotableofs, const hpak_lump_t *entries, int count )
+{
+	hpak_header_t	header;
+
+	FS_Seek( f, infotableofs, SEEK_SET );
+	FS_Write( f, &count, sizeof( count ));
+	FS_Write( f, entries, sizeof( hpak_lump_t ) * count );
+
+	header.ident = IDHPAKHEADER;
+	header.version = IDHPAK_VERSION;
+	header.infotableofs = infotableofs;
+
+	FS_Seek( f, 0, SEEK_SET );
+	FS_Write( f, &header, sizeof( header ));
+}
+
+/*
+=================
+HPAK_Compact
+
+Rewrites the pak without unused space, the result is always in write directory
+=================
+*/
+static qboolean HPAK_Compact( const char *pakname )
+{
+	hpak_header_t	header;
+	hpak_index_t	*index;
+	hpak_lump_t	*entries;
+	string		tempname;
+	file_t		*file_src;
+	file_t		*file_dst;
+	int		i;
+
+	if(( index = HPAK_GetIndex( pakname )) == NULL )
+		return false;
+
+	Q_strncpy( tempname, pakname, sizeof( tempname ));
+	COM_ReplaceExtension( tempname, ".hp2", sizeof( tempname ));
+
+	if(( file_src = FS_Open( pakname, "rb", true )) == NULL )
+		return false;
+
+	if(( file_dst = FS_Open( tempname, "wb", true )) == NULL )
+	{
+		Con_DPrintf( S_ERROR "%s: couldn't open %s.\n", __func__, tempname );
+		FS_Close( file_src );
+		return false;
+	}
+
+	memset( &header, 0, sizeof( header ));
+	FS_Write( file_dst, &header, sizeof( header ));
+
+	entries = Z_Malloc( sizeof( hpak_lump_t ) * index->count );
+	memcpy( entries, index->entries, sizeof( hpak_lump_t ) * index->count );
+
+	for( i = 0; i < index->count; i++ )
+	{
+		if( FS_Seek( file_src, entries[i].filepos, SEEK_SET ) == -1 )
+			break;
+
+		entries[i].filepos = FS_Tell( file_dst );
+
+		if( !FS_FileCopy( file_dst, file_src, entries[i].disksize ))
+			break;
+	}
+
+	FS_Close( file_src );
+
+	// original pak is only replaced by complete copy
+	if( i != index->count )
+	{
+		Con_DPrintf( S_ERROR "%s: couldn't read lump %i from %s.\n", __func__, i, pakname );
+		FS_Close( file_dst );
+		FS_Delete( tempname );
+		Mem_Free( entries );
+		return false;
+	}
+
+	header.infotableofs = FS_Tell( file_dst );
+	HPAK_WriteDirectory( file_dst, header.infotableofs, entries, index->count );
+	FS_Close( file_dst );
+
+#if XASH_WIN32
+	// rename doesn't replace existing files here
+	FS_Delete( pakname );
+#endif
+
+	if( !FS_Rename( tempname, pakname ))
+	{
+		Mem_Free( entries );
+		return false;
+	}
+
+	HPAK_SetIndex( pakname, header.infotableofs, entries, index->count );
+	Mem_Free( entries );
+
+	return true;
+}
+
+/*
+=================
+HPAK_OpenForUpdate
+
+Opens indexed pak for appending, if the indexed file isn't
+in write directory, it's copied there first
+=================
+*/
+static file_t *HPAK_OpenForUpdate( const char *pakname, hpak_index_t **index )
+{
+	file_t	*f;
+
+	// old directories pile up with every update, compact when they take more than lumps
+	if( HPAK_UnusedSpace( *index ) <= ( *index )->filesize / 2 && ( f = FS_Open( pakname, "r+b", true )) != NULL )
+	{
+		if( FS_FileLength( f ) == ( *index )->filesize )
+			return f;
+
+		FS_Close( f );
+	}
+
+	if( !HPAK_Compact( pakname ) || ( *index = HPAK_GetIndex( pakname )) == NULL )
+		return NULL;
+
+	return FS_Open( pakname, "r+b", true );
+}
+
 static void HPAK_AddToQueue( const char *name, resource_t *pResource, void *data, file_t *f )
 {
 	hash_pack_queue_t	*p;
@@ -134,11 +482,11 @@ static void HPAK_CreatePak( const char *filename, resource_t *pResource, byte *p
 
 		// there are better ways
 		filelocation = FS_Tell( fin );
-		temp = Z_Malloc( pResource->nDownloadSize );
+		temp = Mem_ScratchAlloc( pResource->nDownloadSize );
 		FS_Read( fin, temp, pResource->nDownloadSize );
 		FS_Seek( fin, filelocation, SEEK_SET );
 		MD5Update( &ctx, temp, pResource->nDownloadSize );
-		Mem_Free( temp );
+		Mem_ScratchFree( temp );
 	}
 	else
 	{
@@ -178,41 +526,25 @@ static void HPAK_CreatePak( const char *filename, resource_t *pResource, byte *p
 	FS_Write( fout, &hash_pack_info.count, sizeof( hash_pack_info.count ));
 	FS_Write( fout, &hash_pack_info.entries[0], sizeof( hpak_lump_t ));
 
-	if( hash_pack_info.entries )
-		Mem_Free( hash_pack_info.entries );
-	memset( &hash_pack_info, 0, sizeof( hpak_info_t ));
-
 	hash_pack_header.infotableofs = filelocation;
 	FS_Seek( fout, 0, SEEK_SET );
 	FS_Write( fout, &hash_pack_header, sizeof( hpak_header_t ));
 	FS_Close( fout );
-}
 
-static qboolean HPAK_FindResource( hpak_info_t *hpk, byte *hash, resource_t *pResource )
-{
-	int	i;
-
-	for( i = 0; i < hpk->count; i++ )
-	{
-		if( !memcmp( hpk->entries[i].resource.rgucMD5_hash, hash, 16 ))
-		{
-			if( pResource )
-				HPAK_ResourceFromCompat( pResource, &hpk->entries[i].resource );
-			return true;
-		}
-	}
+	HPAK_SetIndex( pakname, filelocation, hash_pack_info.entries, hash_pack_info.count );
 
-	return false;
+	if( hash_pack_info.entries )
+		Mem_Free( hash_pack_info.entries );
+	memset( &hash_pack_info, 0, sizeof( hpak_info_t ));
 }
 
 void HPAK_AddLump( qboolean bUseQueue, const char *name, resource_t *pResource, byte *pData, file_t *pFile )
 {
-	int		i, j, position, length;
-	hpak_lump_t	*pCurrentEntry = NULL;
-	string		srcname, dstname;
-	hpak_info_t	srcpak, dstpak;
-	file_t		*file_src;
-	file_t		*file_dst;
+	int		position;
+	hpak_lump_t	*entries, *entry;
+	string		pakname;
+	hpak_index_t	*index;
+	file_t		*f;
 	byte		md5[16];
 	MD5Context_t	ctx;
 
@@ -235,11 +567,11 @@ void HPAK_AddLump( qboolean bUseQueue, const char *name, resource_t *pResource,
 
 		// there are better ways
 		position = FS_Tell( pFile );
-		temp = Z_Malloc( pResource->nDownloadSize );
+		temp = Mem_ScratchAlloc( pResource->nDownloadSize );
 		FS_Read( pFile, temp, pResource->nDownloadSize );
 		FS_Seek( pFile, position, SEEK_SET );
 		MD5Update( &ctx, temp, pResource->nDownloadSize );
-		Mem_Free( temp );
+		Mem_ScratchFree( temp );
 	}
 	else
 	{
@@ -260,124 +592,63 @@ void HPAK_AddLump( qboolean bUseQueue, const char *name, resource_t *pResource,
 		return;
 	}
 
-	Q_strncpy( srcname, name, sizeof( srcname ));
-	COM_ReplaceExtension( srcname, ".hpk", sizeof( srcname ));
-
-	file_src = FS_Open( srcname, "rb", true );
+	Q_strncpy( pakname, name, sizeof( pakname ));
+	COM_ReplaceExtension( pakname, ".hpk", sizeof( pakname ));
 
-	if( !file_src )
+	if(( index = HPAK_GetIndex( pakname )) == NULL )
 	{
-		// just create new pack
-		HPAK_CreatePak( name, pResource, pData, pFile );
+		if( FS_FileExists( pakname, true ))
+			Con_DPrintf( S_ERROR "%s: %s does not have a valid header.\n", __func__, pakname );
+		else HPAK_CreatePak( name, pResource, pData, pFile ); // just create new pack
 		return;
 	}
 
-	Q_strncpy( dstname, srcname, sizeof( dstname ));
-	COM_ReplaceExtension( dstname, ".hp2", sizeof( dstname ));
-
-	file_dst = FS_Open( dstname, "wb", true );
-
-	if( !file_dst )
-	{
-		Con_DPrintf( S_ERROR "%s: couldn't open %s.\n", __func__, srcname );
-		FS_Close( file_src );
+	// already stored, don't touch the pak
+	if( HPAK_IndexLookup( index, md5, false ))
 		return;
-	}
 
-	// load headers
-	FS_Read( file_src, &hash_pack_header, sizeof( hpak_header_t ));
-
-	if( hash_pack_header.version != IDHPAK_VERSION )
+	if( index->count >= HPAK_MAX_ENTRIES )
 	{
-		// we don't check the HPAK bit for some reason.
-		Con_DPrintf( S_ERROR "%s: %s does not have a valid header.\n", __func__, srcname );
-		FS_Close( file_src );
-		FS_Close( file_dst );
+		Con_DPrintf( S_ERROR "%s: %s contain too many lumps.\n", __func__, pakname );
 		return;
 	}
 
-	length = FS_FileLength( file_src );
-	FS_Seek( file_src, 0, SEEK_SET ); // rewind to start of file
-	FS_FileCopy( file_dst, file_src, length );
-
-	FS_Seek( file_src, hash_pack_header.infotableofs, SEEK_SET );
-	FS_Read( file_src, &srcpak.count, sizeof( srcpak.count ));
-
-	if( srcpak.count < 1 || srcpak.count > HPAK_MAX_ENTRIES )
+	if(( f = HPAK_OpenForUpdate( pakname, &index )) == NULL )
 	{
-		Con_DPrintf( S_ERROR "%s: %s contain too many lumps.\n", __func__, srcname );
-		FS_Close( file_src );
-		FS_Close( file_dst );
+		Con_DPrintf( S_ERROR "%s: couldn't open %s.\n", __func__, pakname );
 		return;
 	}
 
-	// load the data
-	srcpak.entries = Z_Malloc( sizeof( hpak_lump_t ) * srcpak.count );
-	FS_Read( file_src, srcpak.entries, sizeof( hpak_lump_t ) * srcpak.count );
+	// new lump and directory are appended, current directory stays valid until header is rewritten
+	entries = Z_Malloc( sizeof( hpak_lump_t ) * ( index->count + 1 ));
+	memcpy( entries, index->entries, sizeof( hpak_lump_t ) * index->count );
 
-	// check if already exists
-	if( HPAK_FindResource( &srcpak, pResource->rgucMD5_hash, NULL ))
-	{
-		Z_Free( srcpak.entries );
-		FS_Close( file_src );
-		FS_Close( file_dst );
-		FS_Delete( dstname );
-		return;
-	}
+	FS_Seek( f, 0, SEEK_END );
 
-	// make a new container
-	dstpak.count = srcpak.count + 1;
-	dstpak.entries = Z_Malloc( sizeof( hpak_lump_t ) * dstpak.count );
-	memcpy( dstpak.entries, srcpak.entries, sizeof( hpak_lump_t ) * srcpak.count );
+	entry = &entries[index->count];
+	memset( entry, 0, sizeof( *entry ));
+	HPAK_ResourceToCompat( &entry->resource, pResource );
+	entry->filepos = FS_Tell( f );
+	entry->disksize = pResource->nDownloadSize;
 
-	// check is there are entry with same hash
-	for( i = 0; i < srcpak.count; i++ )
+	if( pData )
 	{
-		if( memcmp( md5, srcpak.entries[i].resource.rgucMD5_hash, 16 ) == 0 )
-		{
-			pCurrentEntry = &dstpak.entries[i];
-
-			for( j = i; j < srcpak.count; j++ )
-				dstpak.entries[j + 1] = srcpak.entries[j];
-		}
+		FS_Write( f, pData, entry->disksize );
 	}
-
-	if( !pCurrentEntry )
-		pCurrentEntry = &dstpak.entries[dstpak.count-1];
-
-	memset( pCurrentEntry, 0, sizeof( hpak_lump_t ));
-	FS_Seek( file_dst, hash_pack_header.infotableofs, SEEK_SET );
-	HPAK_ResourceToCompat( &pCurrentEntry->resource, pResource );
-	pCurrentEntry->filepos = FS_Tell( file_dst );
-	pCurrentEntry->disksize = pResource->nDownloadSize;
-
-	if( !pData )
-		FS_FileCopy( file_dst, pFile, pCurrentEntry->disksize );
-	else
-		FS_Write( file_dst, pData, pCurrentEntry->disksize );
-
-	hash_pack_header.infotableofs = FS_Tell( file_dst );
-	FS_Write( file_dst, &dstpak.count, sizeof( dstpak.count ));
-
-	for( i = 0; i < dstpak.count; i++ )
+	else if( !FS_FileCopy( f, pFile, entry->disksize ))
 	{
-		FS_Write( file_dst, &dstpak.entries[i], sizeof( hpak_lump_t ));
+		// header still points to the old directory
+		Con_DPrintf( S_ERROR "%s: couldn't read %s.\n", __func__, pResource->szFileName );
+		FS_Close( f );
+		Mem_Free( entries );
+		return;
 	}
 
-	// finalize
-	if( srcpak.entries )
-		Mem_Free( srcpak.entries );
-	if( dstpak.entries )
-		Mem_Free( dstpak.entries );
-
-	FS_Seek( file_dst, 0, SEEK_SET );
-	FS_Write( file_dst, &hash_pack_header, sizeof( hpak_header_t ));
-
-	FS_Close( file_src );
-	FS_Close( file_dst );
+	HPAK_WriteDirectory( f, entry->filepos + entry->disksize, entries, index->count + 1 );
+	FS_Close( f );
 
-	FS_Delete( srcname );
-	FS_Rename( dstname, srcname );
+	HPAK_SetIndex( pakname, entry->filepos + entry->disksize, entries, index->count + 1 );
+	Mem_Free( entries );
 }
 
 static qboolean HPAK_Validate( const char *filename, qboolean quiet, qboolean delete )
@@ -509,6 +780,7 @@ void HPAK_CheckIntegrity( const char *filename )
 
 void HPAK_CheckSize( const char *filename )
 {
+	hpak_index_t	*index;
 	string	pakname;
 	int	maxsize;
 
@@ -521,6 +793,17 @@ void HPAK_CheckSize( const char *filename )
 	Q_strncpy( pakname, filename, sizeof( pakname ));
 	COM_ReplaceExtension( pakname, ".hpk", sizeof( pakname ));
 
+	if( FS_FileSize( pakname, false ) <= ( maxsize * 1024 * 1024 ))
+		return;
+
+	// removed lumps are still in file, try to get rid of them first
+	index = HPAK_GetIndex( pakname );
+	if( index && HPAK_UnusedSpace( index ) > 0 && HPAK_Compact( pakname ))
+	{
+		Con_Printf( "Server: Size of %s > %f MB, compacting.\n", filename, hpk_maxsize.value );
+		Log_Printf( "Server: Size of %s > %f MB, compacting.\n", filename, hpk_maxsize.value );
+	}
+
 	if( FS_FileSize( pakname, false ) > ( maxsize * 1024 * 1024 ))
 	{
 		Con_Printf( "Server: Size of %s > %f MB, deleting.\n", filename, hpk_maxsize.value );
@@ -531,11 +814,9 @@ void HPAK_CheckSize( const char *filename )
 
 qboolean HPAK_ResourceForHash( const char *filename, byte *hash, resource_t *pResource )
 {
-	hpak_info_t	directory;
-	hpak_header_t	header;
+	const hpak_lump_t	*entry;
+	hpak_index_t	*index;
 	string		pakname;
-	qboolean		bFound;
-	file_t		*f;
 	hash_pack_queue_t	*p;
 
 	if( !COM_CheckString( filename ))
@@ -554,39 +835,16 @@ qboolean HPAK_ResourceForHash( const char *filename, byte *hash, resource_t *pRe
 	Q_strncpy( pakname, filename, sizeof( pakname ));
 	COM_ReplaceExtension( pakname, ".hpk", sizeof( pakname ));
 
-	f = FS_Open( pakname, "rb", true );
-	if( !f ) return false;
-
-	FS_Read( f, &header, sizeof( header ));
-
-	if( header.ident != IDHPAKHEADER )
-	{
-		FS_Close( f );
-		return false;
-	}
-
-	if( header.version != IDHPAK_VERSION )
-	{
-		FS_Close( f );
+	if(( index = HPAK_GetIndex( pakname )) == NULL )
 		return false;
-	}
 
-	FS_Seek( f, header.infotableofs, SEEK_SET );
-	FS_Read( f, &directory.count, sizeof( directory.count ));
-
-	if( directory.count < 1 || directory.count > HPAK_MAX_ENTRIES )
-	{
-		FS_Close( f );
+	if(( entry = HPAK_IndexLookup( index, hash, false )) == NULL )
 		return false;
-	}
 
-	directory.entries = Z_Malloc( sizeof( hpak_lump_t ) * directory.count );
-	FS_Read( f, directory.entries, sizeof( hpak_lump_t ) * directory.count );
-	bFound = HPAK_FindResource( &directory, hash, pResource );
-	Mem_Free( directory.entries );
-	FS_Close( f );
+	if( pResource )
+		HPAK_ResourceFromCompat( pResource, (dresource_t *)&entry->resource );
 
-	return bFound;
+	return true;
 }
 
 static qboolean HPAK_ResourceForIndex( const char *filename, int index, resource_t *pResource )
@@ -654,12 +912,10 @@ qboolean HPAK_GetDataPointer( const char *filename, resource_t *pResource, byte
 {
 	byte		*tmpbuf;
 	string		pakname;
-	hpak_header_t	header;
-	hpak_info_t	directory;
-	hpak_lump_t	*entry;
+	const hpak_lump_t	*entry;
+	hpak_index_t	*index;
 	hash_pack_queue_t	*p;
 	file_t		*f;
-	int		i;
 
 	if( !COM_CheckString( filename ))
 		return false;
@@ -688,193 +944,95 @@ qboolean HPAK_GetDataPointer( const char *filename, resource_t *pResource, byte
 	Q_strncpy( pakname, filename, sizeof( pakname ));
 	COM_ReplaceExtension( pakname, ".hpk", sizeof( pakname ));
 
-	f = FS_Open( pakname, "rb", true );
-	if( !f ) return false;
-
-	FS_Read( f, &header, sizeof( header ));
-
-	if( header.ident != IDHPAKHEADER )
-	{
-		Con_DPrintf( S_ERROR "%s it's not a HPK file.\n", pakname );
-		FS_Close( f );
-		return false;
-	}
-
-	if( header.version != IDHPAK_VERSION )
-	{
-		Con_DPrintf( S_ERROR "%s has invalid version (%i should be %i).\n", pakname, header.version, IDHPAK_VERSION );
-		FS_Close( f );
+	if(( index = HPAK_GetIndex( pakname )) == NULL )
 		return false;
-	}
-
-	FS_Seek( f, header.infotableofs, SEEK_SET );
-	FS_Read( f, &directory.count, sizeof( directory.count ));
 
-	if( directory.count < 1 || directory.count > HPAK_MAX_ENTRIES )
-	{
-		Con_DPrintf( S_ERROR "%s: %s has too many lumps %u.\n", __func__, filename, directory.count );
-		FS_Close( f );
+	if(( entry = HPAK_IndexLookup( index, pResource->rgucMD5_hash, true )) == NULL )
 		return false;
-	}
-
-	directory.entries = Z_Malloc( sizeof( hpak_lump_t ) * directory.count );
-	FS_Read( f, directory.entries, sizeof( hpak_lump_t ) * directory.count );
 
-	for( i = 0; i < directory.count; i++ )
+	if( buffer )
 	{
-		entry = &directory.entries[i];
+		f = FS_Open( pakname, "rb", true );
+		if( !f ) return false;
 
-		if( entry->filepos > 0 &&
-			entry->disksize > 0 &&
-			!memcmp( entry->resource.rgucMD5_hash, pResource->rgucMD5_hash, 16 ))
-		{
-			FS_Seek( f, entry->filepos, SEEK_SET );
-
-			if( buffer )
-			{
-				tmpbuf = Z_Malloc( entry->disksize );
-				FS_Read( f, tmpbuf, entry->disksize );
-				*buffer = tmpbuf;
-			}
-
-			if( bufsize )
-				*bufsize = entry->disksize;
-
-			Mem_Free( directory.entries );
-			FS_Close( f );
+		tmpbuf = Z_Malloc( entry->disksize );
+		FS_Seek( f, entry->filepos, SEEK_SET );
+		FS_Read( f, tmpbuf, entry->disksize );
+		FS_Close( f );
 
-			return true;
-		}
+		*buffer = tmpbuf;
 	}
 
-	Mem_Free( directory.entries );
-	FS_Close( f );
+	if( bufsize )
+		*bufsize = entry->disksize;
 
-	return false;
+	return true;
 }
 
 void HPAK_RemoveLump( const char *name, resource_t *pResource )
 {
-	string		read_path;
-	string		save_path;
-	file_t		*file_src;
-	file_t		*file_dst;
-	hpak_info_t	hpak_read;
-	hpak_info_t	hpak_save;
-	int		i, j;
+	string		pakname;
+	hpak_index_t	*index;
+	hpak_lump_t	*entries;
+	file_t		*f;
+	int		i, count;
+	int		infotableofs;
 
 	if( !COM_CheckString( name ) || !pResource )
 		return;
 
 	HPAK_FlushHostQueue();
 
-	Q_strncpy( read_path, name, sizeof( read_path ));
-	COM_ReplaceExtension( read_path, ".hpk", sizeof( read_path ));
-
-	file_src = FS_Open( read_path, "rb", true );
-	if( !file_src )
-	{
-		Con_DPrintf( S_ERROR "%s couldn't open.\n", read_path );
-		return;
-	}
-
-	Q_strncpy( save_path, read_path, sizeof( save_path ));
-	COM_ReplaceExtension( save_path, ".hp2", sizeof( save_path ));
-	file_dst = FS_Open( save_path, "wb", true );
+	Q_strncpy( pakname, name, sizeof( pakname ));
+	COM_ReplaceExtension( pakname, ".hpk", sizeof( pakname ));
 
-	if( !file_dst )
+	if(( index = HPAK_GetIndex( pakname )) == NULL )
 	{
-		Con_DPrintf( S_ERROR "%s couldn't open.\n", save_path );
-		FS_Close( file_src );
+		Con_DPrintf( S_ERROR "%s couldn't open.\n", pakname );
 		return;
 	}
 
-	FS_Seek( file_src, 0, SEEK_SET );
-	FS_Seek( file_dst, 0, SEEK_SET );
-
-	// header copy
-	FS_Read( file_src, &hash_pack_header, sizeof( hpak_header_t ));
-	FS_Write( file_dst, &hash_pack_header, sizeof( hpak_header_t ));
-
-	if( hash_pack_header.ident != IDHPAKHEADER || hash_pack_header.version != IDHPAK_VERSION )
+	if( index->count == 1 )
 	{
-		Con_DPrintf( S_ERROR "%s has invalid header.\n", read_path );
-		FS_Close( file_src );
-		FS_Close( file_dst );
-		FS_Delete( save_path ); // delete temp file
+		Con_DPrintf( S_WARN "%s only has one element, so HPAK will be removed\n", pakname );
+		FS_Delete( pakname );
+		HPAK_InvalidateIndex( pakname );
 		return;
 	}
 
-	FS_Seek( file_src, hash_pack_header.infotableofs, SEEK_SET );
-	FS_Read( file_src, &hpak_read.count, sizeof( hpak_read.count ));
-
-	if( hpak_read.count < 1 || hpak_read.count > HPAK_MAX_ENTRIES )
+	if( !HPAK_IndexLookup( index, pResource->rgucMD5_hash, false ))
 	{
-		Con_DPrintf( S_ERROR "%s has invalid number of lumps.\n", read_path );
-		FS_Close( file_src );
-		FS_Close( file_dst );
-		FS_Delete( save_path ); // delete temp file
+		Con_DPrintf( S_ERROR "HPAK %s doesn't contain specified lump: %s\n", pakname, pResource->szFileName );
 		return;
 	}
 
-	if( hpak_read.count == 1 )
+	if(( f = HPAK_OpenForUpdate( pakname, &index )) == NULL )
 	{
-		Con_DPrintf( S_WARN "%s only has one element, so HPAK will be removed\n", read_path );
-		FS_Close( file_src );
-		FS_Close( file_dst );
-		FS_Delete( read_path );
-		FS_Delete( save_path );
+		Con_DPrintf( S_ERROR "%s couldn't open.\n", pakname );
 		return;
 	}
 
-	hpak_save.count = hpak_read.count - 1;
-	hpak_read.entries = Z_Malloc( sizeof( hpak_lump_t ) * hpak_read.count );
-	hpak_save.entries = Z_Malloc( sizeof( hpak_lump_t ) * hpak_save.count );
-
-	FS_Read( file_src, hpak_read.entries, sizeof( hpak_lump_t ) * hpak_read.count );
-
-	if( !HPAK_FindResource( &hpak_read, pResource->rgucMD5_hash, NULL ))
-	{
-		Con_DPrintf( S_ERROR "HPAK %s doesn't contain specified lump: %s\n", read_path, pResource->szFileName );
-		Mem_Free( hpak_read.entries );
-		Mem_Free( hpak_save.entries );
-		FS_Close( file_src );
-		FS_Close( file_dst );
-		FS_Delete( save_path );
-		return;
-	}
+	Con_Printf( "Removing %s from HPAK %s.\n", pResource->szFileName, pakname );
 
-	Con_Printf( "Removing %s from HPAK %s.\n", pResource->szFileName, read_path );
+	// lump data stays in file until HPAK_Compact, new directory is appended
+	entries = Z_Malloc( sizeof( hpak_lump_t ) * index->count );
 
-	// If there's a collision, we've just corrupted this hpak.
-	for( i = 0, j = 0; i < hpak_read.count; i++ )
+	for( i = 0, count = 0; i < index->count; i++ )
 	{
-		if( !memcmp( hpak_read.entries[i].resource.rgucMD5_hash, pResource->rgucMD5_hash, 16 ))
+		if( !memcmp( index->entries[i].resource.rgucMD5_hash, pResource->rgucMD5_hash, 16 ))
 			continue;
 
-		hpak_save.entries[j] = hpak_read.entries[i];
-		hpak_save.entries[j].filepos = FS_Tell( file_dst );
-		FS_Seek( file_src, hpak_read.entries[j].filepos, SEEK_SET );
-		FS_FileCopy( file_dst, file_src, hpak_save.entries[j].disksize );
-		j++;
+		entries[count++] = index->entries[i];
 	}
 
-	hash_pack_header.infotableofs = FS_Tell( file_dst );
-	FS_Write( file_dst, &hpak_save.count, sizeof( hpak_save.count ));
+	FS_Seek( f, 0, SEEK_END );
+	infotableofs = FS_Tell( f );
 
-	for( i = 0; i < hpak_save.count; i++ )
-		FS_Write( file_dst, &hpak_save.entries[i], sizeof( hpak_lump_t ));
-
-	FS_Seek( file_dst, 0, SEEK_SET );
-	FS_Write( file_dst, &hash_pack_header, sizeof( hpak_header_t ));
-
-	Mem_Free( hpak_read.entries );
-	Mem_Free( hpak_save.entries );
-	FS_Close( file_src );
-	FS_Close( file_dst );
+	HPAK_WriteDirectory( f, infotableofs, entries, count );
+	FS_Close( f );
 
-	FS_Delete( read_path );
-	FS_Rename( save_path, read_path );
+	HPAK_SetIndex( pakname, infotableofs, entries, count );
+	Mem_Free( entries );
 }
 
 static void HPAK_List_f( void )
@@ -1088,6 +1246,36 @@ static void HPAK_Remove_f( void )
 	}
 }
 
+static void HPAK_Compact_f( void )
+{
+	string		pakname;
+	hpak_index_t	*index;
+	fs_offset_t	unused;
+
+	if( Cmd_Argc() != 2 )
+	{
+		Con_Printf( S_USAGE "hpkcompact <hpk>\n" );
+		return;
+	}
+
+	HPAK_FlushHostQueue();
+
+	Q_strncpy( pakname, Cmd_Argv( 1 ), sizeof( pakname ));
+	COM_ReplaceExtension( pakname, ".hpk", sizeof( pakname ));
+
+	if(( index = HPAK_GetIndex( pakname )) == NULL )
+	{
+		Con_DPrintf( S_ERROR "couldn't open %s.\n", pakname );
+		return;
+	}
+
+	unused = HPAK_UnusedSpace( index );
+
+	if( unused > 0 && HPAK_Compact( pakname ))
+		Con_Printf( "%s: freed %s\n", pakname, Q_memprint( unused ));
+	else Con_Printf( "%s: nothing to compact\n", pakname );
+}
+
 static void HPAK_Validate_f( void )
 {
 	if( Cmd_Argc() != 2 )
@@ -1104,6 +1292,7 @@ void HPAK_Init( void )
 	Cmd_AddRestrictedCommand( "hpklist", HPAK_List_f, "list all files in specified HPK-file" );
 	Cmd_AddRestrictedCommand( "hpkremove", HPAK_Remove_f, "remove specified file from HPK-file" );
 	Cmd_AddRestrictedCommand( "hpkval", HPAK_Validate_f, "validate specified HPK-file" );
+	Cmd_AddRestrictedCommand( "hpkcompact", HPAK_Compact_f, "remove unused space from specified HPK-file" );
 	Cmd_AddRestrictedCommand( "hpkextract", HPAK_Extract_f, "extract all lumps from specified HPK-file" );
 	Cmd_AddRestrictedCommand( "hpk_maxsize", HPAK_MaxSize_f, "deprecation notice for hpk_maxsize" );
 	Cvar_RegisterVariable( &hpk_maxsize );
@@ -1111,3 +1300,118 @@ void HPAK_Init( void )
 
 	gp_hpak_queue = NULL;
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+#define TEST_HPAK "test_gen.hpk"
+#define TEST_LUMPS 3
+
+static void Test_MakeLump( resource_t *res, byte *data, int size, int seed )
+{
+	MD5Context_t ctx;
+	int i;
+
+	for( i = 0; i < size; i++ )
+		data[i] = (byte)( i * seed + ( i >> 8 ));
+
+	memset( res, 0, sizeof( *res ));
+	Q_snprintf( res->szFileName, sizeof( res->szFileName ), "tempdecal%i.wad", seed );
+	res->type = t_decal;
+	res->nDownloadSize = size;
+
+	MD5Init( &ctx );
+	MD5Update( &ctx, data, size );
+	MD5Final( res->rgucMD5_hash, &ctx );
+}
+
+static qboolean Test_CheckLump( resource_t *res, byte *data )
+{
+	resource_t found;
+	byte *buf;
+	int size;
+	qboolean ret;
+
+	if( !HPAK_ResourceForHash( TEST_HPAK, res->rgucMD5_hash, &found ))
+		return false;
+
+	if( found.nDownloadSize != res->nDownloadSize || Q_strcmp( found.szFileName, res->szFileName ))
+		return false;
+
+	if( !HPAK_GetDataPointer( TEST_HPAK, res, &buf, &size ))
+		return false;
+
+	ret = size == res->nDownloadSize && !memcmp( buf, data, size );
+	Mem_Free( buf );
+
+	return ret;
+}
+
+void Test_RunHPAK( void )
+{
+	const int sizes[TEST_LUMPS] = { 1024, 2048, 600 };
+	byte *data[TEST_LUMPS];
+	resource_t res[TEST_LUMPS];
+	byte missing[16] = { 0 };
+	fs_offset_t size;
+	int i;
+
+	// HPAKs are only read from game directory, which isn't mounted yet
+	FS_AddGameDirectory( "test_hpak/", FS_GAMEDIR_PATH );
+	FS_Delete( TEST_HPAK );
+
+	for( i = 0; i < TEST_LUMPS; i++ )
+	{
+		size = FS_FileSize( TEST_HPAK, true );
+		data[i] = Z_Malloc( sizes[i] );
+		Test_MakeLump( &res[i], data[i], sizes[i], i + 3 );
+		HPAK_AddLump( false, TEST_HPAK, &res[i], data[i], NULL );
+
+		// new lump and directory are appended, old directory is left until compaction
+		if( i > 0 )
+		{
+			TASSERT( FS_FileSize( TEST_HPAK, true ) == size + sizes[i] + sizeof( int ) + sizeof( hpak_lump_t ) * ( i + 1 ));
+		}
+	}
+
+	for( i = 0; i < TEST_LUMPS; i++ )
+		TASSERT( Test_CheckLump( &res[i], data[i] ));
+
+	TASSERT( !HPAK_ResourceForHash( TEST_HPAK, missing, NULL ));
+
+	// same lump isn't stored twice
+	size = FS_FileSize( TEST_HPAK, true );
+	HPAK_AddLump( false, TEST_HPAK, &res[1], data[1], NULL );
+	TASSERT( FS_FileSize( TEST_HPAK, true ) == size );
+
+	// other lumps must survive removal
+	HPAK_RemoveLump( TEST_HPAK, &res[0] );
+	TASSERT( !HPAK_ResourceForHash( TEST_HPAK, res[0].rgucMD5_hash, NULL ));
+	TASSERT( Test_CheckLump( &res[1], data[1] ));
+	TASSERT( Test_CheckLump( &res[2], data[2] ));
+
+	// and compaction, pak stays readable by old code in between
+	TASSERT( FS_FileSize( TEST_HPAK, true ) == size + sizeof( int ) + sizeof( hpak_lump_t ) * 2 );
+	TASSERT( HPAK_UnusedSpace( HPAK_GetIndex( TEST_HPAK )) > sizes[0] );
+	TASSERT( HPAK_Validate( TEST_HPAK, true, false ));
+	TASSERT( HPAK_Compact( TEST_HPAK ));
+	TASSERT( FS_FileSize( TEST_HPAK, true ) == sizeof( hpak_header_t ) + sizes[1] + sizes[2] + sizeof( int ) + sizeof( hpak_lump_t ) * 2 );
+	TASSERT( HPAK_UnusedSpace( HPAK_GetIndex( TEST_HPAK )) == 0 );
+	TASSERT( Test_CheckLump( &res[1], data[1] ));
+	TASSERT( Test_CheckLump( &res[2], data[2] ));
+
+	// queued lumps are found before and after flush
+	HPAK_AddLump( true, TEST_HPAK, &res[0], data[0], NULL );
+	TASSERT( Test_CheckLump( &res[0], data[0] ));
+	HPAK_FlushHostQueue();
+	TASSERT( Test_CheckLump( &res[0], data[0] ));
+	TASSERT( Test_CheckLump( &res[2], data[2] ));
+
+	// index is dropped with the pak
+	FS_Delete( TEST_HPAK );
+	TASSERT( !HPAK_ResourceForHash( TEST_HPAK, res[2].rgucMD5_hash, NULL ));
+
+	for( i = 0; i < TEST_LUMPS; i++ )
+		Mem_Free( data[i] );
+}
+#endif /* XASH_ENGINE_TESTS */
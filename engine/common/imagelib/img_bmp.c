@@ -390,7 +390,7 @@ qboolean Image_SaveBMP( const char *name, rgbdata_t *pix )
 
 	FS_Write( pfile, &hdr, sizeof( bmp_t ));
 
-	pbBmpBits = Mem_Malloc( host.imagepool, cbBmpBits );
+	pbBmpBits = Mem_ScratchAlloc( cbBmpBits );
 
 	if( pixel_size == 1 )
 	{
@@ -447,7 +447,7 @@ qboolean Image_SaveBMP( const char *name, rgbdata_t *pix )
 	FS_Write( pfile, pbBmpBits, cbBmpBits );
 	FS_Close( pfile );
 
-	Mem_Free( pbBmpBits );
+	Mem_ScratchFree( pbBmpBits );
 
 	return true;
 }
@@ -288,7 +288,7 @@ qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesi
 	rowsize = pixel_size * image.width;
 
 	uncompressed_size = image.height * ( rowsize + 1 ); // +1 for filter
-	uncompressed_buffer = Mem_Malloc( host.imagepool, uncompressed_size );
+	uncompressed_buffer = Mem_ScratchAlloc( uncompressed_size );
 
 	stream.next_in = idat_buf;
 	stream.total_in = stream.avail_in = newsize;
@@ -299,7 +299,7 @@ qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesi
 	if( inflateInit2( &stream, MAX_WBITS ) != Z_OK )
 	{
 		Con_DPrintf( S_ERROR "%s: IDAT chunk decompression failed (%s)\n", __func__, name );
-		Mem_Free( uncompressed_buffer );
+		Mem_ScratchFree( uncompressed_buffer );
 		Mem_Free( idat_buf );
 		return false;
 	}
@@ -312,7 +312,7 @@ qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesi
 	if( ret != Z_OK && ret != Z_STREAM_END )
 	{
 		Con_DPrintf( S_ERROR "%s: IDAT chunk decompression failed (%s)\n", __func__, name );
-		Mem_Free( uncompressed_buffer );
+		Mem_ScratchFree( uncompressed_buffer );
 		return false;
 	}
 
@@ -352,7 +352,7 @@ qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesi
 		break;
 	default:
 		Con_DPrintf( S_ERROR "%s: Found unknown filter type (%s)\n", __func__, name );
-		Mem_Free( uncompressed_buffer );
+		Mem_ScratchFree( uncompressed_buffer );
 		Mem_Free( image.rgba );
 		return false;
 	}
@@ -416,7 +416,7 @@ qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesi
 			break;
 		default:
 			Con_DPrintf( S_ERROR "%s: Found unknown filter type (%s)\n", __func__, name );
-			Mem_Free( uncompressed_buffer );
+			Mem_ScratchFree( uncompressed_buffer );
 			Mem_Free( image.rgba );
 			return false;
 		}
@@ -503,7 +503,7 @@ qboolean Image_LoadPNG( const char *name, const byte *buffer, fs_offset_t filesi
 		break;
 	}
 
-	Mem_Free( uncompressed_buffer );
+	Mem_ScratchFree( uncompressed_buffer );
 
 	return true;
 }
@@ -546,7 +546,7 @@ qboolean Image_SavePNG( const char *name, rgbdata_t *pix )
 	// get filtered image size
 	filtered_size = ( rowsize + 1 ) * pix->height;
 
-	out = filtered_buffer = Mem_Malloc( host.imagepool, filtered_size );
+	out = filtered_buffer = Mem_ScratchAlloc( filtered_size );
 
 	// apply adaptive filter to image
 	switch( pix->type )
@@ -640,7 +640,7 @@ qboolean Image_SavePNG( const char *name, rgbdata_t *pix )
 	// write IHDR chunk CRC
 	png_hdr.ihdr_crc32 = htonl( crc32 );
 
-	out = buffer = (byte *)Mem_Malloc( host.imagepool, outsize );
+	out = buffer = (byte *)Mem_ScratchAlloc( outsize );
 
 	stream.next_in = filtered_buffer;
 	stream.avail_in = filtered_size;
@@ -651,20 +651,20 @@ qboolean Image_SavePNG( const char *name, rgbdata_t *pix )
 	if( deflateInit( &stream, Z_BEST_COMPRESSION ) != Z_OK )
 	{
 		Con_DPrintf( S_ERROR "%s: deflateInit failed (%s)\n", __func__, name );
-		Mem_Free( filtered_buffer );
-		Mem_Free( buffer );
+		Mem_ScratchFree( filtered_buffer );
+		Mem_ScratchFree( buffer );
 		return false;
 	}
 
 	ret = deflate( &stream, Z_FINISH );
 	deflateEnd( &stream );
 
-	Mem_Free( filtered_buffer );
+	Mem_ScratchFree( filtered_buffer );
 
 	if( ret != Z_OK && ret != Z_STREAM_END )
 	{
 		Con_DPrintf( S_ERROR "%s: IDAT chunk compression failed (%s)\n", __func__, name );
-		Mem_Free( buffer );
+		Mem_ScratchFree( buffer );
 		return false;
 	}
 
@@ -713,6 +713,6 @@ qboolean Image_SavePNG( const char *name, rgbdata_t *pix )
 
 	FS_WriteFile( name, buffer, outsize );
 
-	Mem_Free( buffer );
+	Mem_ScratchFree( buffer );
 	return true;
 }
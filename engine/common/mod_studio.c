@@ -24,6 +24,9 @@ typedef int (*STUDIOAPI)( int, sv_blending_interface_t**, server_studio_api_t*,
 
 typedef struct mstudiocache_s
 {
+	uint	serial;		// zero for never used entry
+	uint	next;		// serial of the older entry with same hash
+	uint	hash;
 	float	frame;
 	int	sequence;
 	vec3_t	angles;
@@ -32,32 +35,36 @@ typedef struct mstudiocache_s
 	byte	controller[4];
 	byte	blending[2];
 	model_t	*model;
-	uint	current_hull;
-	uint	current_plane;
+	edict_t	*edict;
+	uint	current_hull;	// absolute position in the hitboxes ring
 	uint	numhitboxes;
 } mstudiocache_t;
 
-#define STUDIO_CACHESIZE		16
+#define STUDIO_CACHESIZE		512	// must be power of two
 #define STUDIO_CACHEMASK		(STUDIO_CACHESIZE - 1)
+#define STUDIO_CACHEHASH		256
+#define STUDIO_CACHEHULLS		2048	// hitboxes ring, must hold few bodies with MAXSTUDIOBONES
 
 // trace global variables
 static sv_blending_interface_t	*pBlendAPI = NULL;
 static studiohdr_t			*mod_studiohdr;
 static matrix3x4			studio_transform;
-static hull_t			cache_hull[MAXSTUDIOBONES];
 static hull_t			studio_hull[MAXSTUDIOBONES];
 static matrix3x4			studio_bones[MAXSTUDIOBONES];
 static uint			studio_hull_hitgroup[MAXSTUDIOBONES];
-static uint			cache_hull_hitgroup[MAXSTUDIOBONES];
+static uint			cache_hull_hitgroup[STUDIO_CACHEHULLS];
 static mstudiocache_t		cache_studio[STUDIO_CACHESIZE];
+static uint			cache_hash[STUDIO_CACHEHASH];	// serial of newest entry
 static mclipnode_t			studio_clipnodes[6];
 static mplane_t			studio_planes[768];
-static mplane_t			cache_planes[768];
+static mplane_t			cache_planes[STUDIO_CACHEHULLS * 6];
 
 // current cache state
-static int			cache_current;
-static int			cache_current_hull;
-static int			cache_current_plane;
+static uint			cache_serial;	// last used serial
+static uint			cache_current_hull;	// next free hitbox in the ring
+static uint			cache_hits;
+static uint			cache_misses;
+static uint			cache_evicted;
 
 /*
 ====================
@@ -106,9 +113,75 @@ ClearStudioCache
 void Mod_ClearStudioCache( void )
 {
 	memset( cache_studio, 0, sizeof( cache_studio ));
-	cache_current_hull = cache_current_plane = 0;
+	memset( cache_hash, 0, sizeof( cache_hash ));
+	cache_current_hull = 0;
+	cache_serial = 0;
+}
+
+/*
+====================
+StudioCacheHash
+
+-0.0 and 0.0 are equal but have different bits, adding zero merges them
+====================
+*/
+static uint Mod_StudioCacheHash( model_t *model, edict_t *edict, float frame, int sequence, vec3_t angles, vec3_t origin, byte *controller, byte *blending )
+{
+	uint	hash = 2166136261u;
+	float	values[7];
+	uint	bits;
+	int	i;
+
+	values[0] = frame + 0.0f;
+	for( i = 0; i < 3; i++ )
+	{
+		values[1+i] = angles[i] + 0.0f;
+		values[4+i] = origin[i] + 0.0f;
+	}
+
+	hash = ( hash ^ (uint)((size_t)model >> 4 )) * 16777619u;
+	hash = ( hash ^ (uint)((size_t)edict >> 4 )) * 16777619u;
+	hash = ( hash ^ (uint)sequence ) * 16777619u;
+
+	for( i = 0; i < 7; i++ )
+	{
+		memcpy( &bits, &values[i], sizeof( bits ));
+		hash = ( hash ^ bits ) * 16777619u;
+	}
+
+	for( i = 0; i < 4; i++ )
+		hash = ( hash ^ controller[i] ) * 16777619u;
+
+	hash = ( hash ^ blending[0] ) * 16777619u;
+	hash = ( hash ^ blending[1] ) * 16777619u;
+
+	return hash;
+}
+
+/*
+====================
+StudioCacheEntry
+
+returns alive entry by serial or NULL if it was overwritten
+====================
+*/
+static mstudiocache_t *Mod_StudioCacheEntry( uint serial )
+{
+	mstudiocache_t	*pCache;
+
+	if( serial == 0 )
+		return NULL;
+
+	pCache = &cache_studio[serial & STUDIO_CACHEMASK];
+
+	if( pCache->serial != serial )
+		return NULL;
+
+	// hitboxes were overwritten by the newer entries
+	if( cache_current_hull - pCache->current_hull > STUDIO_CACHEHULLS )
+		return NULL;
 
-	cache_current = 0;
+	return pCache;
 }
 
 /*
@@ -116,15 +189,34 @@ void Mod_ClearStudioCache( void )
 AddToStudioCache
 ====================
 */
-static void Mod_AddToStudioCache( float frame, int sequence, vec3_t angles, vec3_t origin, vec3_t size, byte *pcontroller, byte *pblending, model_t *model, hull_t *hull, int numhitboxes )
+static void Mod_AddToStudioCache( uint hash, float frame, int sequence, vec3_t angles, vec3_t origin, vec3_t size, byte *pcontroller, byte *pblending, model_t *model, edict_t *edict, int numhitboxes )
 {
-	mstudiocache_t *pCache;
+	mstudiocache_t	*pCache;
+	uint		pos;
 
-	if( numhitboxes + cache_current_hull >= MAXSTUDIOBONES )
+	if( numhitboxes <= 0 || numhitboxes > STUDIO_CACHEHULLS )
+		return;
+
+	// keep hitboxes of the entry contiguous
+	pos = cache_current_hull % STUDIO_CACHEHULLS;
+	if( pos + numhitboxes > STUDIO_CACHEHULLS )
+		cache_current_hull += STUDIO_CACHEHULLS - pos;
+
+	cache_serial++;
+	if( cache_serial == 0 ) // wrapped, drop everything
+	{
 		Mod_ClearStudioCache();
+		cache_serial = 1;
+	}
+
+	pCache = &cache_studio[cache_serial & STUDIO_CACHEMASK];
+	if( pCache->serial != 0 )
+		cache_evicted++;
 
-	cache_current++;
-	pCache = &cache_studio[cache_current & STUDIO_CACHEMASK];
+	pCache->serial = cache_serial;
+	pCache->hash = hash;
+	pCache->next = cache_hash[hash % STUDIO_CACHEHASH];
+	cache_hash[hash % STUDIO_CACHEHASH] = cache_serial;
 
 	pCache->frame = frame;
 	pCache->sequence = sequence;
@@ -136,16 +228,15 @@ static void Mod_AddToStudioCache( float frame, int sequence, vec3_t angles, vec3
 	memcpy( pCache->blending, pblending, 2 );
 
 	pCache->model = model;
+	pCache->edict = edict;
 	pCache->current_hull = cache_current_hull;
-	pCache->current_plane = cache_current_plane;
+	pCache->numhitboxes = numhitboxes;
 
-	memcpy( &cache_hull[cache_current_hull], hull, numhitboxes * sizeof( hull_t ));
-	memcpy( &cache_planes[cache_current_plane], studio_planes, numhitboxes * sizeof( mplane_t ) * 6 );
-	memcpy( &cache_hull_hitgroup[cache_current_hull], studio_hull_hitgroup, numhitboxes * sizeof( uint ));
+	pos = cache_current_hull % STUDIO_CACHEHULLS;
+	memcpy( &cache_planes[pos * 6], studio_planes, numhitboxes * sizeof( mplane_t ) * 6 );
+	memcpy( &cache_hull_hitgroup[pos], studio_hull_hitgroup, numhitboxes * sizeof( uint ));
 
 	cache_current_hull += numhitboxes;
-	cache_current_plane += numhitboxes * 6;
-	pCache->numhitboxes = numhitboxes;
 }
 
 /*
@@ -153,16 +244,17 @@ static void Mod_AddToStudioCache( float frame, int sequence, vec3_t angles, vec3
 CheckStudioCache
 ====================
 */
-static mstudiocache_t *Mod_CheckStudioCache( model_t *model, float frame, int sequence, vec3_t angles, vec3_t origin, vec3_t size, byte *controller, byte *blending )
+static mstudiocache_t *Mod_CheckStudioCache( uint hash, model_t *model, float frame, int sequence, vec3_t angles, vec3_t origin, vec3_t size, byte *controller, byte *blending, edict_t *edict )
 {
 	mstudiocache_t	*pCached;
-	int		i;
 
-	for( i = 0; i < STUDIO_CACHESIZE; i++ )
+	// chain goes from newest to oldest, so first dead entry ends it
+	for( pCached = Mod_StudioCacheEntry( cache_hash[hash % STUDIO_CACHEHASH] ); pCached; pCached = Mod_StudioCacheEntry( pCached->next ))
 	{
-		pCached = &cache_studio[(cache_current - i) & STUDIO_CACHEMASK];
+		if( pCached->hash != hash )
+			continue;
 
-		if( pCached->model != model )
+		if( pCached->model != model || pCached->edict != edict )
 			continue;
 
 		if( pCached->frame != frame )
@@ -192,6 +284,29 @@ static mstudiocache_t *Mod_CheckStudioCache( model_t *model, float frame, int se
 	return NULL;
 }
 
+/*
+====================
+Mod_PrintStudioCacheStats_f
+====================
+*/
+void Mod_PrintStudioCacheStats_f( void )
+{
+	uint	total = cache_hits + cache_misses;
+	uint	i, alive = 0;
+
+	for( i = 0; i < STUDIO_CACHESIZE; i++ )
+	{
+		if( cache_studio[i].serial && Mod_StudioCacheEntry( cache_studio[i].serial ))
+			alive++;
+	}
+
+	Con_Printf( "studio hull cache: %u/%u entries, %u hitboxes ring\n", alive, STUDIO_CACHESIZE, STUDIO_CACHEHULLS );
+	Con_Printf( "%u hits, %u misses (%.1f%%), %u evicted\n", cache_hits, cache_misses, total ? cache_hits * 100.0 / total : 0.0, cache_evicted );
+
+	if( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ))
+		cache_hits = cache_misses = cache_evicted = 0;
+}
+
 /*
 ===============================================================================
 
@@ -234,6 +349,7 @@ hull_t *Mod_HullForStudio( model_t *model, float frame, int sequence, vec3_t ang
 	mstudiocache_t	*bonecache;
 	mstudiobbox_t	*phitbox;
 	qboolean		bSkipShield;
+	uint		hash = 0;
 	int		i, j;
 
 	bSkipShield = false;
@@ -241,17 +357,23 @@ hull_t *Mod_HullForStudio( model_t *model, float frame, int sequence, vec3_t ang
 
 	if( mod_studiocache.value )
 	{
-		bonecache = Mod_CheckStudioCache( model, frame, sequence, angles, origin, size, pcontroller, pblending );
+		hash = Mod_StudioCacheHash( model, pEdict, frame, sequence, angles, origin, pcontroller, pblending );
+		bonecache = Mod_CheckStudioCache( hash, model, frame, sequence, angles, origin, size, pcontroller, pblending, pEdict );
 
 		if( bonecache != NULL )
 		{
-			memcpy( studio_planes, &cache_planes[bonecache->current_plane], bonecache->numhitboxes * sizeof( mplane_t ) * 6 );
-			memcpy( studio_hull_hitgroup, &cache_hull_hitgroup[bonecache->current_hull], bonecache->numhitboxes * sizeof( uint ));
-			memcpy( studio_hull, &cache_hull[bonecache->current_hull], bonecache->numhitboxes * sizeof( hull_t ));
+			uint	pos = bonecache->current_hull % STUDIO_CACHEHULLS;
+
+			// studio_hull never changes, so only planes and hitgroups are restored
+			memcpy( studio_planes, &cache_planes[pos * 6], bonecache->numhitboxes * sizeof( mplane_t ) * 6 );
+			memcpy( studio_hull_hitgroup, &cache_hull_hitgroup[pos], bonecache->numhitboxes * sizeof( uint ));
 
 			*numhitboxes = bonecache->numhitboxes;
+			cache_hits++;
 			return studio_hull;
 		}
+
+		cache_misses++;
 	}
 
 	mod_studiohdr = Mod_StudioExtradata( model );
@@ -287,7 +409,7 @@ hull_t *Mod_HullForStudio( model_t *model, float frame, int sequence, vec3_t ang
 	*numhitboxes = (bSkipShield) ? (mod_studiohdr->numhitboxes - 1) : (mod_studiohdr->numhitboxes);
 
 	if( mod_studiocache.value )
-		Mod_AddToStudioCache( frame, sequence, angles, origin, size, pcontroller, pblending, model, studio_hull, *numhitboxes );
+		Mod_AddToStudioCache( hash, frame, sequence, angles, origin, size, pcontroller, pblending, model, pEdict, *numhitboxes );
 
 	return studio_hull;
 }
@@ -435,7 +557,7 @@ void *R_StudioGetAnim( studiohdr_t *m_pStudioHeader, model_t *m_pSubModel, mstud
 		// NOTE: here we build real sub-animation filename because stupid user may rename model without recompile
 		Q_snprintf( filepath, sizeof( filepath ), "%s/%s%i%i.mdl", modelpath, modelname, pseqdesc->seqgroup / 10, pseqdesc->seqgroup % 10 );
 
-		buf = FS_LoadFile( filepath, &filesize, false );
+		buf = FS_MapFile( filepath, &filesize, false );
 		if( !buf || !filesize ) Host_Error( "%s: can't load %s\n", __func__, filepath );
 		if( IDSEQGRPHEADER != *(uint *)buf ) Host_Error( "%s: %s is corrupted\n", __func__, filepath );
 
@@ -443,7 +565,7 @@ void *R_StudioGetAnim( studiohdr_t *m_pStudioHeader, model_t *m_pSubModel, mstud
 
 		paSequences[pseqdesc->seqgroup].data = Mem_Calloc( com_studiocache, filesize );
 		memcpy( paSequences[pseqdesc->seqgroup].data, buf, filesize );
-		Mem_Free( buf );
+		FS_UnmapFile( buf );
 	}
 
 	return ((byte *)paSequences[pseqdesc->seqgroup].data + pseqdesc->animindex);
@@ -459,7 +581,7 @@ NOTE: pEdict is unused
 static void SV_StudioSetupBones( model_t *pModel,	float frame, int sequence, const vec3_t angles, const vec3_t origin,
 	const byte *pcontroller, const byte *pblending, int iBone, const edict_t *pEdict )
 {
-	int		i, j, numbones = 0;
+	int		i, numbones = 0;
 	int		boneused[MAXSTUDIOBONES];
 	float		f = 0.0;
 
@@ -469,7 +591,6 @@ static void SV_StudioSetupBones( model_t *pModel,	float frame, int sequence, con
 
 	static float	pos[MAXSTUDIOBONES][3];
 	static vec4_t	q[MAXSTUDIOBONES];
-	matrix3x4		bonematrix;
 
 	static float	pos2[MAXSTUDIOBONES][3];
 	static vec4_t	q2[MAXSTUDIOBONES];
@@ -539,16 +660,7 @@ static void SV_StudioSetupBones( model_t *pModel,	float frame, int sequence, con
 	}
 
 	Matrix3x4_CreateFromEntity( studio_transform, angles, origin, 1.0f );
-
-	for( j = numbones - 1; j >= 0; j-- )
-	{
-		i = boneused[j];
-
-		Matrix3x4_FromOriginQuat( bonematrix, q[i], pos[i] );
-		if( pbones[i].parent == -1 )
-			Matrix3x4_ConcatTransforms( studio_bones[i], studio_transform, bonematrix );
-		else Matrix3x4_ConcatTransforms( studio_bones[i], studio_bones[pbones[i].parent], bonematrix );
-	}
+	R_StudioBoneMatrices( studio_bones, pbones, boneused, numbones, q, pos, studio_transform );
 }
 
 /*
@@ -756,7 +868,7 @@ qboolean Mod_GetStudioBounds( const char *name, vec3_t mins, vec3_t maxs )
 	if( !Q_strstr( name, "models" ) || !Q_strstr( name, ".mdl" ))
 		return false;
 
-	f = FS_LoadFile( name, NULL, false );
+	f = FS_MapFile( name, NULL, false );
 	if( !f ) return false;
 
 	if( *(uint *)f == IDSTUDIOHEADER )
@@ -766,7 +878,7 @@ qboolean Mod_GetStudioBounds( const char *name, vec3_t mins, vec3_t maxs )
 		Mod_StudioComputeBounds( f, mins, maxs, false );
 		result = true;
 	}
-	Mem_Free( f );
+	FS_UnmapFile( f );
 
 	return result;
 }
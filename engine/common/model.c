@@ -27,6 +27,13 @@ GNU General Public License for more details.
 static model_info_t	mod_crcinfo[MAX_MODELS];
 static model_t	mod_known[MAX_MODELS];
 static int	mod_numknown = 0;
+
+// model names can be wiped without notice (Mod_FreeModel, failed loads, etc)
+// so hash chains are allowed to be stale and every hit is verified by name
+#define MOD_HASH_SIZE	256	// must be power of two
+static int	mod_hash[MOD_HASH_SIZE];	// model index + 1, 0 terminates the chain
+static int	mod_hashnext[MAX_MODELS];
+static short	mod_hashkey[MAX_MODELS];	// bucket where model is linked + 1
 poolhandle_t      com_studiocache;		// cache for submodels
 CVAR_DEFINE( mod_studiocache, "r_studiocache", "1", FCVAR_ARCHIVE, "enables studio cache for speedup tracing hitboxes" );
 CVAR_DEFINE_AUTO( r_wadtextures, "0", 0, "completely ignore textures in the bsp-file if enabled" );
@@ -145,6 +152,7 @@ void Mod_Init( void )
 
 	Cmd_AddCommand( "mapstats", Mod_PrintWorldStats_f, "show stats for currently loaded map" );
 	Cmd_AddCommand( "modellist", Mod_Modellist_f, "display loaded models list" );
+	Cmd_AddCommand( "studiocachestats", Mod_PrintStudioCacheStats_f, "show studio hitbox cache hit rate, pass \"reset\" to clear counters" );
 
 	Mod_ResetStudioAPI ();
 	Mod_InitStudioHull ();
@@ -165,6 +173,10 @@ void Mod_FreeAll( void )
 	for( i = 0; i < mod_numknown; i++ )
 		Mod_FreeModel( &mod_known[i] );
 	mod_numknown = 0;
+
+	memset( mod_hash, 0, sizeof( mod_hash ));
+	memset( mod_hashnext, 0, sizeof( mod_hashnext ));
+	memset( mod_hashkey, 0, sizeof( mod_hashkey ));
 }
 
 /*
@@ -198,6 +210,71 @@ void Mod_Shutdown( void )
 
 ===============================================================================
 */
+/*
+==================
+Mod_UnlinkHash
+
+==================
+*/
+static void Mod_UnlinkHash( int index )
+{
+	int	*link;
+
+	if( !mod_hashkey[index] )
+		return;
+
+	for( link = &mod_hash[mod_hashkey[index] - 1]; *link; link = &mod_hashnext[*link - 1] )
+	{
+		if( *link == index + 1 )
+		{
+			*link = mod_hashnext[index];
+			break;
+		}
+	}
+
+	mod_hashnext[index] = 0;
+	mod_hashkey[index] = 0;
+}
+
+/*
+==================
+Mod_LinkHash
+
+==================
+*/
+static void Mod_LinkHash( int index )
+{
+	uint	key = COM_HashKey( mod_known[index].name, MOD_HASH_SIZE );
+
+	Mod_UnlinkHash( index );
+	mod_hashnext[index] = mod_hash[key];
+	mod_hash[key] = index + 1;
+	mod_hashkey[index] = key + 1;
+}
+
+/*
+==================
+Mod_FindHash
+
+returns lowest index of the known model with this name or -1
+==================
+*/
+static int Mod_FindHash( const char *name )
+{
+	int	i, best = -1;
+
+	for( i = mod_hash[COM_HashKey( name, MOD_HASH_SIZE )]; i; i = mod_hashnext[i - 1] )
+	{
+		if( i - 1 >= mod_numknown || ( best != -1 && i - 1 > best ))
+			continue;
+
+		if( !Q_stricmp( mod_known[i - 1].name, name ))
+			best = i - 1;
+	}
+
+	return best;
+}
+
 /*
 ==================
 Mod_FindName
@@ -214,16 +291,15 @@ model_t *Mod_FindName( const char *filename, qboolean trackCRC )
 	Q_strncpy( modname, filename, sizeof( modname ));
 
 	// search the currently loaded models
-	for( i = 0, mod = mod_known; i < mod_numknown; i++, mod++ )
+	if(( i = Mod_FindHash( modname )) != -1 )
 	{
-		if( !Q_stricmp( mod->name, modname ))
-		{
-			if( mod->mempool || mod->name[0] == '*' )
-				mod->needload = NL_PRESENT;
-			else mod->needload = NL_NEEDS_LOADED;
+		mod = &mod_known[i];
 
-			return mod;
-		}
+		if( mod->mempool || mod->name[0] == '*' )
+			mod->needload = NL_PRESENT;
+		else mod->needload = NL_NEEDS_LOADED;
+
+		return mod;
 	}
 
 	// find a free model slot spot
@@ -239,6 +315,7 @@ model_t *Mod_FindName( const char *filename, qboolean trackCRC )
 
 	// copy name, so model loader can find model file
 	Q_strncpy( mod->name, modname, sizeof( mod->name ));
+	Mod_LinkHash( i );
 	if( trackCRC ) mod_crcinfo[i].flags = FCRC_SHOULD_CHECKSUM;
 	else mod_crcinfo[i].flags = 0;
 	mod->needload = NL_NEEDS_LOADED;
@@ -277,7 +354,7 @@ model_t *Mod_LoadModel( model_t *mod, qboolean crash )
 	Q_strncpy( tempname, mod->name, sizeof( tempname ));
 	COM_FixSlashes( tempname );
 
-	buf = FS_LoadFile( tempname, &length, false );
+	buf = FS_MapFile( tempname, &length, false );
 
 	if( !buf )
 	{
@@ -311,7 +388,7 @@ model_t *Mod_LoadModel( model_t *mod, qboolean crash )
 		Mod_LoadBrushModel( mod, buf, &loaded );
 		break;
 	default:
-		Mem_Free( buf );
+		FS_UnmapFile( buf );
 		if( crash ) Host_Error( "%s has unknown format\n", tempname );
 		else Con_Printf( S_ERROR "%s has unknown format\n", tempname );
 		return NULL;
@@ -348,7 +425,7 @@ model_t *Mod_LoadModel( model_t *mod, qboolean crash )
 	if( !loaded )
 	{
 		Mod_FreeModel( mod );
-		Mem_Free( buf );
+		FS_UnmapFile( buf );
 
 		if( crash ) Host_Error( "Could not load model %s\n", tempname );
 		else Con_Printf( S_ERROR "Could not load model %s\n", tempname );
@@ -378,7 +455,7 @@ model_t *Mod_LoadModel( model_t *mod, qboolean crash )
 			p->initialCRC = currentCRC;
 		}
 	}
-	Mem_Free( buf );
+	FS_UnmapFile( buf );
 
 	return mod;
 }
@@ -539,11 +616,11 @@ void Mod_LoadCacheFile( const char *filename, cache_user_t *cu )
 	Q_strncpy( modname, filename, sizeof( modname ));
 	COM_FixSlashes( modname );
 
-	buf = FS_LoadFile( modname, &size, false );
+	buf = FS_MapFile( modname, &size, false );
 	if( !buf || !size ) Host_Error( "LoadCacheFile: ^1can't load %s^7\n", filename );
 	cu->data = Mem_Malloc( com_studiocache, size );
 	memcpy( cu->data, buf, size );
-	Mem_Free( buf );
+	FS_UnmapFile( buf );
 }
 
 /*
@@ -1287,7 +1287,7 @@ qboolean Netchan_CopyFileFragments( netchan_t *chan, sizebuf_t *msg )
 		p = p->next;
 	}
 
-	buffer = Mem_Calloc( net_mempool, nsize + 1 );
+	buffer = Mem_ScratchCalloc( nsize + 1 );
 	p = chan->incomingbufs[FRAG_FILE_STREAM];
 	pos = 0;
 
@@ -1320,11 +1320,11 @@ qboolean Netchan_CopyFileFragments( netchan_t *chan, sizebuf_t *msg )
 	if( chan->gs_netchan && chan->use_bz2 && !Q_stricmp( compressor, "bz2" ))
 	{
 #if !XASH_DEDICATED
-		byte *uncompressedBuffer = Mem_Calloc( net_mempool, uncompressedSize );
+		byte *uncompressedBuffer = Mem_ScratchCalloc( uncompressedSize );
 
 		Con_DPrintf( "Decompressing file %s (%d -> %d bytes)\n", filename, nsize, uncompressedSize );
 		BZ2_bzBuffToBuffDecompress( uncompressedBuffer, &uncompressedSize, buffer, nsize, 1, 0 );
-		Mem_Free( buffer );
+		Mem_ScratchFree( buffer );
 		nsize = uncompressedSize;
 		buffer = uncompressedBuffer;
 #else
@@ -1336,10 +1336,10 @@ qboolean Netchan_CopyFileFragments( netchan_t *chan, sizebuf_t *msg )
 		byte	*uncompressedBuffer;
 
 		uncompressedSize = LZSS_GetActualSize( buffer ) + 1;
-		uncompressedBuffer = Mem_Calloc( net_mempool, uncompressedSize );
+		uncompressedBuffer = Mem_ScratchCalloc( uncompressedSize );
 
 		nsize = LZSS_Decompress( buffer, uncompressedBuffer );
-		Mem_Free( buffer );
+		Mem_ScratchFree( buffer );
 		buffer = uncompressedBuffer;
 	}
 
@@ -1348,16 +1348,18 @@ qboolean Netchan_CopyFileFragments( netchan_t *chan, sizebuf_t *msg )
 	{
 		if( chan->tempbuffer )
 			Mem_Free( chan->tempbuffer );
-		chan->tempbuffer = buffer;
+		chan->tempbuffer = Mem_Malloc( net_mempool, nsize );
 		chan->tempbuffersize = nsize;
+		memcpy( chan->tempbuffer, buffer, nsize );
 	}
 	else
 	{
 		// g-cont. it's will be stored downloaded files directly into game folder
 		FS_WriteFile( filename, buffer, nsize );
-		Mem_Free( buffer );
 	}
 
+	Mem_ScratchFree( buffer );
+
 	// clear remnants
 	MSG_Clear( msg );
 
@@ -42,9 +42,19 @@ void Test_RunGamma( void );
 void Test_RunDelta( void );
 void Test_RunBuffer( void );
 void Test_RunMunge( void );
+void Test_RunSphereTree( void );
+void Test_RunEntityStrings( void );
+void Test_RunZoneThreads( void );
+void Test_RunZoneScratch( void );
+void Test_RunZoneProfile( void );
+void Test_RunHPAK( void );
+void Test_RunMapsList( void );
 
 #define TEST_LIST_0 \
 	Test_RunLibCommon(); \
+	Test_RunZoneThreads(); \
+	Test_RunZoneScratch(); \
+	Test_RunZoneProfile(); \
 	Test_RunCommon(); \
 	Test_RunCmd(); \
 	Test_RunCvar(); \
@@ -58,7 +68,11 @@ void Test_RunMunge( void );
 	Test_RunGamma();
 
 #define TEST_LIST_1 \
-	Test_RunImagelib();
+	Test_RunImagelib(); \
+	Test_RunSphereTree(); \
+	Test_RunEntityStrings(); \
+	Test_RunHPAK(); \
+	Test_RunMapsList();
 
 #define TEST_LIST_1_CLIENT \
 	Test_RunVOX();
@@ -17,10 +17,34 @@ GNU General Public License for more details.
 */
 
 #include "common.h"
+#include "platform/platform.h"
 
 #define MEMHEADER_SENTINEL1	0xDEADF00DU
 #define MEMHEADER_SENTINEL2	0xDFU
 
+#define MEMHEADER_CACHEABLE	BIT( 0 )		// malloc'ed with size class capacity, can go to thread cache
+#define MEMHEADER_PROFILED	BIT( 1 )		// counted by profiler, frame of allocation is in the upper bits
+#define MEMHEADER_STAMP_SHIFT	8
+#define MEMHEADER_STAMP_MASK	0xFFFFFFU	// 24 bits of frame counter
+
+#define MEMCACHE_GRANULARITY	16
+#define MEMCACHE_CLASSES	16		// blocks up to 256 bytes are cached
+#define MEMCACHE_DEPTH	32		// per size class
+#define MEMCACHE_CLASS( size )	((( size ) - 1 ) / MEMCACHE_GRANULARITY )
+#define MEMCACHE_CAPACITY( c )	((( c ) + 1 ) * MEMCACHE_GRANULARITY )
+
+#define MEMSCRATCH_ALIGN	16
+#define MEMSCRATCH_ROUND( x )	((( x ) + MEMSCRATCH_ALIGN - 1 ) & ~((size_t)MEMSCRATCH_ALIGN - 1 ))
+#define MEMSCRATCH_SIZE	( 1024 * 1024 )	// initial per-thread scratch buffer
+#define MEMSCRATCH_MAXSIZE	( 8 * 1024 * 1024 )	// buffer never grows beyond, bigger demand goes to malloc
+#define MEMSCRATCH_FREED	BIT( 0 )
+#define MEMSCRATCH_OVERFLOW	BIT( 1 )		// didn't fit into the buffer, malloc'ed
+
+#define MEMPROFILE_SITES	4096		// must be power of two
+
+#define MEMPOOL_CHUNKSIZE	64		// pools never move, so handles can be resolved without locking
+#define MEMPOOL_MAXCHUNKS	256
+
 #ifdef XASH_CUSTOM_SWAP
 #include "platform/swap/swap.h"
 #define Q_malloc SWAP_Malloc
@@ -51,6 +75,72 @@ static void *Q_realloc( void *mem, size_t size )
 #define Q_realloc realloc
 #endif
 
+/*
+==============================================================================
+
+SPINLOCKS
+
+pool bookkeeping is a few pointer writes, so spinlock is cheaper than mutex
+and costs a single uncontended atomic exchange on the main thread
+
+==============================================================================
+*/
+#if defined( _MSC_VER )
+#include <intrin.h>
+#define MEM_THREAD_LOCAL	__declspec( thread )
+typedef volatile long memlock_t;
+
+static inline qboolean Mem_TryLock( memlock_t *lock )
+{
+	return *lock == 0 && _InterlockedExchange( lock, 1 ) == 0;
+}
+
+static inline void Mem_Unlock( memlock_t *lock )
+{
+	_InterlockedExchange( lock, 0 );
+}
+#elif defined( __GNUC__ ) && !XASH_DOS4GW
+#define MEM_THREAD_LOCAL	__thread
+typedef volatile int memlock_t;
+
+static inline qboolean Mem_TryLock( memlock_t *lock )
+{
+	return *lock == 0 && __atomic_exchange_n( lock, 1, __ATOMIC_ACQUIRE ) == 0;
+}
+
+static inline void Mem_Unlock( memlock_t *lock )
+{
+	__atomic_store_n( lock, 0, __ATOMIC_RELEASE );
+}
+#else // no threads
+#define MEM_THREAD_LOCAL
+typedef int memlock_t;
+
+static inline qboolean Mem_TryLock( memlock_t *lock )
+{
+	return true;
+}
+
+static inline void Mem_Unlock( memlock_t *lock )
+{
+}
+#endif
+
+static void Mem_Lock( memlock_t *lock )
+{
+	int	spins = 0;
+
+	while( !Mem_TryLock( lock ))
+	{
+		// owner might be preempted, give up the timeslice
+		if( ++spins >= 64 )
+		{
+			Platform_Sleep( 0 );
+			spins = 0;
+		}
+	}
+}
+
 typedef struct memheader_s
 {
 	struct memheader_s	*next;		// next and previous memheaders in chain belonging to pool
@@ -59,9 +149,7 @@ typedef struct memheader_s
 	size_t		size;		// size of the memory after the header (excluding header and sentinel2)
 	poolhandle_t	poolptr;		// pool this memheader belongs to
 	int		fileline;
-#if !XASH_64BIT
-	uint32_t		pad0; // doesn't have value, only to make Mem_Alloc return aligned addresses on ILP32
-#endif
+	uint32_t		flags;		// MEMHEADER_ flags, also makes Mem_Alloc return aligned addresses on ILP32
 	uint32_t		sentinel1;	// should always be MEMHEADER_SENTINEL1
 
 	// immediately followed by data, which is followed by a MEMHEADER_SENTINEL2 byte
@@ -70,6 +158,8 @@ typedef struct memheader_s
 typedef struct mempool_s
 {
 	struct memheader_s	*chain;		// chain of individual memory allocations
+	memlock_t		lock;		// protects chain and sizes
+	poolhandle_t	handle;		// index in pool chunks + 1
 	size_t		totalsize;	// total memory allocated in this pool (inside memheaders)
 	size_t		realsize;		// total memory allocated in this pool (actual malloc total)
 	size_t		lastchecksize;	// updated each time the pool is displayed by memlist
@@ -78,8 +168,93 @@ typedef struct mempool_s
 	char		name[64];		// name of the pool
 } mempool_t;
 
-static mempool_t *poolchain = NULL; // critical stuff
+// recently freed small blocks of this thread, reused before going to malloc
+typedef struct memcache_s
+{
+	memheader_t	*blocks[MEMCACHE_CLASSES];	// linked through memheader_t::next
+	int		count[MEMCACHE_CLASSES];
+} memcache_t;
+
+typedef struct memscratchhdr_s
+{
+	struct memscratchhdr_s	*prev;		// previous allocation in the buffer or in overflow list
+	struct memscratchhdr_s	*next;		// overflow list only
+	size_t		size;
+	const char	*filename;	// file name and line where Mem_ScratchAlloc was called
+	int		fileline;
+	uint32_t		flags;		// MEMSCRATCH_ flags
+	uint32_t		sentinel1;	// should always be MEMHEADER_SENTINEL1
+
+	// followed by data, which is followed by a MEMHEADER_SENTINEL2 byte
+} memscratchhdr_t;
+
+#define MEMSCRATCH_HEADER	MEMSCRATCH_ROUND( sizeof( memscratchhdr_t ))
+
+// linear allocator for transient buffers, reset every frame
+typedef struct memscratch_s
+{
+	byte		*base;
+	size_t		size;
+	size_t		used;
+	memscratchhdr_t	*top;		// newest allocation in the buffer
+	memscratchhdr_t	*overflow;	// live allocations that didn't fit
+	size_t		overflowsize;
+	size_t		peak;		// max of used + overflowsize since last reset
+	size_t		overflows;
+	const memscratchhdr_t	*largest;		// largest overflow since last reset
+} memscratch_t;
+
+// allocation statistics of one call site
+typedef struct memsite_s
+{
+	const char	*filename;	// NULL for unused slot
+	int		fileline;
+	poolhandle_t	poolptr;
+	size_t		allocs;
+	size_t		frees;
+	size_t		bytes;		// total allocated
+	size_t		livecount;
+	size_t		livebytes;
+	uint64_t		lifetime;		// sum of lifetimes of freed allocations, in frames
+	uint		lastframe;
+	uint		frameallocs;	// allocations made in lastframe
+	uint		peakframe;	// max allocations in one frame
+} memsite_t;
+
+static mempool_t *poolchunks[MEMPOOL_MAXCHUNKS]; // critical stuff
 static size_t poolcount = 0;
+static memlock_t poollock; // protects pool creation and destruction
+static MEM_THREAD_LOCAL memcache_t mem_cache;
+static MEM_THREAD_LOCAL memscratch_t mem_scratch;
+
+// collected from all threads by Mem_ScratchReset
+static struct
+{
+	memlock_t		lock;
+	size_t		highwater;
+	size_t		overflows;
+	size_t		largest;
+	const char	*largest_filename;
+	int		largest_fileline;
+} mem_scratchstats;
+
+static struct
+{
+	memlock_t		lock;
+	qboolean		enabled;
+	memsite_t		*sites;
+	size_t		numsites;
+	size_t		dropped;		// allocations not counted because table is full
+	uint		frame;		// frames profiled
+	size_t		allocs;
+	size_t		frameallocs;
+	size_t		peakframe;
+} mem_profile;
+
+static inline mempool_t *Mem_PoolForIndex( size_t i )
+{
+	return &poolchunks[i / MEMPOOL_CHUNKSIZE][i % MEMPOOL_CHUNKSIZE];
+}
 
 // a1ba: due to mempool being passed with the model through reused 32-bit field
 // which makes engine incompatible with 64-bit pointers I changed mempool type
@@ -87,17 +262,12 @@ static size_t poolcount = 0;
 static mempool_t *Mem_FindPool( poolhandle_t poolptr )
 {
 	if( likely( poolptr > 0 && poolptr <= poolcount ))
-		return &poolchain[poolptr - 1];
+		return Mem_PoolForIndex( poolptr - 1 );
 
 	Sys_Error( "%s: not allocated or double freed pool %d", __func__, poolptr );
 	return NULL;
 }
 
-static poolhandle_t Mem_PoolIndex( mempool_t *mempool )
-{
-	return (poolhandle_t)(mempool - poolchain) + 1;
-}
-
 static inline void Mem_PoolAdd( mempool_t *pool, size_t size )
 {
 	pool->totalsize += size;
@@ -116,7 +286,7 @@ static inline void Mem_PoolLinkAlloc( mempool_t *pool, memheader_t *mem )
 	if( mem->next ) mem->next->prev = mem;
 	pool->chain = mem;
 	mem->prev = NULL;
-	mem->poolptr = Mem_PoolIndex( pool );
+	mem->poolptr = pool->handle;
 }
 
 static inline void Mem_PoolUnlinkAlloc( mempool_t *pool, memheader_t *mem )
@@ -127,8 +297,89 @@ static inline void Mem_PoolUnlinkAlloc( mempool_t *pool, memheader_t *mem )
 	mem->poolptr = 0;
 }
 
+/*
+========================
+Mem_HeapAlloc
+
+small blocks are taken from the thread cache or allocated with their size class capacity
+========================
+*/
+static memheader_t *Mem_HeapAlloc( size_t size )
+{
+	memheader_t	*mem;
+
+	if( size <= MEMCACHE_CAPACITY( MEMCACHE_CLASSES - 1 ))
+	{
+		int	c = MEMCACHE_CLASS( size );
+
+		if(( mem = mem_cache.blocks[c] ) != NULL )
+		{
+			mem_cache.blocks[c] = mem->next;
+			mem_cache.count[c]--;
+			return mem;
+		}
+
+		mem = (memheader_t *)Q_malloc( sizeof( memheader_t ) + MEMCACHE_CAPACITY( c ) + sizeof( byte ));
+		if( mem ) mem->flags = MEMHEADER_CACHEABLE;
+		return mem;
+	}
+
+	mem = (memheader_t *)Q_malloc( sizeof( memheader_t ) + size + sizeof( byte ));
+	if( mem ) mem->flags = 0;
+	return mem;
+}
+
+static void Mem_HeapFree( memheader_t *mem )
+{
+	if( FBitSet( mem->flags, MEMHEADER_CACHEABLE ))
+	{
+		int	c = MEMCACHE_CLASS( mem->size );
+
+		if( mem_cache.count[c] < MEMCACHE_DEPTH )
+		{
+			mem->next = mem_cache.blocks[c];
+			mem_cache.blocks[c] = mem;
+			mem_cache.count[c]++;
+			return;
+		}
+	}
+
+	Q_free( mem );
+}
+
+/*
+========================
+Mem_FlushThreadCache
+
+worker threads must call it before exit, or cached blocks will leak
+========================
+*/
+void Mem_FlushThreadCache( void )
+{
+	memheader_t	*mem, *next;
+	int		c;
+
+	Mem_ScratchReset();
+	Q_free( mem_scratch.base );
+	mem_scratch.base = NULL;
+	mem_scratch.size = 0;
+
+	for( c = 0; c < MEMCACHE_CLASSES; c++ )
+	{
+		for( mem = mem_cache.blocks[c]; mem; mem = next )
+		{
+			next = mem->next;
+			Q_free( mem );
+		}
+
+		mem_cache.blocks[c] = NULL;
+		mem_cache.count[c] = 0;
+	}
+}
+
 static inline void Mem_InitAlloc( memheader_t *mem, size_t size, const char *filename, int fileline )
 {
+	mem->flags &= MEMHEADER_CACHEABLE;
 	mem->size = size;
 	mem->filename = filename;
 	mem->fileline = fileline;
@@ -149,6 +400,11 @@ static const char *Mem_CheckFilename( const char *filename )
 	return dummy;
 }
 
+static inline qboolean Mem_SentinelsValid( const memheader_t *mem )
+{
+	return mem->sentinel1 == MEMHEADER_SENTINEL1 && *((const byte *)mem + sizeof( memheader_t ) + mem->size ) == MEMHEADER_SENTINEL2;
+}
+
 static qboolean Mem_CheckAllocHeader( const char *func, const memheader_t *mem, const char *filename, int fileline )
 {
 	const char *memfilename;
@@ -170,6 +426,459 @@ static qboolean Mem_CheckAllocHeader( const char *func, const memheader_t *mem,
 	return true;
 }
 
+/*
+==============================================================================
+
+SCRATCH ALLOCATOR
+
+transient buffers that don't live longer than a frame,
+each thread has it's own buffer so no locking is needed
+
+==============================================================================
+*/
+static qboolean Mem_ScratchCheck( const memscratchhdr_t *hdr, const char *func, const char *filename, int fileline )
+{
+	if( hdr->sentinel1 != MEMHEADER_SENTINEL1 )
+	{
+		Sys_Error( "%s: trashed scratch sentinel 1 (check at %s:%i)\n", func, filename, fileline );
+		return false;
+	}
+
+	if( *((const byte *)hdr + MEMSCRATCH_HEADER + hdr->size ) != MEMHEADER_SENTINEL2 )
+	{
+		Sys_Error( "%s: scratch buffer overrun (alloc at %s:%i, check at %s:%i)\n", func,
+			Mem_CheckFilename( hdr->filename ), hdr->fileline, filename, fileline );
+		return false;
+	}
+
+	return true;
+}
+
+void *_Mem_ScratchAlloc( size_t size, qboolean clear, const char *filename, int fileline )
+{
+	memscratch_t	*s = &mem_scratch;
+	memscratchhdr_t	*hdr;
+	size_t		need;
+
+	if( size <= 0 )
+		return NULL;
+
+	if( unlikely( !s->base ))
+	{
+		s->base = (byte *)Q_malloc( MEMSCRATCH_SIZE );
+		s->size = s->base ? MEMSCRATCH_SIZE : 0;
+	}
+
+	need = MEMSCRATCH_HEADER + MEMSCRATCH_ROUND( size + sizeof( byte ));
+
+	if( likely( s->used + need <= s->size ))
+	{
+		hdr = (memscratchhdr_t *)( s->base + s->used );
+		hdr->prev = s->top;
+		hdr->next = NULL;
+		hdr->flags = 0;
+		s->top = hdr;
+		s->used += need;
+	}
+	else
+	{
+		hdr = (memscratchhdr_t *)Q_malloc( MEMSCRATCH_HEADER + size + sizeof( byte ));
+		if( hdr == NULL )
+		{
+			Sys_Error( "%s: out of memory (alloc size %s at %s:%i)\n", __func__, Q_memprint( size ), filename, fileline );
+			return NULL;
+		}
+
+		hdr->flags = MEMSCRATCH_OVERFLOW;
+		hdr->prev = NULL;
+		hdr->next = s->overflow;
+		if( hdr->next ) hdr->next->prev = hdr;
+		s->overflow = hdr;
+		s->overflowsize += size;
+		s->overflows++;
+
+		if( !s->largest || size > s->largest->size )
+			s->largest = hdr;
+	}
+
+	hdr->size = size;
+	hdr->filename = filename;
+	hdr->fileline = fileline;
+	hdr->sentinel1 = MEMHEADER_SENTINEL1;
+	*((byte *)hdr + MEMSCRATCH_HEADER + size ) = MEMHEADER_SENTINEL2;
+
+	if( s->used + s->overflowsize > s->peak )
+		s->peak = s->used + s->overflowsize;
+
+	if( clear )
+		memset((byte *)hdr + MEMSCRATCH_HEADER, 0, size );
+
+	return (byte *)hdr + MEMSCRATCH_HEADER;
+}
+
+/*
+========================
+_Mem_ScratchFree
+
+optional for memory in the buffer, but releasing in reverse order makes it reusable in the same frame
+========================
+*/
+void _Mem_ScratchFree( void *data, const char *filename, int fileline )
+{
+	memscratch_t	*s = &mem_scratch;
+	memscratchhdr_t	*hdr;
+
+	if( data == NULL )
+	{
+		Sys_Error( "%s: data == NULL (called at %s:%i)\n", __func__, filename, fileline );
+		return;
+	}
+
+	hdr = (memscratchhdr_t *)((byte *)data - MEMSCRATCH_HEADER );
+
+	if( !Mem_ScratchCheck( hdr, __func__, filename, fileline ))
+		return;
+
+	if( FBitSet( hdr->flags, MEMSCRATCH_OVERFLOW ))
+	{
+		if( s->largest == hdr )
+		{
+			// remember it for the stats before it's gone
+			Mem_Lock( &mem_scratchstats.lock );
+			if( hdr->size > mem_scratchstats.largest )
+			{
+				mem_scratchstats.largest = hdr->size;
+				mem_scratchstats.largest_filename = hdr->filename;
+				mem_scratchstats.largest_fileline = hdr->fileline;
+			}
+			Mem_Unlock( &mem_scratchstats.lock );
+			s->largest = NULL;
+		}
+
+		if( hdr->next ) hdr->next->prev = hdr->prev;
+		if( hdr->prev ) hdr->prev->next = hdr->next;
+		else s->overflow = hdr->next;
+
+		s->overflowsize -= hdr->size;
+		hdr->sentinel1 = 0;
+		Q_free( hdr );
+		return;
+	}
+
+	if( (byte *)hdr < s->base || (byte *)hdr >= s->base + s->used || FBitSet( hdr->flags, MEMSCRATCH_FREED ))
+	{
+		Sys_Error( "%s: not allocated in this thread or double freed (alloc at %s:%i, free at %s:%i)\n", __func__,
+			Mem_CheckFilename( hdr->filename ), hdr->fileline, filename, fileline );
+		return;
+	}
+
+	SetBits( hdr->flags, MEMSCRATCH_FREED );
+
+	// roll back everything that was freed on top of the buffer
+	while( s->top && FBitSet( s->top->flags, MEMSCRATCH_FREED ))
+	{
+		s->used = (byte *)s->top - s->base;
+		s->top = s->top->prev;
+	}
+}
+
+/*
+========================
+Mem_ScratchReset
+
+releases all scratch memory of the calling thread, called at the end of each frame
+========================
+*/
+void Mem_ScratchReset( void )
+{
+	memscratch_t	*s = &mem_scratch;
+	memscratchhdr_t	*hdr, *next;
+	size_t		newsize;
+
+	for( hdr = s->top; hdr; hdr = hdr->prev )
+		Mem_ScratchCheck( hdr, __func__, __FILE__, __LINE__ );
+
+	Mem_Lock( &mem_scratchstats.lock );
+	if( s->peak > mem_scratchstats.highwater )
+		mem_scratchstats.highwater = s->peak;
+	mem_scratchstats.overflows += s->overflows;
+	if( s->largest && s->largest->size > mem_scratchstats.largest )
+	{
+		mem_scratchstats.largest = s->largest->size;
+		mem_scratchstats.largest_filename = s->largest->filename;
+		mem_scratchstats.largest_fileline = s->largest->fileline;
+	}
+	Mem_Unlock( &mem_scratchstats.lock );
+
+	for( hdr = s->overflow; hdr; hdr = next )
+	{
+		next = hdr->next;
+		Mem_ScratchCheck( hdr, __func__, __FILE__, __LINE__ );
+		Q_free( hdr );
+	}
+
+	// grow the buffer so next frame fits into it
+	if( s->peak > s->size && s->size < MEMSCRATCH_MAXSIZE )
+	{
+		for( newsize = s->size ? s->size : MEMSCRATCH_SIZE; newsize < s->peak && newsize < MEMSCRATCH_MAXSIZE; newsize *= 2 );
+
+		Q_free( s->base );
+		s->base = (byte *)Q_malloc( newsize );
+		s->size = s->base ? newsize : 0;
+	}
+
+	s->used = 0;
+	s->top = NULL;
+	s->overflow = NULL;
+	s->overflowsize = 0;
+	s->peak = 0;
+	s->overflows = 0;
+	s->largest = NULL;
+}
+
+/*
+==============================================================================
+
+ALLOCATION PROFILER
+
+counts allocations per pool and call site, enabled by memprofile command
+
+==============================================================================
+*/
+static memsite_t *Mem_ProfileSite( poolhandle_t poolptr, const char *filename, int fileline, qboolean create )
+{
+	uint	hash = (uint)((uintptr_t)filename >> 3 ) * 31 + (uint)fileline * 131 + (uint)poolptr;
+	uint	i;
+
+	for( i = 0; i < MEMPROFILE_SITES; i++ )
+	{
+		memsite_t	*site = &mem_profile.sites[( hash + i ) & ( MEMPROFILE_SITES - 1 )];
+
+		if( site->filename == filename && site->fileline == fileline && site->poolptr == poolptr )
+			return site;
+
+		if( site->filename == NULL )
+		{
+			if( !create )
+				return NULL;
+
+			site->filename = filename;
+			site->fileline = fileline;
+			site->poolptr = poolptr;
+			mem_profile.numsites++;
+			return site;
+		}
+	}
+
+	return NULL;
+}
+
+static void Mem_ProfileAlloc( const mempool_t *pool, memheader_t *mem )
+{
+	memsite_t	*site;
+
+	Mem_Lock( &mem_profile.lock );
+
+	if( mem_profile.sites && ( site = Mem_ProfileSite( pool->handle, mem->filename, mem->fileline, true )) != NULL )
+	{
+		if( site->lastframe != mem_profile.frame )
+		{
+			if( site->frameallocs > site->peakframe )
+				site->peakframe = site->frameallocs;
+			site->frameallocs = 0;
+			site->lastframe = mem_profile.frame;
+		}
+
+		site->allocs++;
+		site->frameallocs++;
+		site->bytes += mem->size;
+		site->livecount++;
+		site->livebytes += mem->size;
+
+		mem_profile.allocs++;
+		mem_profile.frameallocs++;
+
+		mem->flags |= MEMHEADER_PROFILED | (( mem_profile.frame & MEMHEADER_STAMP_MASK ) << MEMHEADER_STAMP_SHIFT );
+	}
+	else mem_profile.dropped++;
+
+	Mem_Unlock( &mem_profile.lock );
+}
+
+static void Mem_ProfileFree( const mempool_t *pool, const memheader_t *mem )
+{
+	memsite_t	*site;
+
+	// allocated before profiling was started
+	if( !FBitSet( mem->flags, MEMHEADER_PROFILED ))
+		return;
+
+	Mem_Lock( &mem_profile.lock );
+
+	if( mem_profile.sites && ( site = Mem_ProfileSite( pool->handle, mem->filename, mem->fileline, false )) != NULL && site->livecount )
+	{
+		site->frees++;
+		site->livecount--;
+		site->livebytes -= mem->size;
+		site->lifetime += ( mem_profile.frame - ( mem->flags >> MEMHEADER_STAMP_SHIFT )) & MEMHEADER_STAMP_MASK;
+	}
+
+	Mem_Unlock( &mem_profile.lock );
+}
+
+void Mem_ProfileEnable( qboolean enable )
+{
+	Mem_Lock( &mem_profile.lock );
+
+	if( enable && !mem_profile.sites )
+	{
+		mem_profile.sites = (memsite_t *)Q_malloc( sizeof( memsite_t ) * MEMPROFILE_SITES );
+		if( mem_profile.sites )
+			memset( mem_profile.sites, 0, sizeof( memsite_t ) * MEMPROFILE_SITES );
+	}
+
+	mem_profile.enabled = enable && mem_profile.sites != NULL;
+
+	Mem_Unlock( &mem_profile.lock );
+}
+
+void Mem_ProfileReset( void )
+{
+	Mem_Lock( &mem_profile.lock );
+
+	// allocations made before reset are forgotten
+	if( mem_profile.sites )
+		memset( mem_profile.sites, 0, sizeof( memsite_t ) * MEMPROFILE_SITES );
+	mem_profile.numsites = 0;
+	mem_profile.dropped = 0;
+	mem_profile.allocs = 0;
+	mem_profile.frameallocs = 0;
+	mem_profile.peakframe = 0;
+
+	Mem_Unlock( &mem_profile.lock );
+}
+
+/*
+========================
+Mem_ProfileFrame
+
+called once per frame to count per-frame allocation rates
+========================
+*/
+void Mem_ProfileFrame( void )
+{
+	if( !mem_profile.enabled )
+		return;
+
+	Mem_Lock( &mem_profile.lock );
+	if( mem_profile.frameallocs > mem_profile.peakframe )
+		mem_profile.peakframe = mem_profile.frameallocs;
+	mem_profile.frameallocs = 0;
+	mem_profile.frame++;
+	Mem_Unlock( &mem_profile.lock );
+}
+
+static int Mem_ProfileSortAllocs( const void *a, const void *b )
+{
+	const memsite_t *s1 = *(const memsite_t **)a, *s2 = *(const memsite_t **)b;
+	return s1->allocs < s2->allocs ? 1 : s1->allocs > s2->allocs ? -1 : 0;
+}
+
+static int Mem_ProfileSortBytes( const void *a, const void *b )
+{
+	const memsite_t *s1 = *(const memsite_t **)a, *s2 = *(const memsite_t **)b;
+	return s1->bytes < s2->bytes ? 1 : s1->bytes > s2->bytes ? -1 : 0;
+}
+
+static int Mem_ProfileSortLive( const void *a, const void *b )
+{
+	const memsite_t *s1 = *(const memsite_t **)a, *s2 = *(const memsite_t **)b;
+	return s1->livebytes < s2->livebytes ? 1 : s1->livebytes > s2->livebytes ? -1 : 0;
+}
+
+/*
+========================
+Mem_ProfilePrint
+
+top call sites sorted by allocation count, total bytes or live bytes
+========================
+*/
+void Mem_ProfilePrint( int count, memprofilesort_t sort )
+{
+	memsite_t	*sites, **sorted;
+	uint	frames;
+	size_t	i, n;
+
+	Mem_Lock( &mem_profile.lock );
+
+	if( !mem_profile.sites || !mem_profile.numsites )
+	{
+		Mem_Unlock( &mem_profile.lock );
+		Con_Printf( "no allocations were profiled\n" );
+		return;
+	}
+
+	// print a snapshot, so Con_Printf is free to allocate
+	sites = (memsite_t *)Q_malloc( sizeof( *sites ) * mem_profile.numsites + sizeof( *sorted ) * mem_profile.numsites );
+	if( !sites )
+	{
+		Mem_Unlock( &mem_profile.lock );
+		return;
+	}
+
+	sorted = (memsite_t **)( sites + mem_profile.numsites );
+
+	for( i = n = 0; i < MEMPROFILE_SITES && n < mem_profile.numsites; i++ )
+	{
+		if( !mem_profile.sites[i].filename )
+			continue;
+
+		sites[n] = mem_profile.sites[i];
+
+		// last frame with allocations might be the busiest one
+		if( sites[n].frameallocs > sites[n].peakframe )
+			sites[n].peakframe = sites[n].frameallocs;
+
+		sorted[n] = &sites[n];
+		n++;
+	}
+
+	frames = mem_profile.frame ? mem_profile.frame : 1;
+
+	Con_Printf( "%zu allocations at %zu sites in %u frames, %.1f per frame, peak %zu%s\n", mem_profile.allocs, n, frames,
+		(double)mem_profile.allocs / frames, mem_profile.frameallocs > mem_profile.peakframe ? mem_profile.frameallocs : mem_profile.peakframe,
+		mem_profile.enabled ? "" : " (stopped)" );
+	if( mem_profile.dropped )
+		Con_Printf( S_WARN "%zu allocations weren't counted, too many call sites\n", mem_profile.dropped );
+
+	Mem_Unlock( &mem_profile.lock );
+
+	switch( sort )
+	{
+	case MEMPROFILE_BYTES: qsort( sorted, n, sizeof( *sorted ), Mem_ProfileSortBytes ); break;
+	case MEMPROFILE_LIVE: qsort( sorted, n, sizeof( *sorted ), Mem_ProfileSortLive ); break;
+	default: qsort( sorted, n, sizeof( *sorted ), Mem_ProfileSortAllocs ); break;
+	}
+
+	Con_Printf( "^3  allocs  /frame  peak      bytes   live   live bytes  lifetime  site\n" );
+
+	for( i = 0; i < n && i < count; i++ )
+	{
+		const memsite_t	*site = sorted[i];
+		const char	*poolname = "<freed pool>";
+		mempool_t		*pool;
+
+		if( site->poolptr <= poolcount && ( pool = Mem_FindPool( site->poolptr ))->filename )
+			poolname = pool->name;
+
+		Con_Printf( "%8zu %7.1f %5u %10s %6zu %12s %9.1f  %s:%i (%s)\n", site->allocs, (double)site->allocs / frames,
+			site->peakframe, Q_memprint( site->bytes ), site->livecount, Q_memprint( site->livebytes ),
+			site->frees ? (double)site->lifetime / site->frees : 0.0, site->filename, site->fileline, poolname );
+	}
+
+	Q_free( sites );
+}
+
 void *_Mem_Alloc( poolhandle_t poolptr, size_t size, qboolean clear, const char *filename, int fileline )
 {
 	memheader_t *mem;
@@ -188,7 +897,7 @@ void *_Mem_Alloc( poolhandle_t poolptr, size_t size, qboolean clear, const char
 	if( !pool )
 		return NULL;
 
-	mem = (memheader_t *)Q_malloc( sizeof( memheader_t ) + size + sizeof( byte ));
+	mem = Mem_HeapAlloc( size );
 	if( mem == NULL )
 	{
 		Sys_Error( "%s: out of memory (alloc size %s at %s:%i)\n", __func__, Q_memprint( size ), filename, fileline );
@@ -197,8 +906,13 @@ void *_Mem_Alloc( poolhandle_t poolptr, size_t size, qboolean clear, const char
 
 	Mem_InitAlloc( mem, size, filename, fileline );
 
+	if( unlikely( mem_profile.enabled ))
+		Mem_ProfileAlloc( pool, mem );
+
+	Mem_Lock( &pool->lock );
 	Mem_PoolAdd( pool, size );
 	Mem_PoolLinkAlloc( pool, mem );
+	Mem_Unlock( &pool->lock );
 
 	if( clear )
 		memset((void *)((byte *)mem + sizeof( memheader_t )), 0, mem->size );
@@ -217,9 +931,12 @@ static void Mem_FreeBlock( memheader_t *mem, const char *filename, int fileline
 	if( !pool )
 		return;
 
+	Mem_Lock( &pool->lock );
+
 	// unlink memheader from doubly linked list
 	if(( mem->prev ? mem->prev->next != mem : pool->chain != mem ) || ( mem->next && mem->next->prev != mem ))
 	{
+		Mem_Unlock( &pool->lock );
 		Sys_Error( "%s: not allocated or double freed (free at %s:%i)\n", __func__, filename, fileline );
 		return;
 	}
@@ -227,7 +944,9 @@ static void Mem_FreeBlock( memheader_t *mem, const char *filename, int fileline
 	Mem_PoolSubtract( pool, mem->size );
 	Mem_PoolUnlinkAlloc( pool, mem );
 
-	Q_free( mem );
+	Mem_Unlock( &pool->lock );
+	Mem_ProfileFree( pool, mem );
+	Mem_HeapFree( mem );
 }
 
 void _Mem_Free( void *data, const char *filename, int fileline )
@@ -248,18 +967,28 @@ static void Mem_MigratePool( poolhandle_t newpoolptr, memheader_t *mem, const ch
 
 	// dettach allocation from one pool and reattach it to new pool
 	// might be made into public function at some point
+	// never hold both locks, so two threads migrating in opposite directions can't deadlock
 
+	Mem_Lock( &oldpool->lock );
 	Mem_PoolUnlinkAlloc( oldpool, mem );
 	Mem_PoolSubtract( oldpool, mem->size );
+	Mem_Unlock( &oldpool->lock );
+
+	// for profiler it's freed from old pool and allocated in new one
+	Mem_ProfileFree( oldpool, mem );
+	ClearBits( mem->flags, MEMHEADER_PROFILED );
+	if( unlikely( mem_profile.enabled ))
+		Mem_ProfileAlloc( newpool, mem );
 
+	Mem_Lock( &newpool->lock );
 	Mem_PoolLinkAlloc( newpool, mem );
 	Mem_PoolAdd( newpool, mem->size );
+	Mem_Unlock( &newpool->lock );
 }
 
 void *_Mem_Realloc( poolhandle_t poolptr, void *data, size_t size, qboolean clear, const char *filename, int fileline )
 {
-	memheader_t *mem;
-	uintptr_t oldmem;
+	memheader_t *mem, *newmem;
 	mempool_t *pool;
 	size_t oldsize;
 
@@ -290,77 +1019,162 @@ void *_Mem_Realloc( poolhandle_t poolptr, void *data, size_t size, qboolean clea
 
 	pool = Mem_FindPool( poolptr );
 
-	oldmem = (uintptr_t)mem;
-	mem = Q_realloc( mem, sizeof( memheader_t ) + size + sizeof( byte ));
-
-	if( mem == NULL )
+	if( FBitSet( mem->flags, MEMHEADER_CACHEABLE ) && size <= MEMCACHE_CAPACITY( MEMCACHE_CLASSES - 1 )
+		&& MEMCACHE_CLASS( size ) == MEMCACHE_CLASS( oldsize ))
 	{
-		Sys_Error( "%s: out of memory (alloc size %s at %s:%i)\n", __func__, Q_memprint( size ), filename, fileline );
-		return NULL;
+		// still fits into it's size class
+		Mem_ProfileFree( pool, mem );
+
+		Mem_Lock( &pool->lock );
+		Mem_PoolSubtract( pool, oldsize );
+		Mem_InitAlloc( mem, size, filename, fileline );
+		Mem_PoolAdd( pool, size );
+		Mem_Unlock( &pool->lock );
+
+		if( unlikely( mem_profile.enabled ))
+			Mem_ProfileAlloc( pool, mem );
 	}
+	else
+	{
+		// neighbours would point to the old address until it's relinked,
+		// so take it out of the chain while reallocating
+		Mem_Lock( &pool->lock );
+		Mem_PoolUnlinkAlloc( pool, mem );
+		Mem_PoolSubtract( pool, oldsize );
+		Mem_Unlock( &pool->lock );
 
-	// Con_Printf( S_NOTE "%s: mem %s oldmem, size before %zu now %zu (alloc at %s:%i)\n",
-	// __func__, (uintptr_t)mem != oldmem ? "!=" : "==", oldsize, size, filename, fileline );
+		Mem_ProfileFree( pool, mem );
 
-	Mem_InitAlloc( mem, size, filename, fileline );
+		newmem = Q_realloc( mem, sizeof( memheader_t ) + size + sizeof( byte ));
 
-	if( size > oldsize )
-	{
-		Mem_PoolAdd( pool, size - oldsize );
+		if( newmem == NULL )
+		{
+			Sys_Error( "%s: out of memory (alloc size %s at %s:%i)\n", __func__, Q_memprint( size ), filename, fileline );
+			return NULL;
+		}
 
-		if( clear )
-			memset((byte *)mem + sizeof( memheader_t ) + oldsize, 0, size - oldsize );
-	}
-	else Mem_PoolSubtract( pool, oldsize - size );
+		// Con_Printf( S_NOTE "%s: mem %s oldmem, size before %zu now %zu (alloc at %s:%i)\n",
+		// __func__, newmem != mem ? "!=" : "==", oldsize, size, filename, fileline );
 
-	if( oldmem != (uintptr_t)mem ) // just relink pointers
-	{
-		if( mem->next ) mem->next->prev = mem;
-		if( mem->prev ) mem->prev->next = mem;
-		else pool->chain = mem;
+		mem = newmem;
+		ClearBits( mem->flags, MEMHEADER_CACHEABLE );
+		Mem_InitAlloc( mem, size, filename, fileline );
+
+		if( unlikely( mem_profile.enabled ))
+			Mem_ProfileAlloc( pool, mem );
+
+		Mem_Lock( &pool->lock );
+		Mem_PoolLinkAlloc( pool, mem );
+		Mem_PoolAdd( pool, size );
+		Mem_Unlock( &pool->lock );
 	}
 
+	if( clear && size > oldsize )
+		memset((byte *)mem + sizeof( memheader_t ) + oldsize, 0, size - oldsize );
+
 	return (void *)((byte *)mem + sizeof( memheader_t ));
 }
 
 static poolhandle_t Mem_InitPool( mempool_t *pool, const char *name, const char *filename, int fileline )
 {
+	poolhandle_t	handle = pool->handle;
+
 	memset( pool, 0, sizeof( *pool ));
 
 	// fill header
+	pool->handle = handle;
 	pool->filename = filename;
 	pool->fileline = fileline;
 	pool->realsize = sizeof( mempool_t );
 	Q_strncpy( pool->name, name, sizeof( pool->name ));
 
-	return Mem_PoolIndex( pool );
+	return pool->handle;
 }
 
 poolhandle_t _Mem_AllocPool( const char *name, const char *filename, int fileline )
 {
+	poolhandle_t handle;
 	mempool_t *pool;
 	size_t i;
 
-	for( i = 0, pool = poolchain; i < poolcount; i++, pool++ )
+	Mem_Lock( &poollock );
+
+	for( i = 0; i < poolcount; i++ )
 	{
+		pool = Mem_PoolForIndex( i );
+
 		if( pool->filename == NULL )
-			return Mem_InitPool( pool, name, filename, fileline );
+		{
+			handle = Mem_InitPool( pool, name, filename, fileline );
+			Mem_Unlock( &poollock );
+			return handle;
+		}
+	}
+
+	if( poolcount % MEMPOOL_CHUNKSIZE == 0 )
+	{
+		mempool_t *chunk = NULL;
+
+		if( poolcount < MEMPOOL_CHUNKSIZE * MEMPOOL_MAXCHUNKS )
+			chunk = (mempool_t *)Q_malloc( sizeof( *chunk ) * MEMPOOL_CHUNKSIZE );
+
+		if( chunk == NULL )
+		{
+			Mem_Unlock( &poollock );
+			Sys_Error( "%s: out of memory (allocpool at %s:%i)\n", __func__, filename, fileline );
+			return 0;
+		}
+
+		poolchunks[poolcount / MEMPOOL_CHUNKSIZE] = chunk;
 	}
 
-	pool = (mempool_t *)Q_realloc( poolchain, sizeof( *poolchain ) * ( poolcount + 1 ));
-	if( pool == NULL )
+	pool = Mem_PoolForIndex( poolcount );
+	pool->handle = (poolhandle_t)( poolcount + 1 );
+	handle = Mem_InitPool( pool, name, filename, fileline );
+	poolcount++; // publish only after pool is ready
+
+	Mem_Unlock( &poollock );
+	return handle;
+}
+
+/*
+========================
+Mem_ReleaseChain
+
+pool must be locked
+========================
+*/
+static void Mem_ReleaseChain( mempool_t *pool, const char *filename, int fileline )
+{
+	memheader_t	*mem, *next;
+
+	for( mem = pool->chain; mem; mem = next )
 	{
-		Sys_Error( "%s: out of memory (allocpool at %s:%i)\n", __func__, filename, fileline );
-		return 0;
+		next = mem->next;
+
+		if( !Mem_SentinelsValid( mem ))
+		{
+			// don't hold the lock while engine is shutting down
+			Mem_Unlock( &pool->lock );
+			Mem_CheckAllocHeader( __func__, mem, filename, fileline );
+			Mem_Lock( &pool->lock );
+			break;
+		}
+
+		mem->poolptr = 0;
+		Mem_ProfileFree( pool, mem );
+
+		Mem_HeapFree( mem );
 	}
 
-	poolchain = pool;
-	pool = &poolchain[poolcount++];
-	return Mem_InitPool( pool, name, filename, fileline );
+	pool->chain = NULL;
+	pool->totalsize = 0;
+	pool->realsize = sizeof( mempool_t );
 }
 
 void _Mem_FreePool( poolhandle_t *poolptr, const char *filename, int fileline )
 {
+	poolhandle_t	handle;
 	mempool_t	*pool;
 
 	if( *poolptr && ( pool = Mem_FindPool( *poolptr )))
@@ -373,13 +1187,20 @@ void _Mem_FreePool( poolhandle_t *poolptr, const char *filename, int fileline )
 		}
 
 		// free memory owned by the pool
-		while( pool->chain )
-			Mem_FreeBlock( pool->chain, filename, fileline );
+		Mem_Lock( &pool->lock );
+		Mem_ReleaseChain( pool, filename, fileline );
+		Mem_Unlock( &pool->lock );
 
 		// free the pool itself
+		Mem_Lock( &poollock );
+		handle = pool->handle;
 		memset( pool, 0xBF, sizeof( mempool_t ));
 		pool->chain = NULL;
+		pool->lock = 0;
+		pool->handle = handle;
 		pool->filename = NULL; // mark as reusable
+		Mem_Unlock( &poollock );
+
 		*poolptr = 0;
 	}
 }
@@ -398,34 +1219,46 @@ void _Mem_EmptyPool( poolhandle_t poolptr, const char *filename, int fileline )
 		return;
 
 	// free memory owned by the pool
-	while( pool->chain ) Mem_FreeBlock( pool->chain, filename, fileline );
+	Mem_Lock( &pool->lock );
+	Mem_ReleaseChain( pool, filename, fileline );
+	Mem_Unlock( &pool->lock );
 }
 
 static qboolean Mem_CheckAlloc( mempool_t *pool, void *data )
 {
 	memheader_t *header, *target;
+	qboolean found = false;
 
 	if( pool )
 	{
 		// search only one pool
 		target = (memheader_t *)((byte *)data - sizeof( memheader_t ));
+
+		Mem_Lock( &pool->lock );
 		for( header = pool->chain; header; header = header->next )
 		{
 			if( header == target )
-				return true;
+			{
+				found = true;
+				break;
+			}
 		}
+		Mem_Unlock( &pool->lock );
 	}
 	else
 	{
 		// search all pools
 		size_t i;
-		for( i = 0, pool = poolchain; i < poolcount; i++, pool++ )
+		for( i = 0; i < poolcount && !found; i++ )
 		{
-			if( Mem_CheckAlloc( pool, data ))
-				return true;
+			pool = Mem_PoolForIndex( i );
+
+			if( pool->filename && Mem_CheckAlloc( pool, data ))
+				found = true;
 		}
 	}
-	return false;
+
+	return found;
 }
 
 /*
@@ -449,9 +1282,25 @@ void _Mem_Check( const char *filename, int fileline )
 	mempool_t   *pool;
 	size_t i;
 
-	for( i = 0, pool = poolchain; i < poolcount; i++, pool++ )
+	for( i = 0; i < poolcount; i++ )
+	{
+		pool = Mem_PoolForIndex( i );
+
+		if( !pool->filename )
+			continue;
+
+		Mem_Lock( &pool->lock );
 		for( mem = pool->chain; mem; mem = mem->next )
-			Mem_CheckAllocHeader( __func__, mem, filename, fileline );
+		{
+			if( !Mem_SentinelsValid( mem ))
+			{
+				Mem_Unlock( &pool->lock );
+				Mem_CheckAllocHeader( __func__, mem, filename, fileline );
+				return;
+			}
+		}
+		Mem_Unlock( &pool->lock );
+	}
 }
 
 void Mem_PrintStats( void )
@@ -460,8 +1309,10 @@ void Mem_PrintStats( void )
 	mempool_t *pool;
 
 	Mem_Check();
-	for( i = 0, pool = poolchain; i < poolcount; i++, pool++ )
+	for( i = 0; i < poolcount; i++ )
 	{
+		pool = Mem_PoolForIndex( i );
+
 		if( !pool->filename )
 			continue;
 
@@ -472,6 +1323,10 @@ void Mem_PrintStats( void )
 
 	Con_Printf( "^3%zu^7 memory pools, totalling: ^1%s\n", count, Q_memprint( size ));
 	Con_Printf( "total allocated size: ^1%s\n", Q_memprint( realsize ));
+	Con_Printf( "scratch high water: ^1%s^7, %zu overflows", Q_memprint( mem_scratchstats.highwater ), mem_scratchstats.overflows );
+	if( mem_scratchstats.largest )
+		Con_Printf( " (largest %s at %s:%i)", Q_memprint( mem_scratchstats.largest ), mem_scratchstats.largest_filename, mem_scratchstats.largest_fileline );
+	Con_Printf( "\n" );
 }
 
 void Mem_PrintList( size_t minallocationsize )
@@ -484,9 +1339,14 @@ void Mem_PrintList( size_t minallocationsize )
 
 	Con_Printf( "memory pool list:\n" );
 	Con_Printf( "\t^3size\t\t\t\tname\n");
-	for( i = 0, pool = poolchain; i < poolcount; i++, pool++ )
+
+	// not locked, Con_Printf could allocate from the pool being listed
+	for( i = 0; i < poolcount; i++ )
 	{
-		long	changed_size = (long)pool->totalsize - (long)pool->lastchecksize;
+		long	changed_size;
+
+		pool = Mem_PoolForIndex( i );
+		changed_size = (long)pool->totalsize - (long)pool->lastchecksize;
 
 		if( !pool->filename )
 			continue;
@@ -520,5 +1380,256 @@ Memory_Init
 */
 void Memory_Init( void )
 {
-	poolchain = NULL; // init mem chain
+	// pool storage is static, keep pools created so far
+}
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+#if XASH_WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+void Test_RunZoneProfile( void )
+{
+	poolhandle_t	pool = Mem_AllocPool( "Test Profile" );
+	poolhandle_t	other = Mem_AllocPool( "Test Profile Other" );
+	const memsite_t	*site;
+	void		*a, *b, *c;
+	qboolean		enabled = mem_profile.enabled;
+
+	Mem_ProfileEnable( true );
+	Mem_ProfileReset();
+
+	a = _Mem_Alloc( pool, 100, true, "test.c", 1 );
+	b = _Mem_Alloc( pool, 300, true, "test.c", 1 );
+	c = _Mem_Alloc( other, 50, true, "test.c", 1 );
+	Mem_ProfileFrame();
+	Mem_ProfileFrame();
+	Mem_Free( a );
+
+	site = Mem_ProfileSite( pool, "test.c", 1, false );
+	TASSERT( site != NULL );
+	TASSERT_EQi( (int)site->allocs, 2 );
+	TASSERT_EQi( (int)site->frees, 1 );
+	TASSERT_EQi( (int)site->bytes, 400 );
+	TASSERT_EQi( (int)site->livecount, 1 );
+	TASSERT_EQi( (int)site->livebytes, 300 );
+	TASSERT_EQi( (int)site->lifetime, 2 );
+
+	// other pool is a separate site
+	site = Mem_ProfileSite( other, "test.c", 1, false );
+	TASSERT( site != NULL );
+	TASSERT_EQi( (int)site->livebytes, 50 );
+
+	// realloc moves it to the new call site
+	b = _Mem_Realloc( pool, b, 1000, true, "test.c", 2 );
+	site = Mem_ProfileSite( pool, "test.c", 1, false );
+	TASSERT_EQi( (int)site->livecount, 0 );
+	site = Mem_ProfileSite( pool, "test.c", 2, false );
+	TASSERT_EQi( (int)site->livebytes, 1000 );
+	TASSERT_EQi( (int)site->peakframe, 0 );
+
+	Mem_EmptyPool( other );
+	site = Mem_ProfileSite( other, "test.c", 1, false );
+	TASSERT_EQi( (int)site->livecount, 0 );
+
+	Mem_Free( b );
+	Mem_FreePool( &pool );
+	Mem_FreePool( &other );
+
+	Mem_ProfileReset();
+	Mem_ProfileEnable( enabled );
+	(void)c;
+}
+
+void Test_RunZoneScratch( void )
+{
+	byte	*a, *b, *c, *big;
+	uintptr_t	freed;
+	size_t	used;
+
+	Mem_ScratchReset();
+
+	a = Mem_ScratchCalloc( 100 );
+	TASSERT( a[99] == 0 );
+	used = mem_scratch.used;
+
+	// freed in reverse order, space is reused
+	b = Mem_ScratchAlloc( 1000 );
+	c = Mem_ScratchAlloc( 10 );
+	freed = (uintptr_t)b;
+	Mem_ScratchFree( b );
+	TASSERT( mem_scratch.used > used );
+	Mem_ScratchFree( c );
+	TASSERT( mem_scratch.used == used );
+	TASSERT( (uintptr_t)Mem_ScratchAlloc( 1000 ) == freed );
+
+	// doesn't fit, goes to malloc
+	big = Mem_ScratchCalloc( mem_scratch.size );
+	TASSERT( big[mem_scratch.size - 1] == 0 );
+	TASSERT( mem_scratch.overflows == 1 );
+	TASSERT( mem_scratch.overflow != NULL );
+	Mem_ScratchFree( big );
+	TASSERT( mem_scratch.overflow == NULL );
+
+	// live overflow is released by reset and the buffer grows to fit it next time
+	big = Mem_ScratchAlloc( MEMSCRATCH_SIZE + 1 );
+	Mem_ScratchReset();
+	TASSERT( mem_scratch.used == 0 && mem_scratch.overflow == NULL );
+	TASSERT( mem_scratch.size >= MEMSCRATCH_SIZE * 2 );
+	TASSERT( mem_scratchstats.highwater > MEMSCRATCH_SIZE );
+	TASSERT( mem_scratchstats.largest >= MEMSCRATCH_SIZE + 1 );
+	big = Mem_ScratchAlloc( MEMSCRATCH_SIZE + 1 );
+	TASSERT( mem_scratch.overflow == NULL );
+
+	Mem_ScratchReset();
+}
+
+#define ZONE_TEST_THREADS	4
+#define ZONE_TEST_SLOTS	256
+#define ZONE_TEST_ITERATIONS	50000
+
+typedef struct zonetest_s
+{
+	poolhandle_t	pools[2];
+	uint		seed;
+	int		errors;
+} zonetest_t;
+
+static void Test_ZoneWorker( zonetest_t *t )
+{
+	byte	*slots[ZONE_TEST_SLOTS] = { 0 };
+	size_t	sizes[ZONE_TEST_SLOTS] = { 0 };
+	int	i, j;
+
+	for( i = 0; i < ZONE_TEST_ITERATIONS; i++ )
+	{
+		int	slot, op;
+		size_t	size;
+
+		t->seed = t->seed * 1103515245 + 12345;
+		slot = ( t->seed >> 8 ) % ZONE_TEST_SLOTS;
+		op = ( t->seed >> 20 ) % 4;
+		size = 1 + ( t->seed >> 12 ) % ( op == 3 ? 4096 : 300 );
+
+		if( slots[slot] )
+		{
+			// each slot is filled with it's own index
+			for( j = 0; j < sizes[slot]; j++ )
+			{
+				if( slots[slot][j] != (byte)slot )
+				{
+					t->errors++;
+					break;
+				}
+			}
+		}
+
+		if( slots[slot] && op == 0 )
+		{
+			Mem_Free( slots[slot] );
+			slots[slot] = NULL;
+			continue;
+		}
+
+		if( slots[slot] )
+			slots[slot] = Mem_Realloc( t->pools[op & 1], slots[slot], size );
+		else slots[slot] = Mem_Malloc( t->pools[op & 1], size );
+
+		memset( slots[slot], slot, size );
+		sizes[slot] = size;
+	}
+
+	for( i = 0; i < ZONE_TEST_SLOTS; i++ )
+	{
+		if( slots[i] )
+			Mem_Free( slots[i] );
+	}
+
+	Mem_FlushThreadCache();
+}
+
+#if XASH_WIN32
+static DWORD WINAPI Test_ZoneThread( LPVOID arg )
+{
+	Test_ZoneWorker( arg );
+	return 0;
+}
+#else
+static void *Test_ZoneThread( void *arg )
+{
+	Test_ZoneWorker( arg );
+	return NULL;
+}
+#endif
+
+void Test_RunZoneThreads( void )
+{
+	zonetest_t	tests[ZONE_TEST_THREADS + 1];
+	poolhandle_t	pools[2];
+#if XASH_WIN32
+	HANDLE		threads[ZONE_TEST_THREADS];
+#else
+	pthread_t		threads[ZONE_TEST_THREADS];
+#endif
+	double		start;
+	int		i;
+
+	pools[0] = Mem_AllocPool( "Test Threads" );
+	pools[1] = Mem_AllocPool( "Test Threads Other" );
+
+	start = Platform_DoubleTime();
+
+	for( i = 0; i <= ZONE_TEST_THREADS; i++ )
+	{
+		tests[i].pools[0] = pools[0];
+		tests[i].pools[1] = pools[1];
+		tests[i].seed = i * 7919 + 1;
+		tests[i].errors = 0;
+	}
+
+	for( i = 0; i < ZONE_TEST_THREADS; i++ )
+	{
+#if XASH_WIN32
+		threads[i] = CreateThread( NULL, 0, Test_ZoneThread, &tests[i], 0, NULL );
+		TASSERT( threads[i] != NULL );
+#else
+		TASSERT( pthread_create( &threads[i], NULL, Test_ZoneThread, &tests[i] ) == 0 );
+#endif
+	}
+
+	// main thread takes part too
+	Test_ZoneWorker( &tests[ZONE_TEST_THREADS] );
+
+	for( i = 0; i < ZONE_TEST_THREADS; i++ )
+	{
+#if XASH_WIN32
+		WaitForSingleObject( threads[i], INFINITE );
+		CloseHandle( threads[i] );
+#else
+		pthread_join( threads[i], NULL );
+#endif
+	}
+
+	Msg( "%d threads, %d allocations each: %.2f ms\n", ZONE_TEST_THREADS + 1, ZONE_TEST_ITERATIONS,
+		( Platform_DoubleTime() - start ) * 1000.0 );
+
+	for( i = 0; i <= ZONE_TEST_THREADS; i++ )
+		TASSERT_EQi( tests[i].errors, 0 );
+
+	Mem_Check();
+
+	// everything was freed, so bookkeeping must be back to zero
+	TASSERT( Mem_FindPool( pools[0] )->chain == NULL );
+	TASSERT( Mem_FindPool( pools[1] )->chain == NULL );
+	TASSERT( Mem_FindPool( pools[0] )->totalsize == 0 );
+	TASSERT( Mem_FindPool( pools[1] )->totalsize == 0 );
+	TASSERT( Mem_FindPool( pools[0] )->realsize == sizeof( mempool_t ));
+	TASSERT( Mem_FindPool( pools[1] )->realsize == sizeof( mempool_t ));
+
+	Mem_FreePool( &pools[0] );
+	Mem_FreePool( &pools[1] );
 }
+#endif /* XASH_ENGINE_TESTS */
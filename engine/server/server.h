@@ -65,6 +65,7 @@ extern int SV_UPDATE_BACKUP;
 #define MAKE_STRING(str)	SV_MakeString( str )
 
 #define MAX_PUSHED_ENTS	256
+#define PRECACHE_HASH_SIZE	256	// must be power of two
 #define MAX_VIEWENTS	128
 
 #define FCL_RESEND_USERINFO	BIT( 0 )
@@ -144,6 +145,12 @@ typedef struct server_s
 	char		event_precache[MAX_EVENTS][MAX_QPATH];
 	byte		model_precache_flags[MAX_MODELS];
 	model_t		*models[MAX_MODELS];
+
+	// case-insensitive hashes for precache lookups, chains are terminated by zero
+	word		model_hash[PRECACHE_HASH_SIZE], model_hashnext[MAX_MODELS];
+	word		sound_hash[PRECACHE_HASH_SIZE], sound_hashnext[MAX_SOUNDS];
+	word		files_hash[PRECACHE_HASH_SIZE], files_hashnext[MAX_CUSTOM];
+	word		event_hash[PRECACHE_HASH_SIZE], event_hashnext[MAX_EVENTS];
 	int		num_static_entities;
 
 	// run local lightstyles to let SV_LightPoint grab the actual information
@@ -200,6 +207,18 @@ typedef struct
 	int  		first_entity;		// into the circular sv_packet_entities[]
 } client_frame_t;
 
+// players positions as they were seen by client in the client_frame_t with same index
+// used to unlag other players without walking through all the packet entities
+typedef struct
+{
+	int		sequence;			// outgoing sequence this record describes
+	uint		present;			// bit per player visible in this frame
+	uint		nointerp;			// bit per player that was dead or EF_NOINTERP
+	vec3_t		origin[MAX_CLIENTS];
+	int		lastseen[MAX_CLIENTS];	// latest sequence + 1 where player was visible, up to this one
+	int		lastbreak[MAX_CLIENTS];	// latest sequence + 1 that forbids unlag if it gets in the window
+} client_unlag_t;
+
 typedef struct sv_client_s
 {
 	cl_state_t	state;
@@ -251,6 +270,8 @@ typedef struct sv_client_s
 	byte		datagram_buf[MAX_DATAGRAM];
 
 	client_frame_t	*frames;			// updates can be delta'd from here
+	client_unlag_t	*unlag;			// [SV_UPDATE_BACKUP], parallel to frames
+	int		unlag_sequence;		// last recorded outgoing sequence
 	event_state_t	events;			// delta-updated events cycle
 
 	int		challenge;		// challenge of this user, randomly generated
@@ -308,7 +329,6 @@ typedef struct
 {
 	qboolean		active;
 	qboolean		moving;
-	qboolean		firstframe;
 	qboolean		nointerp;
 
 	vec3_t		mins;
@@ -317,7 +337,6 @@ typedef struct
 	vec3_t		curpos;
 	vec3_t		oldpos;
 	vec3_t		newpos;
-	vec3_t		finalpos;
 } sv_interp_t;
 
 typedef struct
@@ -362,6 +381,8 @@ typedef struct
 {
 	qboolean		initialized;		// sv_init has completed
 	double		timestart;		// just for profiling
+	int		fslookups;		// filesystem lookups at level start
+	int		fsmissingcached;		// and how many of them were known missing files
 
 	int		maxclients;		// server max clients
 
@@ -478,6 +499,8 @@ void SV_FinalMessage( const char *message, qboolean reconnect );
 void SV_KickPlayer( sv_client_t *cl, const char *fmt, ... ) _format( 2 );
 void SV_DropClient( sv_client_t *cl, qboolean crash ) RENAME_SYMBOL( "SV_DropClient_" );
 void SV_UpdateMovevars( qboolean initialize );
+int SV_FindPrecache( char (*names)[MAX_QPATH], const word *hash, const word *next, const char *name );
+void SV_AddPrecache( char (*names)[MAX_QPATH], word *hash, word *next, int index );
 int SV_ModelIndex( const char *name );
 int SV_SoundIndex( const char *name );
 int SV_EventIndex( const char *name );
@@ -661,12 +684,16 @@ void SV_ClearGameState( void );
 void SV_InitClientMove( void );
 qboolean SV_PlayerIsFrozen( edict_t *pClient );
 void SV_RunCmd( sv_client_t *cl, usercmd_t *ucmd, int random_seed );
+void SV_RecordUnlagFrame( sv_client_t *cl, client_frame_t *frame );
 
 //
 // sv_world.c
 //
 void SV_ClearWorld( void );
 void SV_UnlinkEdict( edict_t *ent );
+edict_t **SV_AreaSolidEdicts( areanode_t *node, int *numedicts );
+int SV_AreaEdictNode( const edict_t *ent );
+uint SV_AreaNodeSerial( const areanode_t *node );
 void SV_ClipMoveToEntity( edict_t *ent, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, trace_t *trace );
 void SV_CustomClipMoveToEntity( edict_t *ent, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, trace_t *trace );
 trace_t SV_Move( const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int type, edict_t *e, qboolean monsterclip );
@@ -675,6 +702,10 @@ const char *SV_TraceTexture( edict_t *ent, const vec3_t start, const vec3_t end
 msurface_t *SV_TraceSurface( edict_t *ent, const vec3_t start, const vec3_t end );
 trace_t SV_MoveToss( edict_t *tossent, edict_t *ignore );
 void SV_LinkEdict( edict_t *ent, qboolean touch_triggers );
+void SV_InitSphereEdicts( void );
+void SV_ShutdownSphereEdicts( void );
+void SV_LinkSphereEdict( edict_t *ent );
+int SV_FindEntityInSphere( int start, const float *org, float flRadius );
 int SV_TruePointContents( const vec3_t p );
 int SV_PointContents( const vec3_t p );
 void SV_SetLightStyle( int style, const char* s, float f );
@@ -431,6 +431,9 @@ static void SV_ConnectClient( netadr_t from )
 	newcl->challenge = challenge; // save challenge for checksumming
 	if( newcl->frames ) Mem_Free( newcl->frames );
 	newcl->frames = (client_frame_t *)Z_Calloc( sizeof( client_frame_t ) * SV_UPDATE_BACKUP );
+	if( newcl->unlag ) Mem_Free( newcl->unlag );
+	newcl->unlag = (client_unlag_t *)Z_Calloc( sizeof( client_unlag_t ) * SV_UPDATE_BACKUP );
+	newcl->unlag_sequence = 0;
 	newcl->userid = g_userid++;	// create unique userid
 	newcl->state = cs_connected;
 	newcl->extensions = extensions & (NET_EXT_SPLITSIZE);
@@ -542,6 +545,7 @@ edict_t *GAME_EXPORT SV_FakeConnect( const char *netname )
 	sv.current_client = cl;
 
 	if( cl->frames ) Mem_Free( cl->frames );	// fakeclients doesn't have frames
+	if( cl->unlag ) Mem_Free( cl->unlag );
 	memset( cl, 0, sizeof( sv_client_t ));
 
 	cl->edict = EDICT_NUM( (cl - svs.clients) + 1 );
@@ -661,6 +665,10 @@ void SV_DropClient( sv_client_t *cl, qboolean crash )
 		Mem_Free( cl->frames ); // release delta
 	cl->frames = NULL;
 
+	if( cl->unlag )
+		Mem_Free( cl->unlag );
+	cl->unlag = NULL;
+
 	if( NET_CompareBaseAdr( cl->netchan.remote_address, host.rd.address ))
 		SV_EndRedirect( &host.rd );
 
@@ -689,6 +689,8 @@ static void SV_WriteEntitiesToClient( sv_client_t *cl, sizebuf_t *msg )
 		frame->num_entities++;
 	}
 
+	SV_RecordUnlagFrame( cl, frame );
+
 	SV_EmitPacketEntities( cl, frame, msg );
 	SV_EmitEvents( cl, frame, msg );
 	if( send_pings ) SV_EmitPings( msg );
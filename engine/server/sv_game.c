@@ -29,6 +29,8 @@ GNU General Public License for more details.
 // GameAPI functions declarations
 static int GAME_EXPORT pfnModelIndex( const char *m );
 
+static qboolean SV_IsStableString( const char *s );
+
 // fatpvs stuff
 static byte fatphs[(MAX_MAP_LEAFS+7)/8];
 static byte clientpvs[(MAX_MAP_LEAFS+7)/8];	// for find client in PVS
@@ -1021,6 +1023,9 @@ void SV_InitEdict( edict_t *pEdict )
 	pEdict->v.controller[2] = 0x7F;
 	pEdict->v.controller[3] = 0x7F;
 	pEdict->free = false;
+
+	// absbox was cleared
+	SV_LinkSphereEdict( pEdict );
 }
 
 /*
@@ -1346,11 +1351,8 @@ static int GAME_EXPORT pfnModelIndex( const char *m )
 	Q_strncpy( name, m, sizeof( name ));
 	COM_FixSlashes( name );
 
-	for( i = 1; i < MAX_MODELS && sv.model_precache[i][0]; i++ )
-	{
-		if( !Q_stricmp( sv.model_precache[i], name ))
-			return i;
-	}
+	if(( i = SV_FindPrecache( sv.model_precache, sv.model_hash, sv.model_hashnext, name )) != 0 )
+		return i;
 
 	Con_Printf( S_ERROR "Cannot get index for model %s: not precached\n", name );
 	return 0;
@@ -1498,6 +1500,132 @@ static void GAME_EXPORT pfnChangePitch( edict_t* ent )
 	ent->v.angles[PITCH] = SV_AngleMod( ent->v.idealpitch, ent->v.angles[PITCH], ent->v.pitch_speed );
 }
 
+/*
+=========
+entity string hashes
+
+game dll writes entvars directly, so the engine can't keep an index
+of them up to date. Search is always a linear scan in edict order,
+but for the most searched fields hash of the string is remembered
+per edict, so mismatches are rejected without touching the string.
+Hash is trusted only for strings in engine string array, those are
+never rewritten until the array is reset. Everything else (MAKE_STRING
+of game dll buffers, 32-bit zone strings) is always compared by contents
+=========
+*/
+static const int sv_strindex_fields[] =
+{
+	offsetof( entvars_t, classname ),
+	offsetof( entvars_t, targetname ),
+	offsetof( entvars_t, target ),
+	offsetof( entvars_t, netname ),
+};
+
+#define SV_STRINDEX_FIELDS	ARRAYSIZE( sv_strindex_fields )
+
+typedef struct
+{
+	string_t	str;
+	uint	hash;
+	uint	generation;
+} strhash_t;
+
+static struct
+{
+	strhash_t	*hashes[SV_STRINDEX_FIELDS];	// [GI->max_edicts]
+	uint	generation;		// bumped when string array is reused
+} sv_strindex;
+
+static uint SV_StringHash( const char *s )
+{
+	uint hash = 5381;
+
+	while( *s )
+		hash = ( hash << 5 ) + hash + (byte)*s++;
+
+	return hash;
+}
+
+/*
+=========
+SV_AllocEntityStringIndex
+
+=========
+*/
+static void SV_AllocEntityStringIndex( void )
+{
+#ifdef XASH_64BIT
+	int i;
+
+	for( i = 0; i < SV_STRINDEX_FIELDS; i++ )
+		sv_strindex.hashes[i] = Mem_Calloc( svgame.mempool, sizeof( strhash_t ) * GI->max_edicts );
+
+	// zeroed entries are never valid
+	sv_strindex.generation = 1;
+#endif
+}
+
+/*
+=========
+SV_InvalidateEntityStringIndex
+
+must be called every time when engine reuses string array memory
+=========
+*/
+static void SV_InvalidateEntityStringIndex( void )
+{
+	if( ++sv_strindex.generation == 0 )
+		sv_strindex.generation = 1;
+}
+
+/*
+=========
+SV_EntityStringIndex
+
+returns hashes of field at given entvars offset or NULL
+=========
+*/
+static strhash_t *SV_EntityStringIndex( int offset )
+{
+	int i;
+
+	// custom string functions may reuse string_t, don't index them
+	if( svgame.physFuncs.pfnGetString != NULL )
+		return NULL;
+
+	for( i = 0; i < SV_STRINDEX_FIELDS; i++ )
+	{
+		if( sv_strindex_fields[i] == offset )
+			return sv_strindex.hashes[i];
+	}
+
+	return NULL;
+}
+
+/*
+=========
+SV_EntityStringDiffers
+
+true only if string is known to differ from searched one by hash
+=========
+*/
+static qboolean SV_EntityStringDiffers( strhash_t *hashes, int e, string_t str, const char *t, uint hash )
+{
+	strhash_t *h = &hashes[e];
+
+	if( !SV_IsStableString( t ))
+		return false;
+
+	if( h->str != str || h->generation != sv_strindex.generation )
+	{
+		h->str = str;
+		h->hash = SV_StringHash( t );
+		h->generation = sv_strindex.generation;
+	}
+
+	return h->hash != hash;
+}
+
 /*
 =========
 SV_FindEntityByString
@@ -1508,8 +1636,11 @@ static edict_t *GAME_EXPORT SV_FindEntityByString( edict_t *pStartEdict, const c
 {
 	int		index = 0, e = 0;
 	TYPEDESCRIPTION	*desc = NULL;
+	strhash_t		*hashes;
 	edict_t		*ed;
 	const char	*t;
+	string_t		str;
+	uint		hash = 0;
 
 	if( !COM_CheckString( pszValue ))
 		return svgame.edicts;
@@ -1528,6 +1659,9 @@ static edict_t *GAME_EXPORT SV_FindEntityByString( edict_t *pStartEdict, const c
 		return svgame.edicts;
 	}
 
+	if(( hashes = SV_EntityStringIndex( desc->fieldOffset )) != NULL )
+		hash = SV_StringHash( pszValue );
+
 	for( e++; e < svgame.numEntities; e++ )
 	{
 		ed = EDICT_NUM( e );
@@ -1541,9 +1675,13 @@ static edict_t *GAME_EXPORT SV_FindEntityByString( edict_t *pStartEdict, const c
 		case FIELD_STRING:
 		case FIELD_MODELNAME:
 		case FIELD_SOUNDNAME:
-			t = STRING( *(string_t *)&((byte *)&ed->v)[desc->fieldOffset] );
+			str = *(string_t *)&((byte *)&ed->v)[desc->fieldOffset];
+			t = STRING( str );
 			if( t != NULL && t != svgame.globals->pStringBase )
 			{
+				if( hashes && SV_EntityStringDiffers( hashes, e, str, t, hash ))
+					break;
+
 				if( !Q_strcmp( t, pszValue ))
 					return ed;
 			}
@@ -1602,45 +1740,12 @@ find the entity in sphere
 */
 static edict_t *GAME_EXPORT pfnFindEntityInSphere( edict_t *pStartEdict, const float *org, float flRadius )
 {
-	float	distSquared;
-	int	j, e = 0;
-	float	eorg;
-	edict_t	*ent;
-
-	flRadius *= flRadius;
+	int	e = 0;
 
 	if( SV_IsValidEdict( pStartEdict ))
 		e = NUM_FOR_EDICT( pStartEdict );
 
-	for( e++; e < svgame.numEntities; e++ )
-	{
-		ent = EDICT_NUM( e );
-
-		if( !SV_IsValidEdict( ent ))
-			continue;
-
-		// ignore clients that not in a game
-		if( e <= svs.maxclients && !SV_ClientFromEdict( ent, true ))
-			continue;
-
-		distSquared = 0.0f;
-
-		for( j = 0; j < 3 && distSquared <= flRadius; j++ )
-		{
-			if( org[j] < ent->v.absmin[j] )
-				eorg = org[j] - ent->v.absmin[j];
-			else if( org[j] > ent->v.absmax[j] )
-				eorg = org[j] - ent->v.absmax[j];
-			else eorg = 0.0f;
-
-			distSquared += eorg * eorg;
-		}
-
-		if( distSquared < flRadius )
-			return ent;
-	}
-
-	return svgame.edicts;
+	return EDICT_NUM( SV_FindEntityInSphere( e, org, flRadius ));
 }
 
 /*
@@ -3014,7 +3119,98 @@ static struct str64_s
 	size_t numdups;
 	size_t numoverflows;
 	size_t totalalloc;
+
+	// open addressing table of strings after poldstringbase
+	// for deduplication, stores offsets from poldstringbase, 0 is empty slot
+	uint *hashtable;
+	uint hashsize; // always power of two
+	uint hashcount;
 } str64;
+
+/*
+==================
+SV_Str64ClearHash
+
+must be called each time when poldstringbase or plast is reset
+==================
+*/
+static void SV_Str64ClearHash( void )
+{
+	if( str64.hashtable )
+		memset( str64.hashtable, 0, sizeof( *str64.hashtable ) * str64.hashsize );
+	str64.hashcount = 0;
+}
+
+/*
+==================
+SV_Str64FindHash
+
+returns first string in current array region equal to szValue
+==================
+*/
+static char *SV_Str64FindHash( const char *szValue, uint hash )
+{
+	uint i, mask = str64.hashsize - 1;
+
+	if( !str64.hashtable )
+		return NULL;
+
+	for( i = hash & mask; str64.hashtable[i]; i = ( i + 1 ) & mask )
+	{
+		char *str = str64.poldstringbase + str64.hashtable[i];
+
+		if( !Q_strcmp( str, szValue ))
+			return str;
+	}
+
+	return NULL;
+}
+
+/*
+==================
+SV_Str64InsertHash
+
+==================
+*/
+static void SV_Str64InsertHash( const char *str, uint hash )
+{
+	uint i, mask;
+
+	// keep load factor below 0.5
+	if(( str64.hashcount + 1 ) * 2 > str64.hashsize )
+	{
+		uint *oldtable = str64.hashtable;
+		uint j, oldsize = str64.hashsize;
+
+		str64.hashsize = oldsize ? oldsize * 2 : 4096;
+		str64.hashtable = Mem_Calloc( host.mempool, sizeof( *str64.hashtable ) * str64.hashsize );
+		mask = str64.hashsize - 1;
+
+		for( j = 0; j < oldsize; j++ )
+		{
+			if( !oldtable[j] )
+				continue;
+
+			for( i = SV_StringHash( str64.poldstringbase + oldtable[j] ) & mask; str64.hashtable[i]; i = ( i + 1 ) & mask );
+			str64.hashtable[i] = oldtable[j];
+		}
+
+		if( oldtable )
+			Mem_Free( oldtable );
+	}
+
+	mask = str64.hashsize - 1;
+
+	for( i = hash & mask; str64.hashtable[i]; i = ( i + 1 ) & mask )
+	{
+		// keep the first one, linear search did the same
+		if( !Q_strcmp( str64.poldstringbase + str64.hashtable[i], str ))
+			return;
+	}
+
+	str64.hashtable[i] = str - str64.poldstringbase;
+	str64.hashcount++;
+}
 #endif
 
 /*
@@ -3026,6 +3222,8 @@ Free strings on server stop. Reset string pointer on 64 bits
 */
 void SV_EmptyStringPool( void )
 {
+	SV_InvalidateEntityStringIndex();
+
 #ifdef XASH_64BIT
 	if( str64.dynamic ) // switch only after array fill (more space for multiplayer games)
 		str64.pstringbase = str64.pstringarray;
@@ -3033,6 +3231,7 @@ void SV_EmptyStringPool( void )
 	{
 		str64.pstringbase = str64.poldstringbase = str64.pstringarraystatic;
 		str64.plast = str64.pstringbase + 1;
+		SV_Str64ClearHash();
 	}
 #else
 	Mem_EmptyPool( svgame.stringspool );
@@ -3157,6 +3356,7 @@ static void SV_AllocStringPool( void )
 	str64.pstringbase = str64.poldstringbase = ptr;
 	str64.plast = (byte*)ptr + 1;
 	svgame.globals->pStringBase = ptr;
+	SV_Str64ClearHash();
 #else
 	svgame.stringspool = Mem_AllocPool( "Server Strings" );
 	svgame.globals->pStringBase = "";
@@ -3174,11 +3374,33 @@ static void SV_FreeStringPool( void )
 	else
 #endif
 		Mem_Free( str64.staticstringarray );
+
+	if( str64.hashtable )
+		Mem_Free( str64.hashtable );
+	str64.hashtable = NULL;
+	str64.hashsize = str64.hashcount = 0;
 #else
 	Mem_FreePool( &svgame.stringspool );
 #endif
 }
 
+/*
+==================
+SV_IsStableString
+
+string lives in engine string array and
+won't change until array is reset
+==================
+*/
+static qboolean SV_IsStableString( const char *s )
+{
+#ifdef XASH_64BIT
+	return s >= str64.pstringarray && s < str64.pstringarray + str64.maxstringarray * 2;
+#else
+	return false;
+#endif
+}
+
 /*
 ============
 SV_ProcessString
@@ -3248,7 +3470,7 @@ string_t GAME_EXPORT SV_AllocString( const char *szValue )
 	char *newString = NULL;
 	uint len;
 #ifdef XASH_64BIT
-	int cmp;
+	uint hash = 0;
 #endif
 
 	if( svgame.physFuncs.pfnAllocString != NULL )
@@ -3266,16 +3488,10 @@ string_t GAME_EXPORT SV_AllocString( const char *szValue )
 	}
 
 #ifdef XASH_64BIT
-	cmp = 1;
-
 	if( !str64.allowdup )
-	{
-		for( newString = str64.poldstringbase + 1;
-			newString < str64.plast && ( cmp = Q_strcmp( newString, szValue ) );
-			newString += Q_strlen( newString ) + 1 );
-	}
+		newString = SV_Str64FindHash( szValue, hash = SV_StringHash( szValue ));
 
-	if( cmp )
+	if( !newString )
 	{
 		uint len = SV_ProcessString( NULL, szValue );
 
@@ -3284,6 +3500,8 @@ string_t GAME_EXPORT SV_AllocString( const char *szValue )
 			str64.plast = str64.pstringbase + 1;
 			str64.poldstringbase = str64.pstringbase;
 			str64.numoverflows++;
+			SV_InvalidateEntityStringIndex();
+			SV_Str64ClearHash();
 		}
 
 		//MsgDev( D_NOTE, "SV_AllocString: %ld %s\n", str64.plast - svgame.globals->pStringBase, szValue );
@@ -3292,6 +3510,10 @@ string_t GAME_EXPORT SV_AllocString( const char *szValue )
 
 		newString = str64.plast;
 		str64.plast += len;
+
+		// stored string may differ after escape processing
+		if( !str64.allowdup )
+			SV_Str64InsertHash( newString, Q_strcmp( newString, szValue ) ? SV_StringHash( newString ) : hash );
 	}
 	else
 	{
@@ -5150,9 +5372,12 @@ void SV_UnloadProgs( void )
 
 	Mod_ResetStudioAPI ();
 
+	SV_ShutdownSphereEdicts();
+
 	COM_FreeLibrary( svgame.hInstance );
 	Mem_FreePool( &svgame.mempool );
 	memset( &svgame, 0, sizeof( svgame ));
+	memset( &sv_strindex, 0, sizeof( sv_strindex ));
 }
 
 qboolean SV_LoadProgs( const char *name )
@@ -5292,6 +5517,8 @@ qboolean SV_LoadProgs( const char *name )
 	svs.static_entities = Z_Calloc( sizeof( entity_state_t ) * MAX_STATIC_ENTITIES );
 	svs.baselines = Z_Calloc( sizeof( entity_state_t ) * GI->max_edicts );
 	svgame.numEntities = svs.maxclients + 1; // clients + world
+	SV_AllocEntityStringIndex();
+	SV_InitSphereEdicts();
 
 	for( i = 0, e = svgame.edicts; i < GI->max_edicts; i++, e++ )
 		e->free = true; // mark all edicts as freed
@@ -5315,3 +5542,129 @@ qboolean SV_LoadProgs( const char *name )
 
 	return true;
 }
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
+
+static int Test_FindEntityLinear( int e, const char *value )
+{
+	for( e++; e < svgame.numEntities; e++ )
+	{
+		edict_t *ed = EDICT_NUM( e );
+
+		if( ed->free || !ed->v.targetname )
+			continue;
+
+		if( !Q_strcmp( STRING( ed->v.targetname ), value ))
+			return e;
+	}
+
+	return 0;
+}
+
+void Test_RunEntityStrings( void )
+{
+	static edict_t edicts[256];
+	static char strings[32] = "\0door1\0door2\0light";
+	static char gamebuf[16] = "door2";
+	const char *names[] = { "door1", "door2", "light" };
+	string_t values[5];
+	gameinfo_t *oldgameinfo = GI, gameinfo = { 0 };
+	globalvars_t *oldglobals = svgame.globals, globals = { 0 };
+	poolhandle_t oldmempool = svgame.mempool;
+	edict_t *oldedicts = svgame.edicts;
+	int oldnumentities = svgame.numEntities;
+	int oldmaxclients = svs.maxclients;
+	int i, num = ARRAYSIZE( edicts );
+	qboolean swapped = false;
+#ifdef XASH_64BIT
+	char *oldstringarray = str64.pstringarray;
+	size_t oldmaxstringarray = str64.maxstringarray;
+
+	// strings array hashes are cached, game buffer isn't
+	str64.pstringarray = strings;
+	str64.maxstringarray = sizeof( strings ) / 2;
+#endif
+
+	gameinfo.max_edicts = num;
+	GI = &gameinfo;
+	globals.pStringBase = strings;
+	svgame.globals = &globals;
+	svgame.mempool = host.mempool;
+	svgame.edicts = edicts;
+	svgame.numEntities = num;
+	svs.maxclients = 0;
+	SV_AllocEntityStringIndex();
+
+	values[0] = 0;
+	values[1] = 1;
+	values[2] = 7;
+	values[3] = 13;
+	values[4] = gamebuf - strings;
+
+	COM_SetRandomSeed( 1337 );
+
+	for( i = 1; i < num; i++ )
+	{
+		edicts[i].free = COM_RandomLong( 0, 7 ) == 0;
+		edicts[i].v.targetname = values[COM_RandomLong( 0, 4 )];
+	}
+
+	for( i = 0; i < 1000; i++ )
+	{
+		const char *name = names[COM_RandomLong( 0, 2 )];
+		int e = 0;
+
+		// check the whole chain while game changes entities mid-frame
+		do
+		{
+			edict_t *ent = &edicts[COM_RandomLong( 1, num - 1 )];
+			int expected, result;
+
+			switch( COM_RandomLong( 0, 7 ))
+			{
+			case 0:
+				ent->v.targetname = values[COM_RandomLong( 0, 4 )];
+				break;
+			case 1:
+				Q_strncpy( gamebuf, names[COM_RandomLong( 0, 2 )], sizeof( gamebuf ));
+				break;
+			case 2:
+				ent->free = !ent->free;
+				break;
+			case 3:
+				// string array was reused
+				memcpy( strings + 1, swapped ? "door1" : "door2", 5 );
+				memcpy( strings + 7, swapped ? "door2" : "door1", 5 );
+				swapped = !swapped;
+				SV_InvalidateEntityStringIndex();
+				break;
+			}
+
+			expected = Test_FindEntityLinear( e, name );
+			result = NUM_FOR_EDICT( SV_FindEntityByString( EDICT_NUM( e ), "targetname", name ));
+
+			TASSERT_EQi( expected, result );
+			e = expected;
+		} while( e != 0 );
+	}
+
+	for( i = 0; i < SV_STRINDEX_FIELDS; i++ )
+	{
+		if( sv_strindex.hashes[i] )
+			Mem_Free( sv_strindex.hashes[i] );
+	}
+
+	memset( &sv_strindex, 0, sizeof( sv_strindex ));
+#ifdef XASH_64BIT
+	str64.pstringarray = oldstringarray;
+	str64.maxstringarray = oldmaxstringarray;
+#endif
+	svgame.edicts = oldedicts;
+	svgame.numEntities = oldnumentities;
+	svgame.mempool = oldmempool;
+	svgame.globals = oldglobals;
+	svs.maxclients = oldmaxclients;
+	GI = oldgameinfo;
+}
+#endif /* XASH_ENGINE_TESTS */
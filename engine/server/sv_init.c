@@ -93,6 +93,62 @@ static void SV_SendSingleResource( const char *name, resourcetype_t type, int in
 	SV_SendResource( pResource, &sv.reliable_datagram );
 }
 
+/*
+================
+SV_FindPrecache
+
+returns index of the already precached name or zero
+================
+*/
+int SV_FindPrecache( char (*names)[MAX_QPATH], const word *hash, const word *next, const char *name )
+{
+	int	i;
+
+	for( i = hash[COM_HashKey( name, PRECACHE_HASH_SIZE )]; i != 0; i = next[i] )
+	{
+		if( !Q_stricmp( names[i], name ))
+			return i;
+	}
+
+	return 0;
+}
+
+/*
+================
+SV_AddPrecache
+
+link the new name into hash
+================
+*/
+void SV_AddPrecache( char (*names)[MAX_QPATH], word *hash, word *next, int index )
+{
+	uint	key;
+
+	// linear search always returned the first one
+	if( SV_FindPrecache( names, hash, next, names[index] ))
+		return;
+
+	key = COM_HashKey( names[index], PRECACHE_HASH_SIZE );
+	next[index] = hash[key];
+	hash[key] = index;
+}
+
+/*
+================
+SV_FreePrecacheSlot
+
+precache arrays doesn't have holes, find first unused slot
+================
+*/
+static int SV_FreePrecacheSlot( char (*names)[MAX_QPATH], int maxnames )
+{
+	int	i;
+
+	for( i = 1; i < maxnames && names[i][0]; i++ );
+
+	return i;
+}
+
 /*
 ================
 SV_ModelIndex
@@ -113,11 +169,10 @@ int SV_ModelIndex( const char *filename )
 	Q_strncpy( name, filename, sizeof( name ));
 	COM_FixSlashes( name );
 
-	for( i = 1; i < MAX_MODELS && sv.model_precache[i][0]; i++ )
-	{
-		if( !Q_stricmp( sv.model_precache[i], name ))
-			return i;
-	}
+	if(( i = SV_FindPrecache( sv.model_precache, sv.model_hash, sv.model_hashnext, name )) != 0 )
+		return i;
+
+	i = SV_FreePrecacheSlot( sv.model_precache, MAX_MODELS );
 
 	if( i == MAX_MODELS )
 	{
@@ -127,6 +182,7 @@ int SV_ModelIndex( const char *filename )
 
 	// register new model
 	Q_strncpy( sv.model_precache[i], name, sizeof( sv.model_precache[i] ));
+	SV_AddPrecache( sv.model_precache, sv.model_hash, sv.model_hashnext, i );
 
 	if( sv.state != ss_loading )
 	{
@@ -164,11 +220,10 @@ int GAME_EXPORT SV_SoundIndex( const char *filename )
 	Q_strncpy( name, filename, sizeof( name ));
 	COM_FixSlashes( name );
 
-	for( i = 1; i < MAX_SOUNDS && sv.sound_precache[i][0]; i++ )
-	{
-		if( !Q_stricmp( sv.sound_precache[i], name ))
-			return i;
-	}
+	if(( i = SV_FindPrecache( sv.sound_precache, sv.sound_hash, sv.sound_hashnext, name )) != 0 )
+		return i;
+
+	i = SV_FreePrecacheSlot( sv.sound_precache, MAX_SOUNDS );
 
 	if( i == MAX_SOUNDS )
 	{
@@ -178,6 +233,7 @@ int GAME_EXPORT SV_SoundIndex( const char *filename )
 
 	// register new sound
 	Q_strncpy( sv.sound_precache[i], name, sizeof( sv.sound_precache[i] ));
+	SV_AddPrecache( sv.sound_precache, sv.sound_hash, sv.sound_hashnext, i );
 
 	if( sv.state != ss_loading )
 	{
@@ -207,11 +263,10 @@ int SV_EventIndex( const char *filename )
 	Q_strncpy( name, filename, sizeof( name ));
 	COM_FixSlashes( name );
 
-	for( i = 1; i < MAX_EVENTS && sv.event_precache[i][0]; i++ )
-	{
-		if( !Q_stricmp( sv.event_precache[i], name ))
-			return i;
-	}
+	if(( i = SV_FindPrecache( sv.event_precache, sv.event_hash, sv.event_hashnext, name )) != 0 )
+		return i;
+
+	i = SV_FreePrecacheSlot( sv.event_precache, MAX_EVENTS );
 
 	if( i == MAX_EVENTS )
 	{
@@ -221,6 +276,7 @@ int SV_EventIndex( const char *filename )
 
 	// register new event
 	Q_strncpy( sv.event_precache[i], name, sizeof( sv.event_precache[i] ));
+	SV_AddPrecache( sv.event_precache, sv.event_hash, sv.event_hashnext, i );
 
 	if( sv.state != ss_loading )
 	{
@@ -249,11 +305,10 @@ int GAME_EXPORT SV_GenericIndex( const char *filename )
 	Q_strncpy( name, filename, sizeof( name ));
 	COM_FixSlashes( name );
 
-	for( i = 1; i < MAX_CUSTOM && sv.files_precache[i][0]; i++ )
-	{
-		if( !Q_stricmp( sv.files_precache[i], name ))
-			return i;
-	}
+	if(( i = SV_FindPrecache( sv.files_precache, sv.files_hash, sv.files_hashnext, name )) != 0 )
+		return i;
+
+	i = SV_FreePrecacheSlot( sv.files_precache, MAX_CUSTOM );
 
 	if( i == MAX_CUSTOM )
 	{
@@ -263,6 +318,7 @@ int GAME_EXPORT SV_GenericIndex( const char *filename )
 
 	// register new generic resource
 	Q_strncpy( sv.files_precache[i], name, sizeof( sv.files_precache[i] ));
+	SV_AddPrecache( sv.files_precache, sv.files_hash, sv.files_hashnext, i );
 
 	if( sv.state != ss_loading )
 	{
@@ -678,6 +734,8 @@ void SV_ActivateServer( int runPhysics )
 	Host_SetServerState( ss_active );
 
 	Con_DPrintf( "level loaded at %.2f sec\n", Sys_DoubleTime() - svs.timestart );
+	Con_DPrintf( "%i file lookups, %i of them skipped searching for known missing files\n",
+		FI->lookups - svs.fslookups, FI->missingcached - svs.fsmissingcached );
 
 	if( sv.ignored_static_ents )
 		Con_Printf( S_WARN "%i static entities was rejected due buffer overflow\n", sv.ignored_static_ents );
@@ -723,6 +781,10 @@ void SV_DeactivateServer( void )
 		if( svs.clients[i].frames )
 			Mem_Free( svs.clients[i].frames );
 		svs.clients[i].frames = NULL;
+
+		if( svs.clients[i].unlag )
+			Mem_Free( svs.clients[i].unlag );
+		svs.clients[i].unlag = NULL;
 	}
 
 	svgame.globals->maxEntities = GI->max_edicts;
@@ -857,6 +919,10 @@ qboolean CRC32_MapFile( dword *crcvalue, const char *filename, qboolean multipla
 		return true;
 	}
 
+	// lumps of unchanged map are never hashed twice
+	if( FS_GetChecksum( filename, FS_CHECKSUM_MAPCRC, crcvalue, sizeof( *crcvalue )))
+		return true;
+
 	f = FS_Open( filename, "rb", false );
 	if( !f ) return false;
 
@@ -913,6 +979,7 @@ qboolean CRC32_MapFile( dword *crcvalue, const char *filename, qboolean multipla
 	}
 
 	FS_Close( f );
+	FS_SetChecksum( filename, FS_CHECKSUM_MAPCRC, crcvalue, sizeof( *crcvalue ));
 
 	return 1;
 }
@@ -1037,6 +1104,8 @@ qboolean SV_SpawnServer( const char *mapname, const char *startspot, qboolean ba
 	Log_PrintServerVars();
 
 	svs.timestart = Sys_DoubleTime();
+	svs.fslookups = FI->lookups;
+	svs.fsmissingcached = FI->missingcached;
 	svs.spawncount++; // any partially connected client will be restarted
 
 	cycle = Cvar_VariableString( "mapchangecfgfile" );
@@ -1119,6 +1188,7 @@ qboolean SV_SpawnServer( const char *mapname, const char *startspot, qboolean ba
 	else sv.startspot[0] = '\0';
 
 	Q_snprintf( sv.model_precache[WORLD_INDEX], sizeof( sv.model_precache[0] ), "maps/%s.bsp", sv.name );
+	SV_AddPrecache( sv.model_precache, sv.model_hash, sv.model_hashnext, WORLD_INDEX );
 	SetBits( sv.model_precache_flags[WORLD_INDEX], RES_FATALIFMISSING );
 	sv.worldmodel = sv.models[WORLD_INDEX] = Mod_LoadWorld( sv.model_precache[WORLD_INDEX], true );
 	CRC32_MapFile( &sv.worldmapCRC, sv.model_precache[WORLD_INDEX], svs.maxclients > 1 );
@@ -1134,6 +1204,7 @@ qboolean SV_SpawnServer( const char *mapname, const char *startspot, qboolean ba
 	for( i = WORLD_INDEX; i < sv.worldmodel->numsubmodels; i++ )
 	{
 		Q_snprintf( sv.model_precache[i+1], sizeof( sv.model_precache[i+1] ), "*%i", i );
+		SV_AddPrecache( sv.model_precache, sv.model_hash, sv.model_hashnext, i + 1 );
 		sv.models[i+1] = Mod_ForName( sv.model_precache[i+1], false, false );
 		SetBits( sv.model_precache_flags[i+1], RES_FATALIFMISSING );
 	}
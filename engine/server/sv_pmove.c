@@ -193,6 +193,147 @@ static void SV_GetTrueMinMax( sv_client_t *cl, int edictnum, vec3_t mins, vec3_t
 	}
 }
 
+/*
+====================
+player movement broadphase
+
+solid edicts around the player are collected once per frame for
+the region that also covers some movement, then every usercmd
+filters this list by it's own bounds. List is rebuilt when player
+leaves the region or order of edicts changes in the area nodes it
+covers. Only edicts are cached, physents are copied for every usercmd,
+so game code may change entity state between usercmds
+====================
+*/
+#define PM_SNAPSHOT_SLACK	128.0f	// movement allowed before the snapshot is rebuilt
+
+typedef struct
+{
+	edict_t	*ed;
+	int	node;
+} pmcandidate_t;
+
+typedef struct
+{
+	uint	framecount;
+	vec3_t	mins, maxs;
+	byte	visited[AREA_NODES];
+	uint	serials[AREA_NODES];
+	int	numcandidates;
+	int	maxcandidates;
+	pmcandidate_t	*candidates;
+} pmsnapshot_t;
+
+static pmsnapshot_t	sv_pmsnapshots[MAX_CLIENTS];
+
+/*
+====================
+SV_MarkPmoveNodes
+
+same node walk as in SV_AddLinksToPmove
+====================
+*/
+static void SV_MarkPmoveNodes( areanode_t *node, const vec3_t mins, const vec3_t maxs, byte *visited )
+{
+	visited[node - sv_areanodes] = true;
+
+	// recurse down both sides
+	if( node->axis == -1 ) return;
+
+	if( maxs[node->axis] > node->dist )
+		SV_MarkPmoveNodes( node->children[0], mins, maxs, visited );
+	if( mins[node->axis] < node->dist )
+		SV_MarkPmoveNodes( node->children[1], mins, maxs, visited );
+}
+
+/*
+====================
+SV_BuildPmoveSnapshot
+
+collect solid edicts in the node walk order
+====================
+*/
+static void SV_BuildPmoveSnapshot( pmsnapshot_t *snap, areanode_t *node )
+{
+	pmcandidate_t	*c;
+	edict_t		**solids;
+	int		i, numsolids;
+	int		num = node - sv_areanodes;
+
+	snap->serials[num] = SV_AreaNodeSerial( node );
+	solids = SV_AreaSolidEdicts( node, &numsolids );
+
+	for( i = 0; i < numsolids; i++ )
+	{
+		if( snap->numcandidates == snap->maxcandidates )
+		{
+			snap->maxcandidates = Q_max( 64, snap->maxcandidates * 2 );
+			snap->candidates = Mem_Realloc( host.mempool, snap->candidates, sizeof( *snap->candidates ) * snap->maxcandidates );
+		}
+
+		c = &snap->candidates[snap->numcandidates++];
+		c->ed = solids[i];
+		c->node = num;
+	}
+
+	// recurse down both sides
+	if( node->axis == -1 ) return;
+
+	if( snap->visited[node->children[0] - sv_areanodes] )
+		SV_BuildPmoveSnapshot( snap, node->children[0] );
+	if( snap->visited[node->children[1] - sv_areanodes] )
+		SV_BuildPmoveSnapshot( snap, node->children[1] );
+}
+
+/*
+====================
+SV_GetPmoveSnapshot
+
+returns snapshot that covers pmove bounds
+====================
+*/
+static pmsnapshot_t *SV_GetPmoveSnapshot( sv_client_t *cl, const vec3_t pmove_mins, const vec3_t pmove_maxs )
+{
+	pmsnapshot_t	*snap = &sv_pmsnapshots[cl - svs.clients];
+	qboolean		valid = false;
+	int		i;
+
+	if( snap->framecount == host.framecount )
+	{
+		valid = true;
+
+		for( i = 0; i < 3 && valid; i++ )
+		{
+			if( pmove_mins[i] < snap->mins[i] || pmove_maxs[i] > snap->maxs[i] )
+				valid = false;
+		}
+
+		for( i = 0; i < AREA_NODES && valid; i++ )
+		{
+			if( snap->visited[i] && snap->serials[i] != SV_AreaNodeSerial( &sv_areanodes[i] ))
+				valid = false;
+		}
+	}
+
+	if( valid )
+		return snap;
+
+	snap->framecount = host.framecount;
+	snap->numcandidates = 0;
+
+	for( i = 0; i < 3; i++ )
+	{
+		snap->mins[i] = pmove_mins[i] - PM_SNAPSHOT_SLACK;
+		snap->maxs[i] = pmove_maxs[i] + PM_SNAPSHOT_SLACK;
+	}
+
+	memset( snap->visited, 0, sizeof( snap->visited ));
+	SV_MarkPmoveNodes( sv_areanodes, snap->mins, snap->maxs, snap->visited );
+	SV_BuildPmoveSnapshot( snap, sv_areanodes );
+
+	return snap;
+}
+
 /*
 ====================
 SV_AddLinksToPmove
@@ -200,21 +341,29 @@ SV_AddLinksToPmove
 collect solid entities
 ====================
 */
-static void SV_AddLinksToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3_t pmove_maxs )
+static void SV_AddLinksToPmove( pmsnapshot_t *snap, const byte *visited, const vec3_t pmove_mins, const vec3_t pmove_maxs )
 {
-	link_t	*l, *next;
 	edict_t	*check, *pl;
+	pmcandidate_t	*c;
 	vec3_t	mins, maxs;
 	physent_t	*pe;
+	int	i;
 
 	pl = EDICT_NUM( svgame.pmove->player_index + 1 );
 	Assert( SV_IsValidEdict( pl ));
 
 	// touch linked edicts
-	for( l = node->solid_edicts.next; l != &node->solid_edicts; l = next )
+	for( i = 0; i < snap->numcandidates; i++ )
 	{
-		next = l->next;
-		check = EDICT_FROM_AREA( l );
+		c = &snap->candidates[i];
+		check = c->ed;
+
+		if( !visited[c->node] )
+			continue;
+
+		// was moved to another node or unlinked during this frame
+		if( SV_AreaEdictNode( check ) != c->node )
+			continue;
 
 		if( check->v.groupinfo != 0 )
 		{
@@ -277,14 +426,6 @@ static void SV_AddLinksToPmove( areanode_t *node, const vec3_t pmove_mins, const
 				svgame.pmove->numphysent++;
 		}
 	}
-
-	// recurse down both sides
-	if( node->axis == -1 ) return;
-
-	if( pmove_maxs[node->axis] > node->dist )
-		SV_AddLinksToPmove( node->children[0], pmove_mins, pmove_maxs );
-	if( pmove_mins[node->axis] < node->dist )
-		SV_AddLinksToPmove( node->children[1], pmove_mins, pmove_maxs );
 }
 
 /*
@@ -292,18 +433,22 @@ static void SV_AddLinksToPmove( areanode_t *node, const vec3_t pmove_mins, const
 SV_AddLaddersToPmove
 ====================
 */
-static void SV_AddLaddersToPmove( areanode_t *node, const vec3_t pmove_mins, const vec3_t pmove_maxs )
+static void SV_AddLaddersToPmove( pmsnapshot_t *snap, const byte *visited, const vec3_t pmove_mins, const vec3_t pmove_maxs )
 {
-	link_t	*l, *next;
 	edict_t	*check;
+	pmcandidate_t	*c;
 	model_t	*mod;
 	physent_t	*pe;
+	int	i;
 
 	// get ladder edicts
-	for( l = node->solid_edicts.next; l != &node->solid_edicts; l = next )
+	for( i = 0; i < snap->numcandidates; i++ )
 	{
-		next = l->next;
-		check = EDICT_FROM_AREA( l );
+		c = &snap->candidates[i];
+		check = c->ed;
+
+		if( !visited[c->node] || SV_AreaEdictNode( check ) != c->node )
+			continue;
 
 		if( check->v.solid != SOLID_NOT || check->v.skin != CONTENTS_LADDER )
 			continue;
@@ -324,14 +469,6 @@ static void SV_AddLaddersToPmove( areanode_t *node, const vec3_t pmove_mins, con
 		if( SV_CopyEdictToPhysEnt( pe, check ))
 			svgame.pmove->nummoveent++;
 	}
-
-	// recurse down both sides
-	if( node->axis == -1 ) return;
-
-	if( pmove_maxs[node->axis] > node->dist )
-		SV_AddLaddersToPmove( node->children[0], pmove_mins, pmove_maxs );
-	if( pmove_mins[node->axis] < node->dist )
-		SV_AddLaddersToPmove( node->children[1], pmove_mins, pmove_maxs );
 }
 
 static void GAME_EXPORT pfnParticle( const float *origin, int color, float life, int zpos, int zvel )
@@ -535,6 +672,8 @@ static void SV_SetupPMove( playermove_t *pmove, sv_client_t *cl, usercmd_t *ucmd
 {
 	vec3_t	absmin, absmax;
 	edict_t	*clent = cl->edict;
+	byte	visited[AREA_NODES];
+	pmsnapshot_t	*snap;
 	int	i;
 
 	svgame.globals->frametime = (ucmd->msec * 0.001f);
@@ -606,8 +745,12 @@ static void SV_SetupPMove( playermove_t *pmove, sv_client_t *cl, usercmd_t *ucmd
 	svgame.pmove->numphysent = 1;	// always have world
 	svgame.pmove->numvisent = 1;
 
-	SV_AddLinksToPmove( sv_areanodes, absmin, absmax );
-	SV_AddLaddersToPmove( sv_areanodes, absmin, absmax );
+	snap = SV_GetPmoveSnapshot( cl, absmin, absmax );
+	memset( visited, 0, sizeof( visited ));
+	SV_MarkPmoveNodes( sv_areanodes, absmin, absmax, visited );
+
+	SV_AddLinksToPmove( snap, visited, absmin, absmax );
+	SV_AddLaddersToPmove( snap, visited, absmin, absmax );
 }
 
 static void SV_FinishPMove( playermove_t *pmove, sv_client_t *cl )
@@ -677,40 +820,156 @@ static void SV_FinishPMove( playermove_t *pmove, sv_client_t *cl )
 	pmove->runfuncs = false;
 }
 
-static entity_state_t *SV_FindEntInPack( int index, client_frame_t *frame )
+static qboolean SV_UnlagCheckTeleport( vec3_t old_pos, vec3_t new_pos )
 {
-	entity_state_t	*state;
-	int		i;
+	int	i;
 
-	for( i = 0; i < frame->num_entities; i++ )
+	for( i = 0; i < 3; i++ )
 	{
-		state = &svs.packet_entities[(frame->first_entity+i)%svs.num_client_entities];
+		if( fabs( old_pos[i] - new_pos[i] ) > 64.0f )
+			return true;
+	}
+	return false;
+}
+
+/*
+===============================================================================
+
+	LAG COMPENSATION HISTORY
+
+	every client frame has a matching client_unlag_t with the players positions
+	that were sent in it. Unlag window always ends at the newest frame, so each
+	record also keeps the oldest sequence that still has to be inside the window
+	for the player to be discarded (dead, EF_NOINTERP or teleported between two
+	visible frames). Query is a single compare per player instead of walking
+	all the packet entities of every frame in the window
+===============================================================================
+*/
+/*
+===================
+SV_UnlagLinkRecord
+
+chain record with the previous one, record contents
+are preserved so stale frames are described as is
+===================
+*/
+static void SV_UnlagLinkRecord( sv_client_t *cl, int sequence )
+{
+	client_unlag_t	*rec = &cl->unlag[sequence & SV_UPDATE_MASK];
+	client_unlag_t	*prev = &cl->unlag[(sequence - 1) & SV_UPDATE_MASK];
+	qboolean		chained = ( prev->sequence == sequence - 1 );
+	client_unlag_t	*seen;
+	int		i, lastseen;
+
+	rec->sequence = sequence;
+
+	for( i = 0; i < MAX_CLIENTS; i++ )
+	{
+		rec->lastseen[i] = chained ? prev->lastseen[i] : 0;
+		rec->lastbreak[i] = chained ? prev->lastbreak[i] : 0;
+
+		if( !FBitSet( rec->present, BIT( i )))
+			continue;
+
+		lastseen = rec->lastseen[i] - 1;
+		rec->lastseen[i] = sequence + 1;
 
-		if( state->number == index )
-			return state;
+		if( FBitSet( rec->nointerp, BIT( i )))
+		{
+			rec->lastbreak[i] = sequence + 1;
+			continue;
+		}
+
+		// never was visible or too old to get into the window
+		if( lastseen < 0 || sequence - lastseen >= SV_UPDATE_BACKUP )
+			continue;
+
+		seen = &cl->unlag[lastseen & SV_UPDATE_MASK];
+
+		if( seen->sequence == lastseen && SV_UnlagCheckTeleport( seen->origin[i], rec->origin[i] ))
+			rec->lastbreak[i] = Q_max( rec->lastbreak[i], lastseen + 1 );
 	}
-	return NULL;
 }
 
-static qboolean SV_UnlagCheckTeleport( vec3_t old_pos, vec3_t new_pos )
+/*
+===================
+SV_UnlagCatchUp
+
+frames that were not rebuilt since last record
+still keep their old entities, relink them in order
+===================
+*/
+static void SV_UnlagCatchUp( sv_client_t *cl, int sequence )
 {
 	int	i;
 
-	for( i = 0; i < 3; i++ )
+	if( sequence <= cl->unlag_sequence )
+		return;
+
+	i = Q_max( cl->unlag_sequence + 1, sequence - ( SV_UPDATE_BACKUP - 1 ));
+
+	for( ; i <= sequence; i++ )
+		SV_UnlagLinkRecord( cl, i );
+
+	cl->unlag_sequence = sequence;
+}
+
+/*
+===================
+SV_RecordUnlagFrame
+
+save players positions from freshly built frame
+===================
+*/
+void SV_RecordUnlagFrame( sv_client_t *cl, client_frame_t *frame )
+{
+	int		i, sequence = cl->netchan.outgoing_sequence;
+	client_unlag_t	*rec;
+	entity_state_t	*state;
+	int		clientnum;
+
+	if( !cl->unlag )
+		return;
+
+	SV_UnlagCatchUp( cl, sequence - 1 );
+
+	rec = &cl->unlag[sequence & SV_UPDATE_MASK];
+	rec->present = rec->nointerp = 0;
+
+	// entities are sorted by number, players goes first
+	for( i = 0; i < frame->num_entities; i++ )
 	{
-		if( fabs( old_pos[i] - new_pos[i] ) > 64.0f )
-			return true;
+		state = &svs.packet_entities[(frame->first_entity+i)%svs.num_client_entities];
+
+		if( state->number < 1 )
+			continue;
+
+		if( state->number > svs.maxclients )
+			break;
+
+		clientnum = state->number - 1;
+
+		if( FBitSet( rec->present, BIT( clientnum )))
+			continue;
+
+		SetBits( rec->present, BIT( clientnum ));
+		VectorCopy( state->origin, rec->origin[clientnum] );
+
+		if( state->health <= 0 || FBitSet( state->effects, EF_NOINTERP ))
+			SetBits( rec->nointerp, BIT( clientnum ));
 	}
-	return false;
+
+	SV_UnlagLinkRecord( cl, sequence );
+	cl->unlag_sequence = sequence;
 }
 
 static void SV_SetupMoveInterpolant( sv_client_t *cl )
 {
-	int		i, j, clientnum;
+	int		i, sequence, oldest;
 	float		finalpush, lerp_msec;
 	float		latency, lerpFrac;
 	client_frame_t	*frame, *frame2;
-	entity_state_t	*state, *lerpstate;
+	client_unlag_t	*rec, *rec2, *last;
 	vec3_t		curpos, newpos;
 	sv_client_t	*check;
 	sv_interp_t	*lerp;
@@ -718,7 +977,7 @@ static void SV_SetupMoveInterpolant( sv_client_t *cl )
 	memset( svgame.interp, 0, sizeof( svgame.interp ));
 	has_update = false;
 
-	if( !SV_ShouldUnlagForPlayer( cl ))
+	if( !SV_ShouldUnlagForPlayer( cl ) || !cl->unlag )
 		return;
 
 	has_update = true;
@@ -754,34 +1013,12 @@ static void SV_SetupMoveInterpolant( sv_client_t *cl )
 	finalpush = ( host.realtime - latency - lerp_msec ) + sv_unlagpush.value;
 	if( finalpush > host.realtime ) finalpush = host.realtime; // pushed too much ?
 
+	sequence = cl->netchan.outgoing_sequence - 1;
 	frame = frame2 = NULL;
 
 	for( i = 0; i < SV_UPDATE_BACKUP; i++, frame2 = frame )
 	{
-		frame = &cl->frames[(cl->netchan.outgoing_sequence - (i + 1)) & SV_UPDATE_MASK];
-
-		for( j = 0; j < frame->num_entities; j++ )
-		{
-			state = &svs.packet_entities[(frame->first_entity+j)%svs.num_client_entities];
-
-			if( state->number < 1 || state->number > svs.maxclients )
-				continue;
-
-			lerp = &svgame.interp[state->number-1];
-			if( lerp->nointerp ) continue;
-
-			if( state->health <= 0 || FBitSet( state->effects, EF_NOINTERP ))
-				lerp->nointerp = true;
-
-			if( lerp->firstframe )
-			{
-				if( SV_UnlagCheckTeleport( state->origin, lerp->finalpos ))
-					lerp->nointerp = true;
-			}
-			else lerp->firstframe = true;
-
-			VectorCopy( state->origin, lerp->finalpos );
-		}
+		frame = &cl->frames[(sequence - i) & SV_UPDATE_MASK];
 
 		if( finalpush > frame->senttime )
 			break;
@@ -794,13 +1031,22 @@ static void SV_SetupMoveInterpolant( sv_client_t *cl )
 		return;
 	}
 
+	SV_UnlagCatchUp( cl, sequence );
+
+	oldest = sequence - i;
+	last = &cl->unlag[sequence & SV_UPDATE_MASK];
+	rec = &cl->unlag[oldest & SV_UPDATE_MASK];
+
 	if( !frame2 )
 	{
 		frame2 = frame;
+		rec2 = rec;
 		lerpFrac = 0;
 	}
 	else
 	{
+		rec2 = &cl->unlag[(oldest + 1) & SV_UPDATE_MASK];
+
 		if( frame2->senttime - frame->senttime == 0.0 )
 		{
 			lerpFrac = 0;
@@ -812,34 +1058,33 @@ static void SV_SetupMoveInterpolant( sv_client_t *cl )
 		}
 	}
 
-	for( i = 0; i < frame->num_entities; i++ )
+	for( i = 0; i < svs.maxclients; i++ )
 	{
-		state = &svs.packet_entities[(frame->first_entity+i)%svs.num_client_entities];
+		lerp = &svgame.interp[i];
+
+		// something in the window doesn't allow to unlag this player
+		if( last->lastbreak[i] > oldest )
+			lerp->nointerp = true;
 
-		if( state->number < 1 || state->number > svs.maxclients )
+		if( !FBitSet( rec->present, BIT( i )))
 			continue;
 
-		clientnum = state->number - 1;
-		check = &svs.clients[clientnum];
+		check = &svs.clients[i];
 
 		if( check->state != cs_spawned || check == cl )
 			continue;
 
-		lerp = &svgame.interp[clientnum];
-
 		if( !lerp->active || lerp->nointerp )
 			continue;
 
-		lerpstate = SV_FindEntInPack( state->number, frame2 );
-
-		if( !lerpstate )
+		if( !FBitSet( rec2->present, BIT( i )))
 		{
-			VectorCopy( state->origin, curpos );
+			VectorCopy( rec->origin[i], curpos );
 		}
 		else
 		{
-			VectorSubtract( lerpstate->origin, state->origin, newpos );
-			VectorMA( state->origin, lerpFrac, newpos, curpos );
+			VectorSubtract( rec2->origin[i], rec->origin[i], newpos );
+			VectorMA( rec->origin[i], lerpFrac, newpos, curpos );
 		}
 
 		VectorCopy( curpos, lerp->curpos );
@@ -1644,6 +1644,9 @@ static int LoadGameState( char const *level, qboolean changelevel )
 			{
 				// force the entity to be relinked
 //				SV_LinkEdict( pent, false );
+
+				// absbox could be restored without relinking
+				SV_LinkSphereEdict( pent );
 			}
 		}
 	}
@@ -1841,6 +1844,7 @@ static int CreateEntityTransitionList( SAVERESTOREDATA *pSaveData, int levelMask
 				// a matching entity, not be spawned
 				if( svgame.dllFuncs.pfnRestore( pent, pSaveData, 1 ) > 0 )
 				{
+					SV_LinkSphereEdict( pent );
 					movedCount++;
 				}
 				else
@@ -1869,6 +1873,7 @@ static int CreateEntityTransitionList( SAVERESTOREDATA *pSaveData, int levelMask
 					}
 					else
 					{
+						SV_LinkSphereEdict( pent );
 						pTable->flags = FENTTABLE_REMOVED;
 						movedCount++;
 					}
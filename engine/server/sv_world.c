@@ -32,6 +32,8 @@ typedef struct moveclip_s
 	qboolean		monsterclip;
 } moveclip_t;
 
+static void SV_ClearLightCache( void );
+
 /*
 ===============================================================================
 
@@ -408,6 +410,335 @@ static void InsertLinkBefore( link_t *l, link_t *before )
 /*
 ===============================================================================
 
+ENTITY SPHERE QUERIES
+
+sv_areanodes only keeps entities that can collide, but FindEntityInSphere
+have to see every edict. So all valid edicts are linked into a separate
+tree by their absbox, which is only changed by pfnSetAbsBox in SV_LinkEdict
+
+===============================================================================
+*/
+#define SPHERE_NODES	64
+#define SPHERE_DEPTH	5
+
+typedef struct spherenode_s
+{
+	int		axis;	// -1 = leaf node
+	float		dist;
+	struct spherenode_s	*children[2];
+	link_t		edicts;
+} spherenode_t;
+
+static spherenode_t	sv_spherenodes[SPHERE_NODES];
+static int	sv_numspherenodes;
+static link_t	*sv_spherelinks;	// [GI->max_edicts], not linked if prev is NULL
+static int	sv_numspherelinks;
+
+/*
+===============
+SV_CreateSphereNode
+
+===============
+*/
+static spherenode_t *SV_CreateSphereNode( int depth, const vec3_t mins, const vec3_t maxs )
+{
+	spherenode_t	*node;
+	vec3_t		size;
+	vec3_t		mins1, maxs1;
+	vec3_t		mins2, maxs2;
+
+	node = &sv_spherenodes[sv_numspherenodes++];
+	ClearLink( &node->edicts );
+
+	if( depth == SPHERE_DEPTH )
+	{
+		node->axis = -1;
+		node->children[0] = node->children[1] = NULL;
+		return node;
+	}
+
+	VectorSubtract( maxs, mins, size );
+	if( size[0] > size[1] )
+		node->axis = 0;
+	else node->axis = 1;
+
+	node->dist = 0.5f * ( maxs[node->axis] + mins[node->axis] );
+	VectorCopy( mins, mins1 );
+	VectorCopy( mins, mins2 );
+	VectorCopy( maxs, maxs1 );
+	VectorCopy( maxs, maxs2 );
+
+	maxs1[node->axis] = mins2[node->axis] = node->dist;
+	node->children[0] = SV_CreateSphereNode( depth + 1, mins2, maxs2 );
+	node->children[1] = SV_CreateSphereNode( depth + 1, mins1, maxs1 );
+
+	return node;
+}
+
+/*
+===============
+SV_LinkSphereEdict
+
+(re)link edict with it's current absbox
+===============
+*/
+void SV_LinkSphereEdict( edict_t *ent )
+{
+	spherenode_t	*node;
+	link_t		*l;
+	int		e;
+
+	if( !sv_numspherenodes )
+		return;
+
+	e = NUM_FOR_EDICT( ent );
+	if( e <= 0 || e >= sv_numspherelinks )
+		return; // never add the world
+
+	l = &sv_spherelinks[e];
+	if( l->prev ) RemoveLink( l );
+
+	node = sv_spherenodes;
+
+	while( node->axis != -1 )
+	{
+		if( ent->v.absmin[node->axis] > node->dist )
+			node = node->children[0];
+		else if( ent->v.absmax[node->axis] < node->dist )
+			node = node->children[1];
+		else break; // crosses the node
+	}
+
+	InsertLinkBefore( l, &node->edicts );
+}
+
+/*
+===============
+SV_ClearSphereTree
+
+rebuild the tree for given bounds and relink all the edicts
+===============
+*/
+static void SV_ClearSphereTree( const vec3_t mins, const vec3_t maxs )
+{
+	int	i;
+
+	sv_numspherenodes = 0;
+	memset( sv_spherenodes, 0, sizeof( sv_spherenodes ));
+
+	if( !sv_spherelinks )
+		return;
+
+	memset( sv_spherelinks, 0, sizeof( *sv_spherelinks ) * sv_numspherelinks );
+	SV_CreateSphereNode( 0, mins, maxs );
+
+	for( i = 1; i < svgame.numEntities && i < sv_numspherelinks; i++ )
+	{
+		edict_t *ent = svgame.edicts + i;
+
+		if( SV_IsValidEdict( ent ))
+			SV_LinkSphereEdict( ent );
+	}
+}
+
+/*
+===============
+SV_InitSphereEdicts
+
+called after server edicts was allocated
+===============
+*/
+void SV_InitSphereEdicts( void )
+{
+	sv_numspherenodes = 0;
+	sv_numspherelinks = GI->max_edicts;
+	sv_spherelinks = Mem_Calloc( svgame.mempool, sizeof( *sv_spherelinks ) * sv_numspherelinks );
+}
+
+/*
+===============
+SV_ShutdownSphereEdicts
+
+called before server edicts are freed
+===============
+*/
+void SV_ShutdownSphereEdicts( void )
+{
+	if( sv_spherelinks )
+		Mem_Free( sv_spherelinks );
+	sv_spherelinks = NULL;
+	sv_numspherelinks = 0;
+	sv_numspherenodes = 0;
+}
+
+/*
+===============
+SV_EdictInSphere
+
+exact copy of the old linear test, don't change it
+===============
+*/
+static qboolean SV_EdictInSphere( const edict_t *ent, const float *org, float radiusSquared )
+{
+	float	distSquared = 0.0f;
+	float	eorg;
+	int	j;
+
+	for( j = 0; j < 3 && distSquared <= radiusSquared; j++ )
+	{
+		if( org[j] < ent->v.absmin[j] )
+			eorg = org[j] - ent->v.absmin[j];
+		else if( org[j] > ent->v.absmax[j] )
+			eorg = org[j] - ent->v.absmax[j];
+		else eorg = 0.0f;
+
+		distSquared += eorg * eorg;
+	}
+
+	return distSquared < radiusSquared;
+}
+
+/*
+===============
+SV_IsSphereCandidate
+
+===============
+*/
+static qboolean SV_IsSphereCandidate( int e )
+{
+	edict_t	*ent = svgame.edicts + e;
+
+	if( !SV_IsValidEdict( ent ))
+		return false;
+
+	// ignore clients that not in a game
+	if( e <= svs.maxclients && !SV_ClientFromEdict( ent, true ))
+		return false;
+
+	return true;
+}
+
+/*
+===============
+SV_SphereIsFinite
+
+NaN or infinite values can't be used to walk the tree
+===============
+*/
+static qboolean SV_SphereIsFinite( const float *org, float radius )
+{
+	// x - x is NaN for both NaN and infinity
+	return !IS_NAN( org[0] - org[0] ) && !IS_NAN( org[1] - org[1] )
+		&& !IS_NAN( org[2] - org[2] ) && !IS_NAN( radius - radius );
+}
+
+typedef struct sphereclip_s
+{
+	vec3_t		mins, maxs;	// enclose the sphere
+	const float	*org;
+	float		radiusSquared;
+	int		start;
+	int		best;	// lowest matching edict number
+} sphereclip_t;
+
+/*
+===============
+SV_SphereLinks
+
+===============
+*/
+static void SV_SphereLinks( spherenode_t *node, sphereclip_t *clip )
+{
+	link_t	*l;
+
+	for( l = node->edicts.next; l != &node->edicts; l = l->next )
+	{
+		int e = l - sv_spherelinks;
+
+		if( e <= clip->start || e >= clip->best )
+			continue;
+
+		if( !SV_IsSphereCandidate( e ))
+			continue;
+
+		if( SV_EdictInSphere( svgame.edicts + e, clip->org, clip->radiusSquared ))
+			clip->best = e;
+	}
+
+	// recurse down both sides
+	if( node->axis == -1 ) return;
+
+	if( clip->maxs[node->axis] >= node->dist )
+		SV_SphereLinks( node->children[0], clip );
+	if( clip->mins[node->axis] <= node->dist )
+		SV_SphereLinks( node->children[1], clip );
+}
+
+/*
+===============
+SV_FindEntityInSphereLinear
+
+reference implementation, walk all the edicts
+===============
+*/
+static int SV_FindEntityInSphereLinear( int start, const float *org, float radiusSquared )
+{
+	int	e;
+
+	for( e = start + 1; e < svgame.numEntities; e++ )
+	{
+		if( !SV_IsSphereCandidate( e ))
+			continue;
+
+		if( SV_EdictInSphere( svgame.edicts + e, org, radiusSquared ))
+			return e;
+	}
+
+	return 0;
+}
+
+/*
+===============
+SV_FindEntityInSphere
+
+returns number of the first edict after start that touches the sphere
+or zero if nothing was found, edicts order is same as linear search
+===============
+*/
+int SV_FindEntityInSphere( int start, const float *org, float flRadius )
+{
+	sphereclip_t	clip;
+	float		radius;
+	int		i;
+
+	radius = fabs( flRadius );
+
+	if( !sv_numspherenodes || svgame.numEntities > sv_numspherelinks || !SV_SphereIsFinite( org, radius ))
+		return SV_FindEntityInSphereLinear( start, org, flRadius * flRadius );
+
+	// grow the box a bit so float rounding can't cut off anything
+	for( i = 0; i < 3; i++ )
+	{
+		clip.mins[i] = org[i] - radius - 1.0f;
+		clip.maxs[i] = org[i] + radius + 1.0f;
+	}
+
+	clip.org = org;
+	clip.radiusSquared = flRadius * flRadius;
+	clip.start = start;
+	clip.best = svgame.numEntities;
+
+	SV_SphereLinks( sv_spherenodes, &clip );
+
+	if( clip.best == svgame.numEntities )
+		return 0;
+
+	return clip.best;
+}
+
+/*
+===============================================================================
+
 ENTITY AREA CHECKING
 
 ===============================================================================
@@ -416,6 +747,20 @@ static int	iTouchLinkSemaphore = 0;	// prevent recursion when SV_TouchLinks is a
 areanode_t	sv_areanodes[AREA_NODES];
 static int	sv_numareanodes;
 
+// solid edicts of every areanode as a flat array, so player movement
+// doesn't walk the links again for every usercmd while nothing is relinked
+typedef struct
+{
+	qboolean	valid;
+	int	numedicts;
+	int	maxedicts;
+	edict_t	**edicts;
+} areacache_t;
+
+static areacache_t	sv_areacache[AREA_NODES];
+static byte	sv_areaedictnode[MAX_EDICTS];	// areanode + 1 for edicts linked to solid_edicts
+static uint	sv_areaserial[AREA_NODES];	// changed when order of solid_edicts changes
+
 /*
 ===============
 SV_CreateAreaNode
@@ -481,10 +826,84 @@ void SV_ClearWorld( void )
 	}
 
 	memset( sv_areanodes, 0, sizeof( sv_areanodes ));
+	memset( sv_areaedictnode, 0, sizeof( sv_areaedictnode ));
 	iTouchLinkSemaphore = 0;
 	sv_numareanodes = 0;
 
+	for( i = 0; i < AREA_NODES; i++ )
+	{
+		sv_areacache[i].valid = false;
+		sv_areaserial[i]++;
+	}
+
 	SV_CreateAreaNode( 0, sv.worldmodel->mins, sv.worldmodel->maxs );
+	SV_ClearSphereTree( sv.worldmodel->mins, sv.worldmodel->maxs );
+	SV_ClearLightCache();
+}
+
+/*
+===============
+SV_AreaSolidEdicts
+
+returns solid edicts linked to the node in the list order,
+array is valid until something is linked or unlinked here
+===============
+*/
+edict_t **SV_AreaSolidEdicts( areanode_t *node, int *numedicts )
+{
+	areacache_t	*cache = &sv_areacache[node - sv_areanodes];
+	link_t		*l;
+
+	if( !cache->valid )
+	{
+		cache->numedicts = 0;
+
+		for( l = node->solid_edicts.next; l != &node->solid_edicts; l = l->next )
+		{
+			if( cache->numedicts == cache->maxedicts )
+			{
+				cache->maxedicts = Q_max( 64, cache->maxedicts * 2 );
+				cache->edicts = Mem_Realloc( host.mempool, cache->edicts, sizeof( *cache->edicts ) * cache->maxedicts );
+			}
+
+			cache->edicts[cache->numedicts++] = EDICT_FROM_AREA( l );
+		}
+
+		cache->valid = true;
+	}
+
+	*numedicts = cache->numedicts;
+	return cache->edicts;
+}
+
+/*
+===============
+SV_AreaEdictNode
+
+returns areanode number where edict is linked into solid_edicts or -1
+===============
+*/
+int SV_AreaEdictNode( const edict_t *ent )
+{
+	int	e = ent - svgame.edicts;
+
+	if( e < 0 || e >= MAX_EDICTS )
+		return -1;
+
+	return sv_areaedictnode[e] - 1;
+}
+
+/*
+===============
+SV_AreaNodeSerial
+
+changes when new edict appears in node's solid_edicts or
+when relinked edict moves to the end of the list
+===============
+*/
+uint SV_AreaNodeSerial( const areanode_t *node )
+{
+	return sv_areaserial[node - sv_areanodes];
 }
 
 /*
@@ -494,9 +913,17 @@ SV_UnlinkEdict
 */
 void SV_UnlinkEdict( edict_t *ent )
 {
+	int	e = ent - svgame.edicts;
+
 	// not linked in anywhere
 	if( !ent->area.prev ) return;
 
+	if( e >= 0 && e < MAX_EDICTS && sv_areaedictnode[e] )
+	{
+		sv_areacache[sv_areaedictnode[e] - 1].valid = false;
+		sv_areaedictnode[e] = 0;
+	}
+
 	RemoveLink( &ent->area );
 	ent->area.prev = NULL;
 	ent->area.next = NULL;
@@ -640,6 +1067,12 @@ void GAME_EXPORT SV_LinkEdict( edict_t *ent, qboolean touch_triggers )
 {
 	areanode_t	*node;
 	int		headnode;
+	int		e = ent - svgame.edicts;
+	int		oldnode = SV_AreaEdictNode( ent );
+	qboolean		wastail;
+
+	// relinking the last edict into the same node keeps the order
+	wastail = oldnode >= 0 && ent->area.next == &sv_areanodes[oldnode].solid_edicts;
 
 	if( ent->area.prev ) SV_UnlinkEdict( ent );	// unlink from old position
 	if( ent == svgame.edicts ) return;		// don't add the world
@@ -647,6 +1080,7 @@ void GAME_EXPORT SV_LinkEdict( edict_t *ent, qboolean touch_triggers )
 
 	// set the abs box
 	svgame.dllFuncs.pfnSetAbsBox( ent );
+	SV_LinkSphereEdict( ent );
 
 	if( ent->v.movetype == MOVETYPE_FOLLOW && SV_IsValidEdict( ent->v.aiment ))
 	{
@@ -694,7 +1128,19 @@ void GAME_EXPORT SV_LinkEdict( edict_t *ent, qboolean touch_triggers )
 		InsertLinkBefore( &ent->area, &node->trigger_edicts );
 	else if( ent->v.solid == SOLID_PORTAL )
 		InsertLinkBefore( &ent->area, &node->portal_edicts );
-	else InsertLinkBefore( &ent->area, &node->solid_edicts );
+	else
+	{
+		InsertLinkBefore( &ent->area, &node->solid_edicts );
+
+		if( e >= 0 && e < MAX_EDICTS )
+		{
+			sv_areaedictnode[e] = ( node - sv_areanodes ) + 1;
+			sv_areacache[node - sv_areanodes].valid = false;
+
+			if( oldnode != node - sv_areanodes || !wastail )
+				sv_areaserial[node - sv_areanodes]++;
+		}
+	}
 
 	if( touch_triggers && !iTouchLinkSemaphore )
 	{
@@ -1508,7 +1954,22 @@ trace_t SV_MoveToss( edict_t *tossent, edict_t *ignore )
 ===============================================================================
 */
 
-static vec3_t	sv_pointColor;
+#define LIGHTCACHE_SIZE	1024	// must be power of two
+
+// where the light trace hits the world, lightstyles are applied at query time
+// so cached entries are still valid after lightstyles animation
+typedef struct
+{
+	qboolean		valid;
+	qboolean		invlight;
+	vec3_t		origin;
+	msurface_t	*surf;		// NULL if nothing was hit
+	int		sample;		// offset in surf->samples
+} lightcache_t;
+
+static lightcache_t	sv_lightcache[LIGHTCACHE_SIZE];
+static msurface_t	*sv_lightsurf;
+static int	sv_lightsample;
 
 /*
 =================
@@ -1517,13 +1978,12 @@ SV_RecursiveLightPoint
 */
 static qboolean SV_RecursiveLightPoint( model_t *model, mnode_t *node, const vec3_t start, const vec3_t end )
 {
-	float		front, back, scale, frac;
-	int		i, map, side, size;
+	float		front, back, frac;
+	int		i, side;
 	float		ds, dt, s, t;
 	int		sample_size;
 	msurface_t	*surf;
 	mextrasurf_t	*info;
-	color24		*lm;
 	vec3_t		mid;
 
 	// didn't hit anything
@@ -1554,7 +2014,7 @@ static qboolean SV_RecursiveLightPoint( model_t *model, mnode_t *node, const vec
 
 	for( i = 0; i < node->numsurfaces; i++, surf++ )
 	{
-		int	smax, tmax;
+		int	smax;
 
 		info = surf->info;
 
@@ -1573,35 +2033,72 @@ static qboolean SV_RecursiveLightPoint( model_t *model, mnode_t *node, const vec
 		if ( ds > info->lightextents[0] || dt > info->lightextents[1] )
 			continue;
 
+		sv_lightsurf = surf;
+
 		if( !surf->samples )
 			return true;
 
 		sample_size = Mod_SampleSizeForFace( surf );
 		smax = (info->lightextents[0] / sample_size) + 1;
-		tmax = (info->lightextents[1] / sample_size) + 1;
 		ds /= sample_size;
 		dt /= sample_size;
 
-		VectorClear( sv_pointColor );
+		sv_lightsample = Q_rint( dt ) * smax + Q_rint( ds );
+		return true;
+	}
 
-		lm = surf->samples + Q_rint( dt ) * smax + Q_rint( ds );
-		size = smax * tmax;
+	// go down back side
+	return SV_RecursiveLightPoint( model, node->children[!side], mid, end );
+}
 
-		for( map = 0; map < MAXLIGHTMAPS && surf->styles[map] != 255; map++ )
-		{
-			scale = sv.lightstyles[surf->styles[map]].value;
+/*
+=================
+SV_LightPointColor
 
-			sv_pointColor[0] += lm->r * scale;
-			sv_pointColor[1] += lm->g * scale;
-			sv_pointColor[2] += lm->b * scale;
+apply current lightstyles to the lightmap sample
+=================
+*/
+static void SV_LightPointColor( const msurface_t *surf, int sample, vec3_t color )
+{
+	int		map, size, sample_size;
+	mextrasurf_t	*info;
+	color24		*lm;
+	float		scale;
 
-			lm += size; // skip to next lightmap
-		}
-		return true;
+	VectorSet( color, 1.0f, 1.0f, 1.0f );
+
+	if( !surf || !surf->samples )
+		return;
+
+	info = surf->info;
+	sample_size = Mod_SampleSizeForFace( surf );
+	size = ((info->lightextents[0] / sample_size) + 1) * ((info->lightextents[1] / sample_size) + 1);
+	lm = surf->samples + sample;
+
+	VectorClear( color );
+
+	for( map = 0; map < MAXLIGHTMAPS && surf->styles[map] != 255; map++ )
+	{
+		scale = sv.lightstyles[surf->styles[map]].value;
+
+		color[0] += lm->r * scale;
+		color[1] += lm->g * scale;
+		color[2] += lm->b * scale;
+
+		lm += size; // skip to next lightmap
 	}
+}
 
-	// go down back side
-	return SV_RecursiveLightPoint( model, node->children[!side], mid, end );
+/*
+=================
+SV_ClearLightCache
+
+called when world is changed
+=================
+*/
+static void SV_ClearLightCache( void )
+{
+	memset( sv_lightcache, 0, sizeof( sv_lightcache ));
 }
 
 /*
@@ -1642,7 +2139,11 @@ grab the ambient lighting color for current point
 */
 int SV_LightForEntity( edict_t *pEdict )
 {
-	vec3_t	start, end;
+	vec3_t		start, end, color;
+	lightcache_t	*cache;
+	qboolean		invlight;
+	uint		hash;
+	int		i;
 
 	if( FBitSet( pEdict->v.effects, EF_FULLBRIGHT ) || !sv.worldmodel->lightdata )
 		return 255;
@@ -1651,15 +2152,138 @@ int SV_LightForEntity( edict_t *pEdict )
 	if( FBitSet( pEdict->v.flags, FL_CLIENT ))
 		return pEdict->v.light_level;
 
-	VectorCopy( pEdict->v.origin, start );
-	VectorCopy( pEdict->v.origin, end );
+	invlight = FBitSet( pEdict->v.effects, EF_INVLIGHT ) ? true : false;
+
+	// same point always hits the same lightmap sample
+	for( i = 0, hash = invlight; i < 3; i++ )
+	{
+		uint	bits;
+
+		memcpy( &bits, &pEdict->v.origin[i], sizeof( bits ));
+		hash = ( hash ^ bits ) * 16777619u;
+	}
+
+	cache = &sv_lightcache[( hash ^ ( hash >> 16 )) & ( LIGHTCACHE_SIZE - 1 )];
+
+	if( !cache->valid || cache->invlight != invlight || !VectorCompare( cache->origin, pEdict->v.origin ))
+	{
+		VectorCopy( pEdict->v.origin, start );
+		VectorCopy( pEdict->v.origin, end );
+
+		if( invlight )
+			end[2] = start[2] + world.size[2];
+		else end[2] = start[2] - world.size[2];
+
+		sv_lightsurf = NULL;
+		sv_lightsample = 0;
+
+		SV_RecursiveLightPoint( sv.worldmodel, sv.worldmodel->nodes, start, end );
+
+		cache->valid = true;
+		cache->invlight = invlight;
+		VectorCopy( pEdict->v.origin, cache->origin );
+		cache->surf = sv_lightsurf;
+		cache->sample = sv_lightsample;
+	}
+
+	SV_LightPointColor( cache->surf, cache->sample, color );
+
+	return VectorAvg( color );
+}
+
+#if XASH_ENGINE_TESTS
+#include "tests.h"
 
-	if( FBitSet( pEdict->v.effects, EF_INVLIGHT ))
-		end[2] = start[2] + world.size[2];
-	else end[2] = start[2] - world.size[2];
-	VectorSet( sv_pointColor, 1.0f, 1.0f, 1.0f );
+static void Test_RandomSphereEdict( edict_t *ent )
+{
+	float size = COM_RandomLong( 0, 7 ) ? COM_RandomFloat( 0.0f, 128.0f ) : COM_RandomFloat( 512.0f, 4096.0f );
+	int i;
+
+	for( i = 0; i < 3; i++ )
+	{
+		ent->v.absmin[i] = COM_RandomFloat( -4096.0f, 4096.0f );
+		ent->v.absmax[i] = ent->v.absmin[i] + size;
+	}
+}
 
-	SV_RecursiveLightPoint( sv.worldmodel, sv.worldmodel->nodes, start, end );
+void Test_RunSphereTree( void )
+{
+	static edict_t edicts[512];
+	gameinfo_t *oldgameinfo = GI, gameinfo = { 0 };
+	edict_t *oldedicts = svgame.edicts;
+	int oldnumentities = svgame.numEntities;
+	int oldmaxclients = svs.maxclients;
+	link_t *oldlinks = sv_spherelinks;
+	int oldnumlinks = sv_numspherelinks;
+	vec3_t mins = { -4096.0f, -4096.0f, -4096.0f };
+	vec3_t maxs = { 4096.0f, 4096.0f, 4096.0f };
+	int i, j, num = ARRAYSIZE( edicts );
+
+	// edict checks need max_edicts, but there is may be no game yet
+	gameinfo.max_edicts = num;
+	GI = &gameinfo;
+	svgame.edicts = edicts;
+	svgame.numEntities = num;
+	svs.maxclients = 0;
+	sv_numspherelinks = num;
+	sv_spherelinks = Mem_Calloc( host.mempool, sizeof( *sv_spherelinks ) * num );
+
+	COM_SetRandomSeed( 1337 );
+
+	for( i = 0; i < num; i++ )
+	{
+		edicts[i].free = COM_RandomLong( 0, 7 ) == 0;
+		Test_RandomSphereEdict( &edicts[i] );
+	}
+
+	SV_ClearSphereTree( mins, maxs );
+
+	for( i = 0; i < 2000; i++ )
+	{
+		edict_t *ent = &edicts[COM_RandomLong( 1, num - 1 )];
+		vec3_t org;
+		float radius;
+		int e = 0;
+
+		// move and free edicts around, just like the game does
+		if( COM_RandomLong( 0, 3 ) == 0 )
+		{
+			ent->free = !ent->free;
+			if( !ent->free )
+			{
+				memset( &ent->v, 0, sizeof( ent->v ));
+				SV_LinkSphereEdict( ent );
+			}
+		}
+
+		if( !ent->free )
+		{
+			Test_RandomSphereEdict( ent );
+			SV_LinkSphereEdict( ent );
+		}
+
+		for( j = 0; j < 3; j++ )
+			org[j] = COM_RandomFloat( -4608.0f, 4608.0f );
+		radius = COM_RandomLong( 0, 15 ) ? COM_RandomFloat( 0.0f, 512.0f ) : COM_RandomFloat( 1024.0f, 8192.0f );
+
+		// check the whole chain
+		do
+		{
+			int expected = SV_FindEntityInSphereLinear( e, org, radius * radius );
+			int result = SV_FindEntityInSphere( e, org, radius );
+
+			TASSERT_EQi( expected, result );
+			e = expected;
+		} while( e != 0 );
+	}
 
-	return VectorAvg( sv_pointColor );
+	Mem_Free( sv_spherelinks );
+	sv_spherelinks = oldlinks;
+	sv_numspherelinks = oldnumlinks;
+	sv_numspherenodes = 0;
+	svgame.edicts = oldedicts;
+	svgame.numEntities = oldnumentities;
+	svs.maxclients = oldmaxclients;
+	GI = oldgameinfo;
 }
+#endif /* XASH_ENGINE_TESTS */
@@ -521,6 +521,8 @@ public:
 
 extern "C" void EXPORT *CreateInterface( const char *interface, int *retval )
 {
+	FS_InitLocks();
+
 	if( !Q_strcmp( interface, FILESYSTEM_INTERFACE_VERSION ))
 	{
 		if( retval )
@@ -0,0 +1,499 @@
+/*
+async.c - asynchronous file loading
+Copyright (C) 2024 Xash3D FWGS contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "build.h"
+#include <stdlib.h>
+#include <string.h>
+#include "port.h"
+#include "filesystem_internal.h"
+#include "crtlib.h"
+#include "common/com_strings.h"
+
+#define FS_ASYNC_THREADS 2
+
+#if XASH_WIN32
+#include <windows.h>
+#define HAVE_THREADS
+typedef CRITICAL_SECTION   fs_mutex_t;
+typedef CONDITION_VARIABLE fs_cond_t;
+typedef HANDLE             fs_thread_t;
+typedef DWORD              fs_threadid_t;
+#define mutex_create( x )   InitializeCriticalSection( &( x ))  // always recursive
+#define mutex_destroy( x )  DeleteCriticalSection( &( x ))
+#define mutex_lock( x )     EnterCriticalSection( &( x ))
+#define mutex_unlock( x )   LeaveCriticalSection( &( x ))
+#define cond_create( x )    InitializeConditionVariable( &( x ))
+#define cond_destroy( x )
+#define cond_wait( x, m )   SleepConditionVariableCS( &( x ), &( m ), INFINITE )
+#define cond_signal( x )    WakeConditionVariable( &( x ))
+#define cond_broadcast( x ) WakeAllConditionVariable( &( x ))
+#define create_thread( thread, pfn ) ((( thread ) = CreateThread( NULL, 0, ( pfn ), NULL, 0, NULL )) != NULL )
+#define join_thread( x )    ( WaitForSingleObject(( x ), INFINITE ), CloseHandle(( x )))
+#define current_thread()    GetCurrentThreadId()
+#define same_thread( x, y ) (( x ) == ( y ))
+#define THREAD_RETURN_TYPE  DWORD WINAPI
+#define THREAD_RETURN_VALUE 0
+#elif XASH_POSIX && !XASH_EMSCRIPTEN
+#include <pthread.h>
+#define HAVE_THREADS
+typedef pthread_mutex_t fs_mutex_t;
+typedef pthread_cond_t  fs_cond_t;
+typedef pthread_t       fs_thread_t;
+typedef pthread_t       fs_threadid_t;
+#define mutex_create( x )   FS_CreateRecursiveMutex( &( x ))
+#define mutex_destroy( x )  pthread_mutex_destroy( &( x ))
+#define mutex_lock( x )     pthread_mutex_lock( &( x ))
+#define mutex_unlock( x )   pthread_mutex_unlock( &( x ))
+#define cond_create( x )    pthread_cond_init( &( x ), NULL )
+#define cond_destroy( x )   pthread_cond_destroy( &( x ))
+#define cond_wait( x, m )   pthread_cond_wait( &( x ), &( m ))
+#define cond_signal( x )    pthread_cond_signal( &( x ))
+#define cond_broadcast( x ) pthread_cond_broadcast( &( x ))
+#define create_thread( thread, pfn ) !pthread_create( &( thread ), NULL, ( pfn ), NULL )
+#define join_thread( x )    pthread_join(( x ), NULL )
+#define current_thread()    pthread_self()
+#define same_thread( x, y ) pthread_equal(( x ), ( y ))
+#define THREAD_RETURN_TYPE  void *
+#define THREAD_RETURN_VALUE NULL
+
+static void FS_CreateRecursiveMutex( pthread_mutex_t *mutex )
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init( &attr );
+	pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( mutex, &attr );
+	pthread_mutexattr_destroy( &attr );
+}
+#endif
+
+typedef struct fs_async_request_s
+{
+	struct fs_async_request_s *next;
+	fs_async_callback_t callback;
+	void        *userdata;
+	qboolean    gamedironly;
+	byte        *data;
+	fs_offset_t size;
+	char        path[MAX_SYSPATH];
+} fs_async_request_t;
+
+typedef struct fs_async_message_s
+{
+	struct fs_async_message_s *next;
+	void (*pfnPrint)( const char *fmt, ... );
+	char text[1]; // variable sized
+} fs_async_message_t;
+
+typedef struct fs_async_queue_s
+{
+	fs_async_request_t *head;
+	fs_async_request_t **tail;
+} fs_async_queue_t;
+
+static struct
+{
+	fs_async_queue_t pending;   // waiting for I/O thread
+	fs_async_queue_t completed; // waiting for FS_ProcessAsync
+	int              loading;   // taken by I/O threads
+	qboolean         initialized;
+
+	fs_async_message_t *messages;     // printed by main thread
+	fs_async_message_t **messagestail;
+
+#ifdef HAVE_THREADS
+	fs_mutex_t  searchlock; // searchpaths and archive handles
+	fs_mutex_t  queuelock;  // everything above
+	fs_cond_t   wakeup;     // request was queued or threads must quit
+	fs_cond_t   finished;   // request was completed
+	fs_thread_t threads[FS_ASYNC_THREADS];
+	fs_threadid_t mainthread; // the one that loaded filesystem
+	int         numthreads;
+	qboolean    quit;
+#endif
+} fs_async;
+
+/*
+==============================================================================
+
+LOCKING
+
+Searchpaths are only changed on the main thread, but lookup caches and
+archive handles are shared with I/O threads, so everything that touches
+them goes under the same recursive lock
+
+==============================================================================
+*/
+/*
+====================
+FS_InitLocks
+
+Called once filesystem module is loaded, before any other function
+====================
+*/
+void FS_InitLocks( void )
+{
+	if( fs_async.initialized )
+		return;
+
+	fs_async.pending.tail = &fs_async.pending.head;
+	fs_async.completed.tail = &fs_async.completed.head;
+	fs_async.messagestail = &fs_async.messages;
+	fs_async.initialized = true;
+
+#ifdef HAVE_THREADS
+	fs_async.mainthread = current_thread();
+	mutex_create( fs_async.searchlock );
+	mutex_create( fs_async.queuelock );
+	cond_create( fs_async.wakeup );
+	cond_create( fs_async.finished );
+#endif
+}
+
+void FS_Lock( void )
+{
+#ifdef HAVE_THREADS
+	mutex_lock( fs_async.searchlock );
+#endif
+}
+
+void FS_Unlock( void )
+{
+#ifdef HAVE_THREADS
+	mutex_unlock( fs_async.searchlock );
+#endif
+}
+
+/*
+==============================================================================
+
+CONSOLE
+
+Engine console can only be used from the main thread, messages printed
+from other threads are queued and printed by FS_ProcessAsync
+
+==============================================================================
+*/
+static qboolean FS_IsMainThread( void )
+{
+#ifdef HAVE_THREADS
+	return !fs_async.initialized || same_thread( current_thread(), fs_async.mainthread );
+#else
+	return true;
+#endif
+}
+
+static void FS_ConMessage( void (*pfnPrint)( const char *fmt, ... ), const char *text )
+{
+	fs_async_message_t *message;
+	size_t len;
+
+	if( FS_IsMainThread( ))
+	{
+		pfnPrint( "%s", text );
+		return;
+	}
+
+	len = Q_strlen( text );
+	if( !( message = (fs_async_message_t *)malloc( sizeof( *message ) + len )))
+		return;
+
+	message->next = NULL;
+	message->pfnPrint = pfnPrint;
+	memcpy( message->text, text, len + 1 );
+
+#ifdef HAVE_THREADS
+	mutex_lock( fs_async.queuelock );
+	*fs_async.messagestail = message;
+	fs_async.messagestail = &message->next;
+	mutex_unlock( fs_async.queuelock );
+#endif
+}
+
+static void FS_FlushMessages( void )
+{
+	fs_async_message_t *message, *next;
+
+#ifdef HAVE_THREADS
+	mutex_lock( fs_async.queuelock );
+	message = fs_async.messages;
+	fs_async.messages = NULL;
+	fs_async.messagestail = &fs_async.messages;
+	mutex_unlock( fs_async.queuelock );
+#else
+	message = NULL;
+#endif
+
+	for( ; message; message = next )
+	{
+		next = message->next;
+		message->pfnPrint( "%s", message->text );
+		free( message );
+	}
+}
+
+void FS_ConPrintf( const char *fmt, ... )
+{
+	char text[MAX_PRINT_MSG];
+	va_list args;
+
+	va_start( args, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, args );
+	va_end( args );
+
+	FS_ConMessage( g_engfuncs._Con_Printf, text );
+}
+
+void FS_ConDPrintf( const char *fmt, ... )
+{
+	char text[MAX_PRINT_MSG];
+	va_list args;
+
+	va_start( args, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, args );
+	va_end( args );
+
+	FS_ConMessage( g_engfuncs._Con_DPrintf, text );
+}
+
+void FS_ConReportf( const char *fmt, ... )
+{
+	char text[MAX_PRINT_MSG];
+	va_list args;
+
+	va_start( args, fmt );
+	Q_vsnprintf( text, sizeof( text ), fmt, args );
+	va_end( args );
+
+	FS_ConMessage( g_engfuncs._Con_Reportf, text );
+}
+
+/*
+==============================================================================
+
+ASYNC LOADING
+
+Requests are loaded by I/O threads with FS_LoadFileMalloc and delivered
+back through callbacks when FS_ProcessAsync is called, usually once per frame
+
+==============================================================================
+*/
+static void FS_QueuePush( fs_async_queue_t *queue, fs_async_request_t *request )
+{
+	request->next = NULL;
+	*queue->tail = request;
+	queue->tail = &request->next;
+}
+
+static fs_async_request_t *FS_QueuePop( fs_async_queue_t *queue )
+{
+	fs_async_request_t *request = queue->head;
+
+	if( request )
+	{
+		queue->head = request->next;
+		if( !queue->head )
+			queue->tail = &queue->head;
+	}
+
+	return request;
+}
+
+static void FS_LoadRequest( fs_async_request_t *request )
+{
+	request->data = FS_LoadFileMalloc( request->path, &request->size, request->gamedironly );
+
+	if( !request->data )
+		request->size = 0;
+}
+
+#ifdef HAVE_THREADS
+static THREAD_RETURN_TYPE FS_AsyncThread( void *unused )
+{
+	mutex_lock( fs_async.queuelock );
+
+	while( true )
+	{
+		fs_async_request_t *request;
+
+		while( !fs_async.quit && !fs_async.pending.head )
+			cond_wait( fs_async.wakeup, fs_async.queuelock );
+
+		// pending requests are finished before quitting
+		if( !( request = FS_QueuePop( &fs_async.pending )))
+			break;
+
+		fs_async.loading++;
+		mutex_unlock( fs_async.queuelock );
+
+		FS_LoadRequest( request );
+
+		mutex_lock( fs_async.queuelock );
+		fs_async.loading--;
+		FS_QueuePush( &fs_async.completed, request );
+		cond_broadcast( fs_async.finished );
+	}
+
+	mutex_unlock( fs_async.queuelock );
+
+	// thread local memory caches aren't freed automatically
+	Mem_FlushThreadCache();
+
+	return THREAD_RETURN_VALUE;
+}
+
+static void FS_StartAsyncThreads( void )
+{
+	while( fs_async.numthreads < FS_ASYNC_THREADS )
+	{
+		if( !create_thread( fs_async.threads[fs_async.numthreads], FS_AsyncThread ))
+		{
+			Con_Printf( S_WARN "%s: can't create I/O thread\n", __func__ );
+			break;
+		}
+
+		fs_async.numthreads++;
+	}
+}
+#endif // HAVE_THREADS
+
+/*
+====================
+FS_LoadFileAsync
+
+Queues file loading, the callback is called from FS_ProcessAsync
+with the buffer allocated as in FS_LoadFileMalloc or NULL if file wasn't found
+====================
+*/
+qboolean FS_LoadFileAsync( const char *path, qboolean gamedironly, fs_async_callback_t callback, void *userdata )
+{
+	fs_async_request_t *request;
+
+	if( !COM_CheckString( path ) || !callback )
+		return false;
+
+	request = (fs_async_request_t *)malloc( sizeof( *request ));
+	if( !request )
+		return false;
+
+	memset( request, 0, sizeof( *request ));
+	Q_strncpy( request->path, path, sizeof( request->path ));
+	request->gamedironly = gamedironly;
+	request->callback = callback;
+	request->userdata = userdata;
+
+#ifdef HAVE_THREADS
+	if( !fs_async.numthreads )
+		FS_StartAsyncThreads();
+
+	if( fs_async.numthreads )
+	{
+		mutex_lock( fs_async.queuelock );
+		FS_QueuePush( &fs_async.pending, request );
+		cond_signal( fs_async.wakeup );
+		mutex_unlock( fs_async.queuelock );
+		return true;
+	}
+#endif
+
+	// no threads, load right now but still deliver from FS_ProcessAsync
+	FS_LoadRequest( request );
+	FS_QueuePush( &fs_async.completed, request );
+
+	return true;
+}
+
+/*
+====================
+FS_ProcessAsync
+
+Calls callbacks for completed requests on the calling thread, returns their count
+If wait is set, blocks until every queued request is delivered
+====================
+*/
+int FS_ProcessAsync( qboolean wait )
+{
+	fs_async_request_t *request;
+	int count = 0;
+
+	while( true )
+	{
+#ifdef HAVE_THREADS
+		mutex_lock( fs_async.queuelock );
+
+		if( wait )
+		{
+			while( !fs_async.completed.head && ( fs_async.pending.head || fs_async.loading ))
+				cond_wait( fs_async.finished, fs_async.queuelock );
+		}
+
+		request = FS_QueuePop( &fs_async.completed );
+		mutex_unlock( fs_async.queuelock );
+#else
+		request = FS_QueuePop( &fs_async.completed );
+#endif
+
+		// errors are printed before callback gets its result
+		FS_FlushMessages();
+
+		if( !request )
+			break;
+
+		// callback may queue another request
+		request->callback( request->path, request->data, request->size, request->userdata );
+		free( request );
+		count++;
+	}
+
+	return count;
+}
+
+/*
+====================
+FS_ShutdownAsync
+
+Stops I/O threads, requests that weren't delivered yet are dropped
+====================
+*/
+void FS_ShutdownAsync( void )
+{
+	fs_async_request_t *request;
+
+#ifdef HAVE_THREADS
+	int i;
+
+	if( fs_async.numthreads )
+	{
+		mutex_lock( fs_async.queuelock );
+		fs_async.quit = true;
+		cond_broadcast( fs_async.wakeup );
+		mutex_unlock( fs_async.queuelock );
+
+		for( i = 0; i < fs_async.numthreads; i++ )
+			join_thread( fs_async.threads[i] );
+
+		fs_async.numthreads = 0;
+		fs_async.quit = false;
+	}
+#endif
+
+	FS_FlushMessages();
+
+	while(( request = FS_QueuePop( &fs_async.completed )) != NULL )
+	{
+		free( request->data );
+		free( request );
+	}
+}
@@ -28,9 +28,11 @@ GNU General Public License for more details.
 #endif
 #if XASH_LINUX
 #include <linux/fs.h>
+#include <sys/inotify.h>
 #ifndef FS_CASEFOLD_FL // for compatibility with older distros
 #define FS_CASEFOLD_FL 0x40000000
 #endif // FS_CASEFOLD_FL
+#define HAVE_INOTIFY
 #endif // XASH_LINUX
 
 #include "port.h"
@@ -41,18 +43,246 @@ GNU General Public License for more details.
 
 enum
 {
-	DIRENTRY_EMPTY_DIRECTORY = 0, // don't care if it's not directory or it's empty
+	DIRENTRY_EMPTY_DIRECTORY = 0, // it's empty or we don't know if it's directory
 	DIRENTRY_NOT_SCANNED = -1,
 	DIRENTRY_CASEINSENSITIVE = -2, // directory is already caseinsensitive, just copy whatever is left
+	DIRENTRY_NOT_DIRECTORY = -3, // regular file or doesn't exist
 };
 
+typedef struct dirwatch_s
+{
+	int wd;
+	qboolean stale; // directory was changed since it was scanned
+	struct dir_s *dir;
+	struct dirwatch_s *next; // in hash chain
+} dirwatch_t;
+
 typedef struct dir_s
 {
 	string name;
 	int numentries;
 	struct dir_s *entries; // sorted
+	dirwatch_t *watch; // set if changes to this directory are reported to us
 } dir_t;
 
+/*
+=======================================================================
+
+			DIRECTORY WATCHING
+
+With inotify, scanned directories are watched for added, removed or
+renamed entries. Listing of watched directory is trusted until it
+changes, so lookups neither stat every path element nor rescan the
+directory to make sure that missing file didn't appear.
+Set XASH3D_NO_DIRWATCH environment variable to disable it.
+
+=======================================================================
+*/
+#ifdef HAVE_INOTIFY
+#define FS_WATCH_HASH 64 // must be power of two
+#define FS_WATCH_MASK ( IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR )
+
+static struct
+{
+	qboolean initialized;
+	qboolean added; // something was created since last FS_UpdateDirWatches call
+	int fd;
+	dirwatch_t *hash[FS_WATCH_HASH];
+} fs_watch;
+
+static dirwatch_t *FS_FindWatch( int wd )
+{
+	dirwatch_t *watch;
+
+	for( watch = fs_watch.hash[wd & ( FS_WATCH_HASH - 1 )]; watch; watch = watch->next )
+	{
+		if( watch->wd == wd )
+			return watch;
+	}
+
+	return NULL;
+}
+
+static void FS_FreeWatch( dirwatch_t *watch )
+{
+	dirwatch_t **prev;
+
+	for( prev = &fs_watch.hash[watch->wd & ( FS_WATCH_HASH - 1 )]; *prev; prev = &( *prev )->next )
+	{
+		if( *prev == watch )
+		{
+			*prev = watch->next;
+			break;
+		}
+	}
+
+	watch->dir->watch = NULL;
+	Mem_Free( watch );
+}
+#endif // HAVE_INOTIFY
+
+static void FS_WatchDir( dir_t *dir, const char *path )
+{
+#ifdef HAVE_INOTIFY
+	dirwatch_t *watch;
+	int wd;
+
+	if( !fs_watch.initialized )
+	{
+		fs_watch.initialized = true;
+		fs_watch.fd = -1;
+
+		if( !getenv( "XASH3D_NO_DIRWATCH" ))
+			fs_watch.fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	}
+
+	if( fs_watch.fd < 0 || dir->watch )
+		return;
+
+	// may fail if user watches limit is reached, then it's just rescanned as before
+	if(( wd = inotify_add_watch( fs_watch.fd, path, FS_WATCH_MASK )) < 0 )
+		return;
+
+	// same directory can be reached by different paths
+	if(( watch = FS_FindWatch( wd )) != NULL )
+		return;
+
+	watch = Mem_Calloc( fs_mempool, sizeof( *watch ));
+	watch->wd = wd;
+	watch->dir = dir;
+	watch->next = fs_watch.hash[wd & ( FS_WATCH_HASH - 1 )];
+	fs_watch.hash[wd & ( FS_WATCH_HASH - 1 )] = watch;
+	dir->watch = watch;
+#endif // HAVE_INOTIFY
+}
+
+static void FS_UnwatchDir( dir_t *dir )
+{
+#ifdef HAVE_INOTIFY
+	if( !dir->watch )
+		return;
+
+	inotify_rm_watch( fs_watch.fd, dir->watch->wd );
+	FS_FreeWatch( dir->watch );
+#endif // HAVE_INOTIFY
+}
+
+static qboolean FS_DirIsWatched( const dir_t *dir )
+{
+	return dir->watch != NULL && !dir->watch->stale;
+}
+
+/*
+====================
+FS_ReadDirWatches
+
+Marks changed directories to be rescanned
+====================
+*/
+static void FS_ReadDirWatches( void )
+{
+#ifdef HAVE_INOTIFY
+	union
+	{
+		struct inotify_event ev;
+		char raw[4096];
+	} buf;
+	ssize_t len;
+
+	if( !fs_watch.initialized || fs_watch.fd < 0 )
+		return;
+
+	while(( len = read( fs_watch.fd, buf.raw, sizeof( buf.raw ))) > 0 )
+	{
+		ssize_t ofs;
+
+		for( ofs = 0; ofs < len; ofs += sizeof( struct inotify_event ) + ((struct inotify_event *)( buf.raw + ofs ))->len )
+		{
+			const struct inotify_event *ev = (const struct inotify_event *)( buf.raw + ofs );
+			dirwatch_t *watch;
+
+			if( FBitSet( ev->mask, IN_Q_OVERFLOW ))
+			{
+				int i;
+
+				// events were lost, don't trust anything
+				for( i = 0; i < FS_WATCH_HASH; i++ )
+				{
+					for( watch = fs_watch.hash[i]; watch; watch = watch->next )
+						watch->stale = true;
+				}
+
+				fs_watch.added = true;
+				continue;
+			}
+
+			if(( watch = FS_FindWatch( ev->wd )) == NULL )
+				continue;
+
+			if( FBitSet( ev->mask, IN_IGNORED ))
+			{
+				// kernel already removed the watch
+				FS_FreeWatch( watch );
+			}
+			else if( FBitSet( ev->mask, IN_DELETE_SELF|IN_MOVE_SELF ))
+			{
+				// path doesn't lead to this directory anymore, parent will be rescanned
+				FS_UnwatchDir( watch->dir );
+			}
+			else
+			{
+				watch->stale = true;
+
+				if( FBitSet( ev->mask, IN_CREATE|IN_MOVED_TO ))
+					fs_watch.added = true;
+			}
+		}
+	}
+#endif // HAVE_INOTIFY
+}
+
+/*
+====================
+FS_UpdateDirWatches
+
+Returns true if any file might have appeared in
+watched directories since last call
+====================
+*/
+qboolean FS_UpdateDirWatches( void )
+{
+#ifdef HAVE_INOTIFY
+	qboolean added;
+
+	FS_ReadDirWatches();
+
+	added = fs_watch.added;
+	fs_watch.added = false;
+
+	return added;
+#else
+	return false;
+#endif // HAVE_INOTIFY
+}
+
+void FS_ShutdownDirWatches( void )
+{
+#ifdef HAVE_INOTIFY
+	int i;
+
+	for( i = 0; i < FS_WATCH_HASH; i++ )
+	{
+		while( fs_watch.hash[i] )
+			FS_FreeWatch( fs_watch.hash[i] );
+	}
+
+	if( fs_watch.initialized && fs_watch.fd >= 0 )
+		close( fs_watch.fd );
+
+	fs_watch.initialized = false;
+#endif // HAVE_INOTIFY
+}
+
 static qboolean Platform_GetDirectoryCaseSensitivity( const char *dir )
 {
 #if XASH_WIN32 || XASH_PSVITA || XASH_NSWITCH
@@ -89,7 +319,11 @@ static void FS_FreeDirEntries( dir_t *dir )
 	{
 		int i;
 		for( i = 0; i < dir->numentries; i++ )
+		{
 			FS_FreeDirEntries( &dir->entries[i] );
+			FS_UnwatchDir( &dir->entries[i] );
+		}
+		Mem_Free( dir->entries );
 		dir->entries = NULL;
 	}
 
@@ -110,6 +344,7 @@ static void FS_InitDirEntries( dir_t *dir, const stringlist_t *list )
 		Q_strncpy( entry->name, list->strings[i], sizeof( entry->name ));
 		entry->numentries = DIRENTRY_NOT_SCANNED;
 		entry->entries = NULL;
+		entry->watch = NULL;
 	}
 
 	qsort( dir->entries, dir->numentries, sizeof( dir->entries[0] ), FS_SortDirEntries );
@@ -121,7 +356,7 @@ static void FS_PopulateDirEntries( dir_t *dir, const char *path )
 
 	if( !FS_SysFolderExists( path ))
 	{
-		dir->numentries = DIRENTRY_EMPTY_DIRECTORY;
+		dir->numentries = DIRENTRY_NOT_DIRECTORY;
 		dir->entries = NULL;
 		return;
 	}
@@ -133,6 +368,9 @@ static void FS_PopulateDirEntries( dir_t *dir, const char *path )
 		return;
 	}
 
+	// start watching before listing, so nothing is missed in between
+	FS_WatchDir( dir, path );
+
 	stringlistinit( &list );
 	listdirectory( &list, path );
 	if( !list.numstrings )
@@ -192,7 +430,7 @@ static void FS_MergeDirEntries( dir_t *dir, const stringlist_t *list )
 		int j;
 
 		// don't care about directories without subentries
-		if( oldentry->entries == NULL )
+		if( oldentry->entries == NULL && oldentry->watch == NULL )
 			continue;
 
 		// try to find this directory in new tree
@@ -202,6 +440,7 @@ static void FS_MergeDirEntries( dir_t *dir, const stringlist_t *list )
 		if( j < 0 )
 		{
 			FS_FreeDirEntries( oldentry );
+			FS_UnwatchDir( oldentry );
 			continue;
 		}
 
@@ -210,6 +449,10 @@ static void FS_MergeDirEntries( dir_t *dir, const stringlist_t *list )
 
 		newentry->numentries = oldentry->numentries;
 		newentry->entries = oldentry->entries;
+		newentry->watch = oldentry->watch;
+
+		if( newentry->watch )
+			newentry->watch->dir = newentry;
 	}
 
 	// now we can free old tree and replace it with temporary
@@ -266,6 +509,33 @@ static int FS_MaybeUpdateDirEntries( dir_t *dir, const char *path, const char *e
 	return ret;
 }
 
+static void FS_RefreshDirEntries( dir_t *dir, const char *path )
+{
+	stringlist_t list;
+
+	// events coming during the scan will mark it again
+	dir->watch->stale = false;
+
+	stringlistinit( &list );
+	listdirectory( &list, path );
+
+	if( list.numstrings == 0 )
+	{
+		FS_FreeDirEntries( dir );
+		dir->numentries = DIRENTRY_EMPTY_DIRECTORY;
+	}
+	else if( dir->numentries <= DIRENTRY_EMPTY_DIRECTORY )
+	{
+		FS_InitDirEntries( dir, &list );
+	}
+	else
+	{
+		FS_MergeDirEntries( dir, &list );
+	}
+
+	stringlistfreecontents( &list );
+}
+
 static inline qboolean FS_AppendToPath( char *dst, size_t *pi, const size_t len, const char *src, const char *path, const char *err )
 {
 	size_t i = *pi;
@@ -281,12 +551,16 @@ static inline qboolean FS_AppendToPath( char *dst, size_t *pi, const size_t len,
 	return true;
 }
 
-qboolean FS_FixFileCase( dir_t *dir, const char *path, char *dst, const size_t len, qboolean createpath )
+static qboolean FS_FixFileCase_( dir_t *dir, const char *path, char *dst, const size_t len, qboolean createpath )
 {
 	const char *prev;
 	const char *next;
+	qboolean parent_trusted = false;
 	size_t i = 0;
 
+	// apply changes reported since last lookup
+	FS_ReadDirWatches();
+
 	if( !FS_AppendToPath( dst, &i, len, dir->name, path, "init" ))
 		return false;
 
@@ -299,6 +573,7 @@ qboolean FS_FixFileCase( dir_t *dir, const char *path, char *dst, const size_t l
 		  prev = next + 1, next = Q_strchrnul( prev, '/' ))
 	{
 		qboolean uptodate = false; // do not run second scan if we're just updated our directory list
+		qboolean trusted;
 		size_t temp;
 		char entryname[MAX_SYSPATH];
 		int ret;
@@ -309,6 +584,16 @@ qboolean FS_FixFileCase( dir_t *dir, const char *path, char *dst, const size_t l
 			FS_PopulateDirEntries( dir, dst );
 			uptodate = true;
 		}
+		else if( dir->watch && dir->watch->stale )
+		{
+			FS_RefreshDirEntries( dir, dst );
+			uptodate = true;
+		}
+
+		// watched directory and files in it can't change without us knowing
+		trusted = FS_DirIsWatched( dir ) || ( parent_trusted && dir->numentries == DIRENTRY_NOT_DIRECTORY );
+		if( trusted )
+			uptodate = true;
 
 		// this subdirectory is case insensitive, just slam everything that's left
 		if( dir->numentries == DIRENTRY_CASEINSENSITIVE )
@@ -353,6 +638,7 @@ qboolean FS_FixFileCase( dir_t *dir, const char *path, char *dst, const size_t l
 				return false;
 		}
 		i = temp;
+		parent_trusted = trusted;
 
 		// end of string, found file, return
 		if( next[0] == '\0' || ( next[0] == '/' && next[1] == '\0' ))
@@ -365,9 +651,24 @@ qboolean FS_FixFileCase( dir_t *dir, const char *path, char *dst, const size_t l
 	return true;
 }
 
+qboolean FS_FixFileCase( dir_t *dir, const char *path, char *dst, const size_t len, qboolean createpath )
+{
+	qboolean ret;
+
+	// directory caches and watches are shared with I/O threads
+	FS_Lock();
+	ret = FS_FixFileCase_( dir, path, dst, len, createpath );
+	FS_Unlock();
+
+	return ret;
+}
+
 static void FS_Close_DIR( searchpath_t *search )
 {
+	FS_Lock();
 	FS_FreeDirEntries( search->dir );
+	FS_UnwatchDir( search->dir );
+	FS_Unlock();
 	Mem_Free( search->dir );
 }
 
@@ -488,7 +789,11 @@ void FS_InitDirectorySearchpath( searchpath_t *search, const char *path, int fla
 	// create cache root
 	search->dir = Mem_Malloc( fs_mempool, sizeof( dir_t ));
 	Q_strncpy( search->dir->name, search->filename, sizeof( search->dir->name ));
+	search->dir->watch = NULL;
+
+	FS_Lock();
 	FS_PopulateDirEntries( search->dir, path );
+	FS_Unlock();
 }
 
 searchpath_t *FS_AddDir_Fullpath( const char *path, int flags )
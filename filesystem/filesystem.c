@@ -33,6 +33,9 @@ GNU General Public License for more details.
 #include <stdio.h>
 #include <stdarg.h>
 #include "port.h"
+#if defined( HAVE_MMAP ) && !XASH_WIN32
+#include <sys/mman.h>
+#endif
 #include "defaults.h"
 #include "const.h"
 #include "crtlib.h"
@@ -53,6 +56,64 @@ char          fs_rootdir[MAX_SYSPATH];
 searchpath_t *fs_writepath;
 
 static searchpath_t *fs_searchpaths = NULL;	// chain
+static int          fs_searchpaths_generation = 1;	// changed on every mount and unmount
+
+// archive entry in the global file index
+typedef struct fs_indexentry_s
+{
+	const char   *name;	// stored in archive directory
+	searchpath_t *search;
+	int          pack_ind;
+	int          position;	// of the searchpath, lower wins
+	int          next;	// in the hash bucket
+	int          shadowed;	// same name in the later searchpath
+} fs_indexentry_t;
+
+// all files of fixed content archives, so lookups don't walk through each of them
+static struct
+{
+	int             generation;	// fs_searchpaths_generation index was built for
+	fs_indexentry_t *entries;
+	int             numentries;
+	int             *buckets;
+	uint            numbuckets;
+	searchpath_t    **unindexed;	// plain directories and wads, still looked up in order
+	int             *positions;	// of unindexed searchpaths
+	int             numunindexed;
+} fs_index;
+
+#define FS_MAP_MIN_SIZE ( 64 * 1024 ) // smaller files are cheaper to read than to map
+
+// buffer given out by FS_MapFile
+typedef struct fs_mapping_s
+{
+	byte   *data;	// as returned to the caller
+	void   *base;	// of the mapped view, NULL if file was loaded to memory
+	size_t size;	// of the mapped view
+	struct fs_mapping_s *next;
+} fs_mapping_t;
+
+static fs_mapping_t *fs_mappings;
+
+#define FS_MISSING_CACHE_SETS 512 // must be power of two
+#define FS_MISSING_CACHE_WAYS 4
+
+// names that weren't found, so repeated probes don't walk all searchpaths again
+typedef struct fs_missing_s
+{
+	int      generation;	// entry is valid only if equals to fs_missing.generation
+	uint     stamp;	// oldest entry in the set is replaced first
+	qboolean gamedironly;	// only gamedir was checked
+	char     name[MAX_QPATH];
+} fs_missing_t;
+
+static struct
+{
+	int          generation;	// bumped to drop all entries
+	int          searchpaths_generation;
+	uint         stamp;
+	fs_missing_t entries[FS_MISSING_CACHE_SETS][FS_MISSING_CACHE_WAYS];
+} fs_missing;
 static char			fs_basedir[MAX_SYSPATH];	// base game directory
 static char			fs_gamedir[MAX_SYSPATH];	// game current directory
 
@@ -123,6 +184,7 @@ static void FS_BackupFileName( file_t *file, const char *path, uint options ) {}
 #endif
 
 static void FS_InitMemory( void );
+static void FS_SaveChecksumCache( void );
 static void FS_Purge( file_t* file );
 
 void _Mem_Free( void *data, const char *filename, int fileline )
@@ -323,8 +385,11 @@ searchpath_t *FS_AddArchive_Fullpath( const fs_archive_t *archive, const char *f
 	if( !search )
 		return NULL;
 
+	FS_Lock();
 	search->next = fs_searchpaths;
 	fs_searchpaths = search;
+	fs_searchpaths_generation++;
+	FS_Unlock();
 
 	// time to add in search list all the wads from this archive
 	if( archive->load_wads && !FBitSet( flags, FS_SKIP_ARCHIVED_WADS ))
@@ -344,8 +409,11 @@ searchpath_t *FS_AddArchive_Fullpath( const fs_archive_t *archive, const char *f
 			Q_snprintf( fullpath, sizeof( fullpath ), "%s/%s", file, list.strings[i] );
 			if(( wad = FS_AddWad_Fullpath( fullpath, flags | FS_LOAD_PACKED_WAD )))
 			{
+				FS_Lock();
 				wad->next = fs_searchpaths;
 				fs_searchpaths = wad;
+				fs_searchpaths_generation++;
+				FS_Unlock();
 			}
 		}
 
@@ -430,6 +498,11 @@ void FS_ClearSearchPath( void )
 {
 	searchpath_t *cur, **prev;
 
+	// checksums are kept per game directory
+	FS_SaveChecksumCache();
+
+	// I/O threads can't have searchpath in use while holding the lock
+	FS_Lock();
 	prev = &fs_searchpaths;
 
 	while( true )
@@ -449,7 +522,10 @@ void FS_ClearSearchPath( void )
 		*prev = cur->next;
 		cur->pfnClose( cur );
 		Mem_Free( cur );
+		fs_searchpaths_generation++;
 	}
+
+	FS_Unlock();
 }
 
 /*
@@ -1474,6 +1550,11 @@ static void *Sys_GetNativeObjectStub( const char *object )
 	return NULL;
 }
 
+static void Mem_FlushThreadCacheStub( void )
+{
+	// stub
+}
+
 /*
 ================
 FS_Init
@@ -1601,8 +1682,11 @@ void FS_ShutdownStdio( void )
 			Mem_Free( FI.games[i] );
 	}
 
+	FS_ShutdownAsync();
 	FS_ClearSearchPath(); // release all wad files too
+	FS_ShutdownDirWatches();
 	Mem_FreePool( &fs_mempool );
+	memset( &fs_index, 0, sizeof( fs_index )); // was allocated in fs_mempool
 }
 
 /*
@@ -1634,6 +1718,11 @@ void FS_Path_f( void )
 
 		Con_Printf( "\n" );
 	}
+
+	if( fs_index.generation == fs_searchpaths_generation )
+		Con_Printf( "%i files indexed, %i searchpaths looked up directly\n", fs_index.numentries, fs_index.numunindexed );
+
+	Con_Printf( "%i of %i lookups answered from missing files cache\n", FI.missingcached, FI.lookups );
 }
 
 /*
@@ -1907,21 +1996,149 @@ int FS_SetCurrentDirectory( const char *path )
 
 /*
 ====================
-FS_FindFile
+FS_FreeIndex
 
-Look for a file in the packages and in the filesystem
+====================
+*/
+static void FS_FreeIndex( void )
+{
+	if( fs_index.entries ) Mem_Free( fs_index.entries );
+	if( fs_index.buckets ) Mem_Free( fs_index.buckets );
+	if( fs_index.unindexed ) Mem_Free( fs_index.unindexed );
+	if( fs_index.positions ) Mem_Free( fs_index.positions );
+	memset( &fs_index, 0, sizeof( fs_index ));
+}
 
-Return the searchpath where the file was found (or NULL)
-and the file index in the package if relevant
+/*
+====================
+FS_BuildIndex
+
+Hash all files of archives that can't change while mounted.
+When the same name is in several archives, the first searchpath
+stays in the bucket and later ones are chained through shadowed
 ====================
 */
-searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t len, qboolean gamedironly )
+static qboolean FS_BuildIndex( void )
 {
-	searchpath_t	*search;
+	searchpath_t *search;
+	int numentries = 0, numsearchpaths = 0;
+	int position, i;
+
+	FS_FreeIndex();
 
-	// search through the path, one element at a time
 	for( search = fs_searchpaths; search; search = search->next )
 	{
+		numsearchpaths++;
+
+		if( search->pfnFileName )
+		{
+			for( i = 0; search->pfnFileName( search, i ); i++ )
+				numentries++;
+		}
+	}
+
+	for( fs_index.numbuckets = 64; fs_index.numbuckets < numentries; fs_index.numbuckets <<= 1 );
+
+	fs_index.entries = Mem_Malloc( fs_mempool, sizeof( *fs_index.entries ) * Q_max( numentries, 1 ));
+	fs_index.buckets = Mem_Malloc( fs_mempool, sizeof( *fs_index.buckets ) * fs_index.numbuckets );
+	fs_index.unindexed = Mem_Malloc( fs_mempool, sizeof( *fs_index.unindexed ) * Q_max( numsearchpaths, 1 ));
+	fs_index.positions = Mem_Malloc( fs_mempool, sizeof( *fs_index.positions ) * Q_max( numsearchpaths, 1 ));
+
+	if( !fs_index.entries || !fs_index.buckets || !fs_index.unindexed || !fs_index.positions )
+	{
+		FS_FreeIndex();
+		return false;
+	}
+
+	memset( fs_index.buckets, 0xFF, sizeof( *fs_index.buckets ) * fs_index.numbuckets );
+
+	for( search = fs_searchpaths, position = 0; search; search = search->next, position++ )
+	{
+		const char *name;
+
+		if( !search->pfnFileName )
+		{
+			fs_index.unindexed[fs_index.numunindexed] = search;
+			fs_index.positions[fs_index.numunindexed] = position;
+			fs_index.numunindexed++;
+			continue;
+		}
+
+		for( i = 0; ( name = search->pfnFileName( search, i )) != NULL; i++ )
+		{
+			fs_indexentry_t *entry = &fs_index.entries[fs_index.numentries];
+			uint hash = COM_HashKey( name, fs_index.numbuckets );
+			int j;
+
+			entry->name = name;
+			entry->search = search;
+			entry->pack_ind = i;
+			entry->position = position;
+			entry->shadowed = -1;
+
+			for( j = fs_index.buckets[hash]; j >= 0; j = fs_index.entries[j].next )
+			{
+				if( !Q_stricmp( fs_index.entries[j].name, name ))
+					break;
+			}
+
+			if( j >= 0 )
+			{
+				// already provided by one of the previous searchpaths
+				while( fs_index.entries[j].shadowed >= 0 )
+					j = fs_index.entries[j].shadowed;
+
+				fs_index.entries[j].shadowed = fs_index.numentries;
+				entry->next = -1;
+			}
+			else
+			{
+				entry->next = fs_index.buckets[hash];
+				fs_index.buckets[hash] = fs_index.numentries;
+			}
+
+			fs_index.numentries++;
+		}
+	}
+
+	fs_index.generation = fs_searchpaths_generation;
+
+	return true;
+}
+
+/*
+====================
+FS_FindFileIndexed
+
+Same as searchpaths walk in FS_FindFile, but archives are looked up in the index
+and only directories and wads in front of the found archive are checked one by one
+====================
+*/
+static searchpath_t *FS_FindFileIndexed( const char *name, int *index, char *fixedname, size_t len, qboolean gamedironly )
+{
+	const fs_indexentry_t *entry = NULL;
+	int limit = INT_MAX;
+	int i;
+
+	for( i = fs_index.buckets[COM_HashKey( name, fs_index.numbuckets )]; i >= 0; i = fs_index.entries[i].next )
+	{
+		if( !Q_stricmp( fs_index.entries[i].name, name ))
+			break;
+	}
+
+	for( ; i >= 0; i = fs_index.entries[i].shadowed )
+	{
+		if( gamedironly & !FBitSet( fs_index.entries[i].search->flags, FS_GAMEDIRONLY_SEARCH_FLAGS ))
+			continue;
+
+		entry = &fs_index.entries[i];
+		limit = entry->position;
+		break;
+	}
+
+	for( i = 0; i < fs_index.numunindexed && fs_index.positions[i] < limit; i++ )
+	{
+		searchpath_t *search = fs_index.unindexed[i];
 		int pack_ind;
 
 		if( gamedironly & !FBitSet( search->flags, FS_GAMEDIRONLY_SEARCH_FLAGS ))
@@ -1936,6 +2153,164 @@ searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t
 		}
 	}
 
+	if( !entry )
+		return NULL;
+
+	if( fixedname )
+		Q_strncpy( fixedname, entry->name, len );
+
+	if( index )
+		*index = entry->pack_ind;
+
+	return entry->search;
+}
+
+/*
+====================
+FS_InvalidateMissingCache
+
+Must be called when file might appear in one of the searchpaths
+====================
+*/
+static void FS_InvalidateMissingCache( void )
+{
+	FS_Lock();
+	fs_missing.generation++;
+	FS_Unlock();
+}
+
+/*
+====================
+FS_CheckMissingCache
+
+Returns true if file is known to be missing
+====================
+*/
+static qboolean FS_CheckMissingCache( const char *name, qboolean gamedironly )
+{
+	const fs_missing_t *set;
+	int i;
+
+	if( fs_missing.searchpaths_generation != fs_searchpaths_generation )
+	{
+		fs_missing.searchpaths_generation = fs_searchpaths_generation;
+		FS_InvalidateMissingCache();
+		return false;
+	}
+
+	set = fs_missing.entries[COM_HashKey( name, FS_MISSING_CACHE_SETS )];
+
+	for( i = 0; i < FS_MISSING_CACHE_WAYS; i++ )
+	{
+		if( set[i].generation != fs_missing.generation )
+			continue;
+
+		// missing from all searchpaths means it's missing from gamedir too
+		if( set[i].gamedironly && !gamedironly )
+			continue;
+
+		if( !Q_stricmp( set[i].name, name ))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+====================
+FS_AddMissingCache
+
+Remember that file wasn't found, evicting the oldest entry in the set
+====================
+*/
+static void FS_AddMissingCache( const char *name, qboolean gamedironly )
+{
+	fs_missing_t *set, *entry;
+	int i;
+
+	// long names are rare, not worth the memory
+	if( Q_strlen( name ) >= sizeof( set->name ))
+		return;
+
+	set = fs_missing.entries[COM_HashKey( name, FS_MISSING_CACHE_SETS )];
+	entry = &set[0];
+
+	for( i = 0; i < FS_MISSING_CACHE_WAYS; i++ )
+	{
+		if( set[i].generation != fs_missing.generation )
+		{
+			entry = &set[i];
+			break;
+		}
+
+		if( set[i].stamp < entry->stamp )
+			entry = &set[i];
+	}
+
+	entry->generation = fs_missing.generation;
+	entry->stamp = ++fs_missing.stamp;
+	entry->gamedironly = gamedironly;
+	Q_strncpy( entry->name, name, sizeof( entry->name ));
+}
+
+/*
+====================
+FS_FindFile
+
+Look for a file in the packages and in the filesystem
+
+Return the searchpath where the file was found (or NULL)
+and the file index in the package if relevant
+====================
+*/
+static searchpath_t *FS_FindFile_( const char *name, int *index, char *fixedname, size_t len, qboolean gamedironly )
+{
+	searchpath_t	*search;
+
+	FI.lookups++;
+
+	// file appeared in watched directory
+	if( FS_UpdateDirWatches( ))
+		FS_InvalidateMissingCache();
+
+	// direct paths can point anywhere, so they are never cached
+	if( !fs_ext_path && FS_CheckMissingCache( name, gamedironly ))
+	{
+		FI.missingcached++;
+
+		if( index != NULL )
+			*index = -1;
+
+		return NULL;
+	}
+
+	// index is rebuilt after searchpaths were changed
+	if( fs_index.generation == fs_searchpaths_generation || FS_BuildIndex( ))
+	{
+		search = FS_FindFileIndexed( name, index, fixedname, len, gamedironly );
+		if( search )
+			return search;
+	}
+	else
+	{
+		// search through the path, one element at a time
+		for( search = fs_searchpaths; search; search = search->next )
+		{
+			int pack_ind;
+
+			if( gamedironly & !FBitSet( search->flags, FS_GAMEDIRONLY_SEARCH_FLAGS ))
+				continue;
+
+			pack_ind = search->pfnFindFile( search, name, fixedname, len );
+			if( pack_ind >= 0 )
+			{
+				if( index )
+					*index = pack_ind;
+				return search;
+			}
+		}
+	}
+
 	if( fs_ext_path )
 	{
 		char netpath[MAX_SYSPATH], dirpath[MAX_SYSPATH];
@@ -1965,6 +2340,7 @@ searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t
 			return &fs_directpath;
 		}
 	}
+	else FS_AddMissingCache( name, gamedironly );
 
 	if( index != NULL )
 		*index = -1;
@@ -1972,6 +2348,18 @@ searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t
 	return NULL;
 }
 
+searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t len, qboolean gamedironly )
+{
+	searchpath_t *search;
+
+	// lookup caches are shared with I/O threads
+	FS_Lock();
+	search = FS_FindFile_( name, index, fixedname, len, gamedironly );
+	FS_Unlock();
+
+	return search;
+}
+
 /*
 ===========================
 FS_FullPathToRelativePath
@@ -2011,15 +2399,19 @@ file_t *FS_OpenReadFile( const char *filename, const char *mode, qboolean gamedi
 {
 	searchpath_t *search;
 	char netpath[MAX_SYSPATH];
+	file_t *file = NULL;
 	int pack_ind;
 
+	// archive handle is shared with I/O threads
+	FS_Lock();
 	search = FS_FindFile( filename, &pack_ind, netpath, sizeof( netpath ), gamedironly );
 
-	// not found?
-	if( search == NULL )
-		return NULL;
+	if( search != NULL )
+		file = search->pfnOpenFile( search, netpath, mode, pack_ind );
+
+	FS_Unlock();
 
-	return search->pfnOpenFile( search, netpath, mode, pack_ind );
+	return file;
 }
 
 /*
@@ -2061,6 +2453,7 @@ file_t *FS_Open( const char *filepath, const char *mode, qboolean gamedironly )
 			return NULL;
 
 		FS_CreatePath( real_path ); // Create directories up to the file
+		FS_InvalidateMissingCache();
 
 		return FS_SysOpen( real_path, mode );
 	}
@@ -2082,6 +2475,9 @@ int FS_Close( file_t *file )
 
 	FS_BackupFileName( file, NULL, 0 );
 
+	if( file->pfnCloseStream )
+		file->pfnCloseStream( file );
+
 	if( file->handle >= 0 )
 	{
 		if( close( file->handle ))
@@ -2150,6 +2546,57 @@ fs_offset_t FS_Write( file_t *file, const void *data, size_t datasize )
 	return result;
 }
 
+/*
+====================
+FS_ReadAt
+
+Read from the given offset, doesn't depend on descriptor offset
+so it's safe to use from different threads
+====================
+*/
+fs_offset_t FS_ReadAt( int handle, void *buffer, fs_offset_t count, fs_offset_t offset )
+{
+	if( count <= 0 )
+		return 0;
+
+#ifdef HAVE_PREAD
+	return pread( handle, buffer, count, offset );
+#else
+	fs_offset_t nb;
+
+	FS_Lock();
+	lseek( handle, offset, SEEK_SET );
+	nb = read( handle, buffer, count );
+	FS_Unlock();
+
+	return nb;
+#endif
+}
+
+/*
+====================
+FS_ReadRaw
+
+Read file contents at current position bypassing the buffer
+====================
+*/
+static fs_offset_t FS_ReadRaw( file_t *file, void *buffer, fs_offset_t count )
+{
+	if( count <= 0 )
+		return 0;
+
+	// compressed data is always decoded from where previous read stopped
+	if( file->pfnReadStream )
+		return file->pfnReadStream( file, buffer, count );
+
+	// archive members share descriptor and its offset with the archive
+	if( file->offset != 0 )
+		return FS_ReadAt( file->handle, buffer, count, file->offset + file->position );
+
+	lseek( file->handle, file->position, SEEK_SET );
+	return read( file->handle, buffer, count );
+}
+
 /*
 ====================
 FS_Read
@@ -2202,8 +2649,7 @@ fs_offset_t FS_Read( file_t *file, void *buffer, size_t buffersize )
 	{
 		if( count > (fs_offset_t)buffersize )
 			count = (fs_offset_t)buffersize;
-		lseek( file->handle, file->offset + file->position, SEEK_SET );
-		nb = read( file->handle, &((byte *)buffer)[done], count );
+		nb = FS_ReadRaw( file, &((byte *)buffer)[done], count );
 
 		if( nb > 0 )
 		{
@@ -2217,8 +2663,7 @@ fs_offset_t FS_Read( file_t *file, void *buffer, size_t buffersize )
 	{
 		if( count > (fs_offset_t)sizeof( file->buff ))
 			count = (fs_offset_t)sizeof( file->buff );
-		lseek( file->handle, file->offset + file->position, SEEK_SET );
-		nb = read( file->handle, file->buff, count );
+		nb = FS_ReadRaw( file, file->buff, count );
 
 		if( nb > 0 )
 		{
@@ -2369,6 +2814,36 @@ int FS_Gets( file_t *file, char *string, size_t bufsize )
 	return c;
 }
 
+/*
+====================
+FS_SeekStream
+
+Compressed data can't be seeked directly, so it's decoded
+from the start when going back and skipped when going forward
+====================
+*/
+static int FS_SeekStream( file_t *file, fs_offset_t offset )
+{
+	if( offset < file->position )
+	{
+		file->pfnRewindStream( file );
+		file->position = 0;
+	}
+
+	while( file->position < offset )
+	{
+		fs_offset_t count = Q_min( offset - file->position, (fs_offset_t)sizeof( file->buff ));
+		fs_offset_t nb = file->pfnReadStream( file, file->buff, count );
+
+		if( nb <= 0 )
+			return -1;
+
+		file->position += nb;
+	}
+
+	return 0;
+}
+
 /*
 ====================
 FS_Seek
@@ -2409,6 +2884,9 @@ int FS_Seek( file_t *file, fs_offset_t offset, int whence )
 	// Purge cached data
 	FS_Purge( file );
 
+	if( file->pfnReadStream )
+		return FS_SeekStream( file, offset );
+
 	if( lseek( file->handle, file->offset + offset, SEEK_SET ) == -1 )
 		return -1;
 	file->position = offset;
@@ -2472,39 +2950,28 @@ FS_LoadFile
 
 Filename are relative to the xash directory.
 Always appends a 0 byte.
+Called with FS_Lock held, releases it once file is opened,
+so reading of files from other threads isn't serialized
 ============
 */
-static byte *FS_LoadFile_( const char *path, fs_offset_t *filesizeptr, const qboolean gamedironly, const qboolean custom_alloc )
+static byte *FS_LoadSearchpathFile( searchpath_t *search, const char *netpath, int pack_ind, fs_offset_t *filesizeptr, const qboolean custom_alloc )
 {
-	searchpath_t *search;
 	fs_offset_t	filesize;
 	file_t *file;
 	byte *buf;
-	char netpath[MAX_SYSPATH];
-	int pack_ind;
 	void *( *pfnAlloc )( size_t ) = custom_alloc ? FS_CustomAlloc : malloc;
 	void ( *pfnFree )( void * ) = custom_alloc ? FS_CustomFree : free;
 
-	// some mappers used leading '/' or '\' in path to models or sounds
-	if( path[0] == '/' || path[0] == '\\' )
-		path++;
+	// custom load file function for compressed files
+	if( search->pfnLoadFile )
+	{
+		buf = search->pfnLoadFile( search, netpath, pack_ind, filesizeptr, pfnAlloc, pfnFree );
+		FS_Unlock();
+		return buf;
+	}
 
-	if( path[0] == '/' || path[0] == '\\' )
-		path++;
-
-	if( !fs_searchpaths || FS_CheckNastyPath( path ))
-		return NULL;
-
-	search = FS_FindFile( path, &pack_ind, netpath, sizeof( netpath ), gamedironly );
-
-	if( !search )
-		return NULL;
-
-	// custom load file function for compressed files
-	if( search->pfnLoadFile )
-		return search->pfnLoadFile( search, netpath, pack_ind, filesizeptr, pfnAlloc, pfnFree );
-
-	file = search->pfnOpenFile( search, netpath, "rb", pack_ind );
+	file = search->pfnOpenFile( search, netpath, "rb", pack_ind );
+	FS_Unlock();
 
 	if( !file ) // TODO: indicate errors
 		return NULL;
@@ -2527,6 +2994,34 @@ static byte *FS_LoadFile_( const char *path, fs_offset_t *filesizeptr, const qbo
 	return buf;
 }
 
+static byte *FS_LoadFile_( const char *path, fs_offset_t *filesizeptr, const qboolean gamedironly, const qboolean custom_alloc )
+{
+	searchpath_t *search;
+	char netpath[MAX_SYSPATH];
+	int pack_ind;
+
+	// some mappers used leading '/' or '\' in path to models or sounds
+	if( path[0] == '/' || path[0] == '\\' )
+		path++;
+
+	if( path[0] == '/' || path[0] == '\\' )
+		path++;
+
+	if( !fs_searchpaths || FS_CheckNastyPath( path ))
+		return NULL;
+
+	FS_Lock();
+	search = FS_FindFile( path, &pack_ind, netpath, sizeof( netpath ), gamedironly );
+
+	if( !search )
+	{
+		FS_Unlock();
+		return NULL;
+	}
+
+	return FS_LoadSearchpathFile( search, netpath, pack_ind, filesizeptr, custom_alloc );
+}
+
 byte *FS_LoadFileMalloc( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly )
 {
 	return FS_LoadFile_( path, filesizeptr, gamedironly, false );
@@ -2537,12 +3032,493 @@ byte *FS_LoadFile( const char *path, fs_offset_t *filesizeptr, qboolean gamediro
 	return FS_LoadFile_( path, filesizeptr, gamedironly, true );
 }
 
+/*
+============
+FS_MapRegion
+
+Creates private copy-on-write view of the part of file,
+returns pointer to offset within the view or NULL if it can't be mapped
+============
+*/
+static byte *FS_MapRegion( int handle, fs_offset_t offset, fs_offset_t size, fs_mapping_t *mapping )
+{
+#if XASH_WIN32
+	HANDLE hmap;
+	SYSTEM_INFO info;
+	struct _stat64 buf;
+	fs_offset_t start;
+
+	if( _fstat64( handle, &buf ) < 0 || offset + size > buf.st_size )
+		return NULL; // never map past the end of file
+
+	GetSystemInfo( &info );
+	start = offset - offset % info.dwAllocationGranularity;
+	mapping->size = offset - start + size;
+
+	hmap = CreateFileMapping( (HANDLE)_get_osfhandle( handle ), NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	if( !hmap )
+		return NULL;
+
+	// view holds the mapping object
+	mapping->base = MapViewOfFile( hmap, FILE_MAP_COPY, (DWORD)((uint64_t)start >> 32 ), (DWORD)start, mapping->size );
+	CloseHandle( hmap );
+
+	if( !mapping->base )
+		return NULL;
+
+	return (byte *)mapping->base + ( offset - start );
+#elif defined( HAVE_MMAP )
+	struct stat buf;
+	fs_offset_t start;
+
+	if( fstat( handle, &buf ) < 0 || offset + size > buf.st_size )
+		return NULL; // never map past the end of file
+
+	start = offset - offset % sysconf( _SC_PAGESIZE );
+	mapping->size = offset - start + size;
+	mapping->base = mmap( NULL, mapping->size, PROT_READ|PROT_WRITE, MAP_PRIVATE, handle, start );
+
+	if( mapping->base == MAP_FAILED )
+	{
+		mapping->base = NULL;
+		return NULL;
+	}
+
+	return (byte *)mapping->base + ( offset - start );
+#else
+	return NULL;
+#endif
+}
+
+/*
+============
+FS_UnmapRegion
+
+============
+*/
+static void FS_UnmapRegion( fs_mapping_t *mapping )
+{
+#if XASH_WIN32
+	UnmapViewOfFile( mapping->base );
+#elif defined( HAVE_MMAP )
+	munmap( mapping->base, mapping->size );
+#endif
+}
+
+/*
+============
+FS_MapFile
+
+Same as FS_LoadFile but uncompressed files are mapped to memory without copying.
+Writes to the buffer never reach the file, but it isn't null terminated
+and must be released with FS_UnmapFile
+============
+*/
+byte *FS_MapFile( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly )
+{
+	fs_mapping_t *mapping;
+	searchpath_t *search;
+	char netpath[MAX_SYSPATH];
+	fs_offset_t offset = 0, size = 0;
+	int pack_ind, handle = -1;
+	file_t *file = NULL;
+
+	// some mappers used leading '/' or '\' in path to models or sounds
+	if( path[0] == '/' || path[0] == '\\' )
+		path++;
+
+	if( path[0] == '/' || path[0] == '\\' )
+		path++;
+
+	if( !fs_searchpaths || FS_CheckNastyPath( path ))
+		return NULL;
+
+	FS_Lock();
+	search = FS_FindFile( path, &pack_ind, netpath, sizeof( netpath ), gamedironly );
+
+	if( !search )
+	{
+		FS_Unlock();
+		return NULL;
+	}
+
+	mapping = Mem_Calloc( fs_mempool, sizeof( *mapping ));
+
+	if( search->pfnFileHandle )
+	{
+		handle = search->pfnFileHandle( search, pack_ind, &offset, &size );
+	}
+	else if( !search->pfnLoadFile && ( file = search->pfnOpenFile( search, netpath, "rb", pack_ind )) != NULL )
+	{
+		handle = file->handle;
+		offset = file->offset;
+		size = file->real_length;
+	}
+
+	if( handle >= 0 && size >= FS_MAP_MIN_SIZE )
+		mapping->data = FS_MapRegion( handle, offset, size, mapping );
+
+	// view stays valid after file is closed
+	if( file )
+		FS_Close( file );
+
+	if( mapping->data )
+	{
+		FS_Unlock();
+
+		if( filesizeptr )
+			*filesizeptr = size;
+	}
+	else if(( mapping->data = FS_LoadSearchpathFile( search, netpath, pack_ind, filesizeptr, true )) == NULL )
+	{
+		Mem_Free( mapping );
+		return NULL;
+	}
+
+	mapping->next = fs_mappings;
+	fs_mappings = mapping;
+
+	return mapping->data;
+}
+
+/*
+============
+FS_UnmapFile
+
+============
+*/
+void FS_UnmapFile( byte *data )
+{
+	fs_mapping_t **prev, *mapping;
+
+	if( !data )
+		return;
+
+	for( prev = &fs_mappings; *prev; prev = &( *prev )->next )
+	{
+		if( ( *prev )->data == data )
+			break;
+	}
+
+	if( !( mapping = *prev ))
+	{
+		Con_Printf( S_ERROR "%s: %p wasn't returned by FS_MapFile\n", __func__, data );
+		return;
+	}
+
+	*prev = mapping->next;
+
+	if( mapping->base )
+		FS_UnmapRegion( mapping );
+	else Mem_Free( mapping->data );
+
+	Mem_Free( mapping );
+}
+
+/*
+=============================================================================
+
+CHECKSUM CACHE
+
+Full file hashing is repeated on every map spawn and consistency check,
+so checksums are kept on disk in the writable game directory. Entry is
+valid until file moves to other archive, changes its size or modification time
+
+=============================================================================
+*/
+#define FS_CHECKSUM_CACHE   "checksums.dat"
+#define FS_CHECKSUM_IDENT   (('K'<<24)+('S'<<16)+('C'<<8)+'X') // little-endian "XCSK"
+#define FS_CHECKSUM_VERSION 1
+#define FS_CHECKSUM_HASH    256 // must be power of two
+#define FS_CHECKSUM_MAXSIZE 16
+
+typedef struct fs_checksum_s
+{
+	struct fs_checksum_s *next;
+	int         kind;
+	int         filetime;
+	fs_offset_t filesize;
+	byte        checksum[FS_CHECKSUM_MAXSIZE];
+	char        *archive; // points into name
+	char        name[]; // flexible, followed by archive
+} fs_checksum_t;
+
+// on-disk entry, followed by null terminated path and archive
+typedef struct
+{
+	int     kind;
+	int     filetime;
+	int64_t filesize;
+	byte    checksum[FS_CHECKSUM_MAXSIZE];
+	word    namelen;
+	word    archivelen;
+} dchecksum_t;
+
+static struct
+{
+	fs_checksum_t *hash[FS_CHECKSUM_HASH];
+	int           count;
+	qboolean      loaded;
+	qboolean      dirty;
+} fs_checksums;
+
+static fs_checksum_t *FS_FindChecksum( const char *path, int kind )
+{
+	fs_checksum_t *entry;
+
+	for( entry = fs_checksums.hash[COM_HashKey( path, FS_CHECKSUM_HASH )]; entry; entry = entry->next )
+	{
+		if( entry->kind == kind && !Q_stricmp( entry->name, path ))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static fs_checksum_t *FS_AddChecksum( const char *path, const char *archive, int kind )
+{
+	size_t namelen = Q_strlen( path ) + 1, archivelen = Q_strlen( archive ) + 1;
+	fs_checksum_t *entry = Mem_Calloc( fs_mempool, sizeof( *entry ) + namelen + archivelen );
+	uint hash = COM_HashKey( path, FS_CHECKSUM_HASH );
+
+	memcpy( entry->name, path, namelen );
+	entry->archive = entry->name + namelen;
+	memcpy( entry->archive, archive, archivelen );
+	entry->kind = kind;
+
+	entry->next = fs_checksums.hash[hash];
+	fs_checksums.hash[hash] = entry;
+	fs_checksums.count++;
+
+	return entry;
+}
+
+static void FS_LoadChecksumCache( void )
+{
+	fs_offset_t len, ofs;
+	byte *buf;
+	int i, count;
+
+	fs_checksums.loaded = true;
+
+	if( !( buf = FS_LoadFile( FS_CHECKSUM_CACHE, &len, true )))
+		return;
+
+	if( len < (fs_offset_t)sizeof( int ) * 3 || ((int *)buf)[0] != FS_CHECKSUM_IDENT || ((int *)buf)[1] != FS_CHECKSUM_VERSION )
+	{
+		Con_Reportf( "%s: ignoring outdated %s\n", __func__, FS_CHECKSUM_CACHE );
+		Mem_Free( buf );
+		return;
+	}
+
+	count = ((int *)buf)[2];
+
+	for( i = 0, ofs = sizeof( int ) * 3; i < count; i++ )
+	{
+		const char *name, *archive;
+		fs_checksum_t *entry;
+		dchecksum_t in;
+
+		if( ofs + (fs_offset_t)sizeof( in ) > len )
+			break;
+
+		// entries aren't aligned
+		memcpy( &in, buf + ofs, sizeof( in ));
+		name = (const char *)buf + ofs + sizeof( in );
+		archive = name + in.namelen + 1;
+		ofs += sizeof( in ) + in.namelen + in.archivelen + 2;
+
+		// truncated file
+		if( ofs > len || name[in.namelen] || archive[in.archivelen] )
+			break;
+
+		entry = FS_AddChecksum( name, archive, in.kind );
+		entry->filetime = in.filetime;
+		entry->filesize = in.filesize;
+		memcpy( entry->checksum, in.checksum, sizeof( entry->checksum ));
+	}
+
+	Mem_Free( buf );
+}
+
+/*
+====================
+FS_SaveChecksumCache
+
+Writes cache to current game directory and releases it, so next game loads its own
+====================
+*/
+static void FS_SaveChecksumCache( void )
+{
+	fs_checksum_t *entry, *next;
+	file_t *f = NULL;
+	int i, header[3];
+
+	if( fs_checksums.dirty && fs_writepath && ( f = FS_Open( FS_CHECKSUM_CACHE, "wb", false )) != NULL )
+	{
+		header[0] = FS_CHECKSUM_IDENT;
+		header[1] = FS_CHECKSUM_VERSION;
+		header[2] = fs_checksums.count;
+		FS_Write( f, header, sizeof( header ));
+	}
+
+	for( i = 0; i < FS_CHECKSUM_HASH; i++ )
+	{
+		for( entry = fs_checksums.hash[i]; entry; entry = next )
+		{
+			next = entry->next;
+
+			if( f )
+			{
+				dchecksum_t out;
+
+				out.kind = entry->kind;
+				out.filetime = entry->filetime;
+				out.filesize = entry->filesize;
+				memcpy( out.checksum, entry->checksum, sizeof( out.checksum ));
+				out.namelen = Q_strlen( entry->name );
+				out.archivelen = Q_strlen( entry->archive );
+
+				FS_Write( f, &out, sizeof( out ));
+				FS_Write( f, entry->name, out.namelen + 1 );
+				FS_Write( f, entry->archive, out.archivelen + 1 );
+			}
+
+			Mem_Free( entry );
+		}
+	}
+
+	if( f )
+	{
+		Con_Reportf( "%s: %d checksums saved\n", __func__, fs_checksums.count );
+		FS_Close( f );
+	}
+
+	memset( &fs_checksums, 0, sizeof( fs_checksums ));
+}
+
+/*
+====================
+FS_ChecksumKey
+
+Everything that must stay same for cached checksum to be valid
+====================
+*/
+static qboolean FS_ChecksumKey( const char *path, char *archive, size_t len, int *filetime, fs_offset_t *filesize )
+{
+	searchpath_t *search;
+	char netpath[MAX_SYSPATH];
+	file_t *file = NULL;
+	int pack_ind;
+
+	FS_Lock();
+	search = FS_FindFile( path, &pack_ind, netpath, sizeof( netpath ), false );
+
+	if( search && ( file = search->pfnOpenFile( search, netpath, "rb", pack_ind )) != NULL )
+	{
+		Q_strncpy( archive, search->filename, len );
+		*filetime = search->pfnFileTime( search, netpath );
+		*filesize = file->real_length;
+		FS_Close( file );
+	}
+
+	FS_Unlock();
+
+	return file != NULL;
+}
+
+/*
+====================
+FS_GetChecksum
+
+Returns true and copies checksum if it's cached and file wasn't changed since
+====================
+*/
+qboolean FS_GetChecksum( const char *path, int kind, void *checksum, size_t size )
+{
+	char archive[MAX_SYSPATH];
+	fs_checksum_t *entry;
+	fs_offset_t filesize;
+	int filetime;
+
+	if( size > FS_CHECKSUM_MAXSIZE || !fs_searchpaths )
+		return false;
+
+	if( !fs_checksums.loaded )
+		FS_LoadChecksumCache();
+
+	// cheap miss, file isn't touched at all
+	if( !( entry = FS_FindChecksum( path, kind )))
+		return false;
+
+	if( !FS_ChecksumKey( path, archive, sizeof( archive ), &filetime, &filesize ))
+		return false;
+
+	if( entry->filetime != filetime || entry->filesize != filesize || Q_stricmp( entry->archive, archive ))
+		return false;
+
+	memcpy( checksum, entry->checksum, size );
+
+	return true;
+}
+
+/*
+====================
+FS_SetChecksum
+
+====================
+*/
+void FS_SetChecksum( const char *path, int kind, const void *checksum, size_t size )
+{
+	char archive[MAX_SYSPATH];
+	fs_checksum_t *entry;
+	fs_offset_t filesize;
+	int filetime;
+
+	if( size > FS_CHECKSUM_MAXSIZE || !fs_searchpaths )
+		return;
+
+	if( !FS_ChecksumKey( path, archive, sizeof( archive ), &filetime, &filesize ))
+		return;
+
+	if( !fs_checksums.loaded )
+		FS_LoadChecksumCache();
+
+	entry = FS_FindChecksum( path, kind );
+
+	// file was moved to other archive
+	if( entry && Q_stricmp( entry->archive, archive ))
+	{
+		fs_checksum_t **prev = &fs_checksums.hash[COM_HashKey( path, FS_CHECKSUM_HASH )];
+
+		while( *prev != entry )
+			prev = &( *prev )->next;
+
+		*prev = entry->next;
+		fs_checksums.count--;
+		Mem_Free( entry );
+		entry = NULL;
+	}
+
+	if( !entry )
+		entry = FS_AddChecksum( path, archive, kind );
+
+	entry->filetime = filetime;
+	entry->filesize = filesize;
+	memset( entry->checksum, 0, sizeof( entry->checksum ));
+	memcpy( entry->checksum, checksum, size );
+	fs_checksums.dirty = true;
+}
+
 qboolean CRC32_File( dword *crcvalue, const char *filename )
 {
 	char	buffer[1024];
 	int	num_bytes;
 	file_t	*f;
 
+	if( FS_GetChecksum( filename, FS_CHECKSUM_CRC32, crcvalue, sizeof( *crcvalue )))
+		return true;
+
 	f = FS_Open( filename, "rb", false );
 	if( !f ) return false;
 
@@ -2559,6 +3535,7 @@ qboolean CRC32_File( dword *crcvalue, const char *filename )
 	}
 
 	FS_Close( f );
+	FS_SetChecksum( filename, FS_CHECKSUM_CRC32, crcvalue, sizeof( *crcvalue ));
 	return true;
 }
 
@@ -2569,6 +3546,10 @@ qboolean MD5_HashFile( byte digest[16], const char *pszFileName, uint seed[4] )
 	MD5Context_t	MD5_Hash;
 	int		bytes;
 
+	// seeded hashes are unique for each check, don't cache them
+	if( !seed && FS_GetChecksum( pszFileName, FS_CHECKSUM_MD5, digest, 16 ))
+		return true;
+
 	if(( file = FS_Open( pszFileName, "rb", false )) == NULL )
 		return false;
 
@@ -2595,6 +3576,9 @@ qboolean MD5_HashFile( byte digest[16], const char *pszFileName, uint seed[4] )
 	FS_Close( file );
 	MD5Final( digest, &MD5_Hash );
 
+	if( !seed )
+		FS_SetChecksum( pszFileName, FS_CHECKSUM_MD5, digest, 16 );
+
 	return true;
 }
 
@@ -2819,6 +3803,8 @@ qboolean FS_Rename( const char *oldname, const char *newname )
 		return false;
 	}
 
+	FS_InvalidateMissingCache();
+
 	return true;
 }
 
@@ -2969,6 +3955,8 @@ void FS_InitMemory( void )
 {
 	fs_mempool = Mem_AllocPool( "FileSystem Pool" );
 	fs_searchpaths = NULL;
+	fs_searchpaths_generation++;
+	memset( &fs_index, 0, sizeof( fs_index ));
 }
 
 fs_interface_t g_engfuncs =
@@ -2983,6 +3971,7 @@ fs_interface_t g_engfuncs =
 	Mem_ReallocStub,
 	Mem_FreeStub,
 	Sys_GetNativeObjectStub,
+	Mem_FlushThreadCacheStub,
 };
 
 static qboolean FS_InitInterface( int version, const fs_interface_t *engfuncs )
@@ -3030,6 +4019,9 @@ static qboolean FS_InitInterface( int version, const fs_interface_t *engfuncs )
 		Con_Reportf( "filesystem_stdio: custom platform-specific functions found\n" );
 	}
 
+	if( engfuncs->_Mem_FlushThreadCache )
+		g_engfuncs._Mem_FlushThreadCache = engfuncs->_Mem_FlushThreadCache;
+
 	return true;
 }
 
@@ -3095,6 +4087,15 @@ const fs_api_t g_api =
 	FS_LoadFileMalloc,
 
 	FS_IsArchiveExtensionSupported,
+
+	FS_MapFile,
+	FS_UnmapFile,
+
+	FS_LoadFileAsync,
+	FS_ProcessAsync,
+
+	FS_GetChecksum,
+	FS_SetChecksum,
 };
 
 int EXPORT GetFSAPI( int version, fs_api_t *api, fs_globals_t **globals, fs_interface_t *engfuncs );
@@ -3103,6 +4104,8 @@ int EXPORT GetFSAPI( int version, fs_api_t *api, fs_globals_t **globals, fs_inte
 	if( engfuncs && !FS_InitInterface( version, engfuncs ))
 		return 0;
 
+	FS_InitLocks();
+
 	*api = g_api;
 	*globals = &FI;
 
@@ -32,8 +32,8 @@ extern "C"
 {
 #endif // __cplusplus
 
-#define FS_API_VERSION 3 // not stable yet!
-#define FS_API_CREATEINTERFACE_TAG   "XashFileSystem002" // follow FS_API_VERSION!!!
+#define FS_API_VERSION 4 // not stable yet!
+#define FS_API_CREATEINTERFACE_TAG   "XashFileSystem003" // follow FS_API_VERSION!!!
 #define FILESYSTEM_INTERFACE_VERSION "VFileSystem009" // never change this!
 
 // search path flags
@@ -136,8 +136,23 @@ typedef struct fs_globals_t
 	gameinfo_t	*GameInfo;	// current GameInfo
 	gameinfo_t	*games[MAX_MODS];	// environment games (founded at each engine start)
 	int		numgames;
+
+	// lookup statistics, never reset
+	int		lookups;		// all FS_FindFile calls
+	int		missingcached;	// answered from missing files cache without searching
 } fs_globals_t;
 
+// GetChecksum/SetChecksum kinds
+enum
+{
+	FS_CHECKSUM_CRC32 = 0, // CRC32_File
+	FS_CHECKSUM_MD5,       // MD5_HashFile without seed
+	FS_CHECKSUM_MAPCRC,    // engine's CRC32_MapFile
+};
+
+// called from ProcessAsync, data is allocated with malloc and owned by callback, NULL if file wasn't found
+typedef void (*fs_async_callback_t)( const char *path, byte *data, fs_offset_t size, void *userdata );
+
 typedef struct fs_api_t
 {
 	qboolean (*InitStdio)( qboolean unused_set_to_true, const char *rootdir, const char *basedir, const char *gamedir, const char *rodir );
@@ -203,6 +218,20 @@ typedef struct fs_api_t
 
 	// queries supported archive formats
 	qboolean (*IsArchiveExtensionSupported)( const char *ext, uint flags );
+
+	// like LoadFile but uncompressed files are mapped without copying, writes never reach the file
+	// buffer isn't null terminated and must be released with UnmapFile
+	byte *(*MapFile)( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly );
+	void (*UnmapFile)( byte *data );
+
+	// queues file loading on I/O threads, completed loads are delivered by ProcessAsync on the calling thread
+	qboolean (*LoadFileAsync)( const char *path, qboolean gamedironly, fs_async_callback_t callback, void *userdata );
+	int (*ProcessAsync)( qboolean wait ); // returns count of delivered loads, wait blocks until all are delivered
+
+	// persistent checksum cache, entry is valid while file stays in same archive with same size and time
+	// checksum can be up to 16 bytes
+	qboolean (*GetChecksum)( const char *path, int kind, void *checksum, size_t size );
+	void (*SetChecksum)( const char *path, int kind, const void *checksum, size_t size );
 } fs_api_t;
 
 typedef struct fs_interface_t
@@ -225,6 +254,9 @@ typedef struct fs_interface_t
 
 	// platform
 	void *(*_Sys_GetNativeObject)( const char *object );
+
+	// releases memory cached by the calling thread, called by filesystem threads before exit
+	void  (*_Mem_FlushThreadCache)( void );
 } fs_interface_t;
 
 typedef int (*FSAPI)( int version, fs_api_t *api, fs_globals_t **globals, const fs_interface_t *interface );
@@ -56,6 +56,12 @@ struct file_s
 	fs_offset_t buff_len; // buffer current length
 	byte		buff[FILE_BUFF_SIZE]; // intermediate buffer
 
+	// optional, for compressed archive members: contents are decoded sequentially from current position
+	void        *stream;
+	fs_offset_t (*pfnReadStream)( file_t *file, void *buffer, fs_offset_t count );
+	void        (*pfnRewindStream)( file_t *file ); // back to the start of file
+	void        (*pfnCloseStream)( file_t *file );
+
 #ifdef XASH_REDUCE_FD
 	const char *backup_path;
 	fs_offset_t backup_position;
@@ -105,6 +111,12 @@ typedef struct searchpath_s
 	int     (*pfnFindFile)( struct searchpath_s *search, const char *path, char *fixedname, size_t len );
 	void    (*pfnSearch)( struct searchpath_s *search, stringlist_t *list, const char *pattern, int caseinsensitive );
 	byte   *(*pfnLoadFile)( struct searchpath_s *search, const char *path, int pack_ind, fs_offset_t *filesize, void *( *pfnAlloc )( size_t ), void ( *pfnFree )( void * ));
+
+	// optional, for archives with fixed contents: name of file by index, NULL after last one
+	const char *(*pfnFileName)( struct searchpath_s *search, int pack_ind );
+
+	// optional: descriptor of archive and location of file if it's stored uncompressed, -1 otherwise
+	int     (*pfnFileHandle)( struct searchpath_s *search, int pack_ind, fs_offset_t *offset, fs_offset_t *size );
 } searchpath_t;
 
 typedef searchpath_t *(*FS_ADDARCHIVE_FULLPATH)( const char *path, int flags );
@@ -137,11 +149,12 @@ extern const fs_archive_t g_archives[];
 #define Mem_AllocPool( name ) g_engfuncs._Mem_AllocPool( name, __FILE__, __LINE__ )
 #define Mem_FreePool( pool ) g_engfuncs._Mem_FreePool( pool, __FILE__, __LINE__ )
 
-#define Con_Printf  (*g_engfuncs._Con_Printf)
-#define Con_DPrintf (*g_engfuncs._Con_DPrintf)
-#define Con_Reportf (*g_engfuncs._Con_Reportf)
+#define Con_Printf  FS_ConPrintf
+#define Con_DPrintf FS_ConDPrintf
+#define Con_Reportf FS_ConReportf
 #define Sys_Error   (*g_engfuncs._Sys_Error)
 #define Sys_GetNativeObject (*g_engfuncs._Sys_GetNativeObject)
+#define Mem_FlushThreadCache (*g_engfuncs._Mem_FlushThreadCache)
 
 //
 // filesystem.c
@@ -191,6 +204,9 @@ byte *FS_LoadFile( const char *path, fs_offset_t *filesizeptr, qboolean gamediro
 	MALLOC_LIKE( _Mem_Free, 1 ) WARN_UNUSED_RESULT;
 byte *FS_LoadFileMalloc( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly )
 	MALLOC_LIKE( free, 1 ) WARN_UNUSED_RESULT;
+void FS_UnmapFile( byte *data );
+byte *FS_MapFile( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly )
+	MALLOC_LIKE( FS_UnmapFile, 1 ) WARN_UNUSED_RESULT;
 byte *FS_LoadDirectFile( const char *path, fs_offset_t *filesizeptr )
 	MALLOC_LIKE( _Mem_Free, 1 ) WARN_UNUSED_RESULT;
 qboolean FS_WriteFile( const char *filename, const void *data, fs_offset_t len );
@@ -198,6 +214,8 @@ qboolean FS_WriteFile( const char *filename, const void *data, fs_offset_t len )
 // file hashing
 qboolean CRC32_File( dword *crcvalue, const char *filename );
 qboolean MD5_HashFile( byte digest[16], const char *pszFileName, uint seed[4] );
+qboolean FS_GetChecksum( const char *path, int kind, void *checksum, size_t size );
+void FS_SetChecksum( const char *path, int kind, const void *checksum, size_t size );
 
 // stringlist ops
 void stringlistinit( stringlist_t *list );
@@ -224,8 +242,22 @@ int           FS_SysFileTime( const char *filename );
 file_t       *FS_OpenHandle( searchpath_t *search, int handle, fs_offset_t offset, fs_offset_t len );
 file_t       *FS_SysOpen( const char *filepath, const char *mode );
 searchpath_t *FS_FindFile( const char *name, int *index, char *fixedname, size_t len, qboolean gamedironly );
+fs_offset_t   FS_ReadAt( int handle, void *buffer, fs_offset_t count, fs_offset_t offset );
 qboolean FS_FullPathToRelativePath( char *dst, const char *src, size_t size );
 
+//
+// async.c
+//
+void FS_InitLocks( void );
+void FS_Lock( void );
+void FS_Unlock( void );
+void FS_ConPrintf( const char *fmt, ... ) _format( 1 );
+void FS_ConDPrintf( const char *fmt, ... ) _format( 1 );
+void FS_ConReportf( const char *fmt, ... ) _format( 1 );
+qboolean FS_LoadFileAsync( const char *path, qboolean gamedironly, fs_async_callback_t callback, void *userdata );
+int FS_ProcessAsync( qboolean wait );
+void FS_ShutdownAsync( void );
+
 //
 // pak.c
 //
@@ -247,6 +279,8 @@ searchpath_t *FS_AddZip_Fullpath( const char *zipfile, int flags );
 searchpath_t *FS_AddDir_Fullpath( const char *path, int flags );
 qboolean FS_FixFileCase( dir_t *dir, const char *path, char *dst, const size_t len, qboolean createpath );
 void FS_InitDirectorySearchpath( searchpath_t *search, const char *path, int flags );
+qboolean FS_UpdateDirWatches( void );
+void FS_ShutdownDirWatches( void );
 
 //
 // android.c
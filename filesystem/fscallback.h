@@ -71,10 +71,18 @@ extern fs_globals_t *FI;
 #define FS_LoadDirectFile (*g_fsapi.LoadDirectFile)
 #endif
 #define FS_WriteFile (*g_fsapi.WriteFile)
+#ifndef FSCALLBACK_OVERRIDE_MALLOC_LIKE
+#define FS_MapFile (*g_fsapi.MapFile)
+#define FS_UnmapFile (*g_fsapi.UnmapFile)
+#endif
+#define FS_LoadFileAsync (*g_fsapi.LoadFileAsync)
+#define FS_ProcessAsync (*g_fsapi.ProcessAsync)
 
 // file hashing
 #define CRC32_File (*g_fsapi.CRC32_File)
 #define MD5_HashFile (*g_fsapi.MD5_HashFile)
+#define FS_GetChecksum (*g_fsapi.GetChecksum)
+#define FS_SetChecksum (*g_fsapi.SetChecksum)
 
 // filesystem ops
 #define FS_FileExists (*g_fsapi.FileExists)
@@ -0,0 +1,286 @@
+#include "fstests.h"
+
+#define TEST_DIR    "asyncload/"
+#define NUM_LOOSE   64
+#define NUM_PACKED  128
+#define NUM_ZIPPED  128
+#define NUM_FILES   ( NUM_LOOSE + NUM_PACKED + NUM_ZIPPED )
+#define NUM_PASSES  4
+
+typedef struct
+{
+	char        name[56];
+	int         size;
+	int         seed;
+	int         delivered;
+	qboolean    failed;
+} testfile_t;
+
+static testfile_t g_files[NUM_FILES];
+static int g_missing;
+static int g_chained;
+
+static byte *Generate( const testfile_t *file )
+{
+	byte *buf = malloc( file->size );
+	uint seed = file->seed;
+	int i;
+
+	// compressible, but not trivially
+	for( i = 0; i < file->size; i++ )
+	{
+		seed = seed * 1103515245 + 12345;
+		buf[i] = ( seed >> 16 ) & 0x1f;
+	}
+
+	return buf;
+}
+
+static qboolean WriteLoose( testfile_t *files, int numfiles )
+{
+	int i;
+
+	for( i = 0; i < numfiles; i++ )
+	{
+		char path[256];
+		byte *buf = Generate( &files[i] );
+		FILE *f;
+
+		if( snprintf( path, sizeof( path ), TEST_DIR "%s", files[i].name ) >= (int)sizeof( path )
+			|| !( f = fopen( path, "wb" )))
+		{
+			free( buf );
+			return false;
+		}
+
+		fwrite( buf, 1, files[i].size, f );
+		fclose( f );
+		free( buf );
+	}
+
+	return true;
+}
+
+static qboolean WriteArchive( const char *path, testfile_t *files, int numfiles, qboolean zip )
+{
+	archentry_t *entries = calloc( numfiles, sizeof( *entries ));
+	qboolean ok;
+	int i;
+
+	for( i = 0; i < numfiles; i++ )
+	{
+		entries[i].name = files[i].name;
+		entries[i].data = Generate( &files[i] );
+		entries[i].size = files[i].size;
+		entries[i].deflate = i & 1; // mix stored and deflated entries
+	}
+
+	ok = zip ? WriteZip( path, entries, numfiles ) : WritePak( path, entries, numfiles, 0 );
+
+	for( i = 0; i < numfiles; i++ )
+		free( (byte *)entries[i].data );
+	free( entries );
+
+	return ok;
+}
+
+static qboolean Compare( const char *what, const testfile_t *file, const byte *data, fs_offset_t size )
+{
+	byte *expected;
+	qboolean ok;
+
+	if( !data || size != file->size )
+	{
+		printf( "%s %s: got %ld bytes, expected %d\n", what, file->name, data ? (long)size : -1L, file->size );
+		return false;
+	}
+
+	expected = Generate( file );
+	ok = !memcmp( data, expected, size ) && data[size] == 0;
+	free( expected );
+
+	if( !ok )
+		printf( "%s %s: contents mismatch\n", what, file->name );
+
+	return ok;
+}
+
+static void LoadedCallback( const char *path, byte *data, fs_offset_t size, void *userdata )
+{
+	testfile_t *file = userdata;
+
+	if( strcmp( path, file->name ) || !Compare( "async", file, data, size ))
+		file->failed = true;
+
+	file->delivered++;
+	free( data );
+}
+
+static void MissingCallback( const char *path, byte *data, fs_offset_t size, void *userdata )
+{
+	if( data || size )
+		free( data );
+	else g_missing++;
+}
+
+static void ChainedCallback( const char *path, byte *data, fs_offset_t size, void *userdata )
+{
+	// dependent resource, queued from the callback itself
+	if( data && g_fs.LoadFileAsync( g_files[0].name, false, LoadedCallback, &g_files[0] ))
+		g_chained++;
+
+	free( data );
+}
+
+static qboolean TestAsync( void )
+{
+	int i, j, pass, frames = 0, delivered = 0;
+
+	for( pass = 0; pass < NUM_PASSES; pass++ )
+	{
+		for( i = 0; i < NUM_FILES; i++ )
+		{
+			if( !g_fs.LoadFileAsync( g_files[i].name, false, LoadedCallback, &g_files[i] ))
+			{
+				printf( "can't queue %s\n", g_files[i].name );
+				return false;
+			}
+		}
+	}
+
+	g_fs.LoadFileAsync( "missing.bin", false, MissingCallback, NULL );
+	g_fs.LoadFileAsync( g_files[NUM_FILES - 1].name, false, ChainedCallback, NULL );
+
+	// simulate frames, main thread keeps using filesystem meanwhile
+	while( delivered < NUM_FILES * NUM_PASSES + 3 )
+	{
+		for( j = 0; j < 8; j++ )
+		{
+			testfile_t *file = &g_files[( frames * 8 + j ) % NUM_FILES];
+			fs_offset_t size;
+			byte *data = g_fs.LoadFileMalloc( file->name, &size, false );
+			qboolean ok = Compare( "sync", file, data, size );
+
+			free( data );
+			if( !ok )
+				return false;
+		}
+
+		delivered += g_fs.ProcessAsync( false );
+		frames++;
+
+		if( frames > 1000000 )
+		{
+			printf( "requests weren't delivered\n" );
+			return false;
+		}
+	}
+
+	for( i = 0; i < NUM_FILES; i++ )
+	{
+		int expected = NUM_PASSES + ( i == 0 ? 1 : 0 );
+
+		if( g_files[i].failed || g_files[i].delivered != expected )
+		{
+			printf( "%s delivered %d times, expected %d\n", g_files[i].name, g_files[i].delivered, expected );
+			return false;
+		}
+	}
+
+	if( g_missing != 1 || g_chained != 1 )
+	{
+		printf( "missing %d, chained %d\n", g_missing, g_chained );
+		return false;
+	}
+
+	printf( "%d requests delivered over %d frames\n", delivered, frames );
+
+	return true;
+}
+
+static void CountCallback( const char *path, byte *data, fs_offset_t size, void *userdata )
+{
+	*(int *)userdata += size;
+	free( data );
+}
+
+static void Benchmark( void )
+{
+	clock_t start;
+	double synctime, asynctime;
+	fs_offset_t size;
+	int i, total = 0;
+
+	start = clock();
+	for( i = 0; i < NUM_FILES; i++ )
+		free( g_fs.LoadFileMalloc( g_files[i].name, &size, false ));
+	synctime = ( clock() - start ) * 1000.0 / CLOCKS_PER_SEC;
+
+	start = clock();
+	for( i = 0; i < NUM_FILES; i++ )
+		g_fs.LoadFileAsync( g_files[i].name, false, CountCallback, &total );
+	g_fs.ProcessAsync( true );
+	asynctime = ( clock() - start ) * 1000.0 / CLOCKS_PER_SEC;
+
+	// clock() is process time, so it's a cost and not latency measurement
+	printf( "%d files (%d KB): LoadFileMalloc %.2f ms, LoadFileAsync %.2f ms of CPU time\n",
+		NUM_FILES, total >> 10, synctime, asynctime );
+}
+
+static void Cleanup( void )
+{
+	char path[256];
+	int i;
+
+	for( i = 0; i < NUM_LOOSE; i++ )
+	{
+		if( snprintf( path, sizeof( path ), TEST_DIR "%s", g_files[i].name ) < (int)sizeof( path ))
+			remove( path );
+	}
+
+	remove( TEST_DIR "pak0.pak" );
+	remove( TEST_DIR "pak1.pk3" );
+	rmdir( TEST_DIR );
+}
+
+int main( int argc, char **argv )
+{
+	int i;
+
+	if( !LoadFilesystem() )
+		return EXIT_FAILURE;
+
+	for( i = 0; i < NUM_FILES; i++ )
+	{
+		const char *kind = i < NUM_LOOSE ? "loose" : i < NUM_LOOSE + NUM_PACKED ? "packed" : "zipped";
+
+		snprintf( g_files[i].name, sizeof( g_files[i].name ), "%s%03d.bin", kind, i );
+		g_files[i].seed = i * 7919;
+		g_files[i].size = 1 + ( i * 104729 ) % ( 256 * 1024 );
+	}
+
+	mkdir( TEST_DIR, 0777 );
+
+	if( !WriteLoose( g_files, NUM_LOOSE )
+		|| !WriteArchive( TEST_DIR "pak0.pak", g_files + NUM_LOOSE, NUM_PACKED, false )
+		|| !WriteArchive( TEST_DIR "pak1.pk3", g_files + NUM_LOOSE + NUM_PACKED, NUM_ZIPPED, true ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	g_fs.AddGameDirectory( TEST_DIR, FS_GAMEDIR_PATH );
+
+	if( !TestAsync( ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	Benchmark();
+	Cleanup();
+
+	printf( "success\n" );
+
+	return EXIT_SUCCESS;
+}
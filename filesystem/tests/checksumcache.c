@@ -0,0 +1,219 @@
+#include "fstests.h"
+#if XASH_POSIX
+#include <utime.h>
+#elif XASH_WIN32
+#include <sys/utime.h>
+#define utime _utime
+#define utimbuf _utimbuf
+#endif
+
+#define TEST_DIR   "checksumcache/"
+#define BIG_SIZE   ( 8 * 1024 * 1024 )
+#define SMALL_SIZE 4096
+
+static qboolean WriteFile( const char *path, int size, int seed, time_t mtime )
+{
+	struct utimbuf times;
+	byte *buf = malloc( size );
+	FILE *f;
+	int i;
+
+	for( i = 0; i < size; i++ )
+		buf[i] = (byte)( i * 31 + seed + ( i >> 10 ));
+
+	if( !( f = fopen( path, "wb" )))
+	{
+		free( buf );
+		return false;
+	}
+
+	fwrite( buf, 1, size, f );
+	fclose( f );
+	free( buf );
+
+	// same size and time, so only a cached checksum can stay the same
+	times.actime = times.modtime = mtime;
+	return utime( path, &times ) == 0;
+}
+
+static qboolean WritePackedFile( int seed )
+{
+	archentry_t file;
+	byte buf[SMALL_SIZE];
+	int i;
+
+	for( i = 0; i < SMALL_SIZE; i++ )
+		buf[i] = (byte)( i + seed );
+
+	memset( &file, 0, sizeof( file ));
+	file.name = "packed.bin";
+	file.data = buf;
+	file.size = SMALL_SIZE;
+
+	return WritePak( TEST_DIR "pak0.pak", &file, 1, 0 );
+}
+
+static qboolean TestLoose( void )
+{
+	const time_t mtime = 1000000000;
+	dword crc1, crc2, crc3;
+	byte md1[16], md2[16];
+	uint seed[4] = { 1, 2, 3, 4 };
+
+	if( !WriteFile( TEST_DIR "loose.bin", SMALL_SIZE, 1, mtime ))
+		return false;
+
+	if( !g_fs.CRC32_File( &crc1, "loose.bin" ) || !g_fs.MD5_HashFile( md1, "loose.bin", NULL ))
+		return false;
+
+	// different contents, same key
+	WriteFile( TEST_DIR "loose.bin", SMALL_SIZE, 2, mtime );
+	g_fs.CRC32_File( &crc2, "loose.bin" );
+	g_fs.MD5_HashFile( md2, "loose.bin", NULL );
+
+	if( crc1 != crc2 || memcmp( md1, md2, 16 ))
+	{
+		printf( "checksum wasn't cached\n" );
+		return false;
+	}
+
+	// seeded hashes always read the file
+	g_fs.MD5_HashFile( md2, "loose.bin", seed );
+	if( !memcmp( md1, md2, 16 ))
+	{
+		printf( "seeded hash was cached\n" );
+		return false;
+	}
+
+	// time changed
+	WriteFile( TEST_DIR "loose.bin", SMALL_SIZE, 2, mtime + 10 );
+	g_fs.CRC32_File( &crc2, "loose.bin" );
+	if( crc1 == crc2 )
+	{
+		printf( "checksum wasn't invalidated by time\n" );
+		return false;
+	}
+
+	// size changed
+	WriteFile( TEST_DIR "loose.bin", SMALL_SIZE + 1, 2, mtime + 10 );
+	g_fs.CRC32_File( &crc3, "loose.bin" );
+	if( crc2 == crc3 )
+	{
+		printf( "checksum wasn't invalidated by size\n" );
+		return false;
+	}
+
+	return true;
+}
+
+static qboolean TestArchive( void )
+{
+	dword crc1, crc2;
+
+	if( !g_fs.CRC32_File( &crc1, "packed.bin" ))
+		return false;
+
+	// same name in directory overrides archive, even if size and time match
+	WriteFile( TEST_DIR "packed.bin", SMALL_SIZE, 5, time( NULL ));
+	g_fs.CRC32_File( &crc2, "packed.bin" );
+
+	if( crc1 == crc2 )
+	{
+		printf( "checksum wasn't invalidated by archive\n" );
+		return false;
+	}
+
+	return true;
+}
+
+static qboolean TestPersistent( void )
+{
+	const time_t mtime = 1100000000;
+	dword crc1, crc2;
+	FILE *f;
+
+	WriteFile( TEST_DIR "saved.bin", SMALL_SIZE, 1, mtime );
+	g_fs.CRC32_File( &crc1, "saved.bin" );
+
+	// cache is written when game directory is unmounted
+	g_fs.ClearSearchPath();
+
+	if( !( f = fopen( TEST_DIR "checksums.dat", "rb" )))
+	{
+		printf( "cache wasn't saved\n" );
+		return false;
+	}
+
+	fclose( f );
+
+	WriteFile( TEST_DIR "saved.bin", SMALL_SIZE, 2, mtime );
+	g_fs.AddGameDirectory( TEST_DIR, FS_GAMEDIR_PATH );
+	g_fs.CRC32_File( &crc2, "saved.bin" );
+
+	if( crc1 != crc2 )
+	{
+		printf( "cache wasn't loaded\n" );
+		return false;
+	}
+
+	return true;
+}
+
+static void Benchmark( void )
+{
+	clock_t start, first, second;
+	dword crc;
+
+	WriteFile( TEST_DIR "big.bin", BIG_SIZE, 3, time( NULL ));
+
+	start = clock();
+	g_fs.CRC32_File( &crc, "big.bin" );
+	first = clock() - start;
+
+	start = clock();
+	g_fs.CRC32_File( &crc, "big.bin" );
+	second = clock() - start;
+
+	printf( "%d MB CRC32_File: %.2f ms, cached %.2f ms\n", BIG_SIZE >> 20,
+		first * 1000.0 / CLOCKS_PER_SEC, second * 1000.0 / CLOCKS_PER_SEC );
+}
+
+static void Cleanup( void )
+{
+	remove( TEST_DIR "loose.bin" );
+	remove( TEST_DIR "packed.bin" );
+	remove( TEST_DIR "saved.bin" );
+	remove( TEST_DIR "big.bin" );
+	remove( TEST_DIR "pak0.pak" );
+	remove( TEST_DIR "checksums.dat" );
+	rmdir( TEST_DIR );
+}
+
+int main( int argc, char **argv )
+{
+	if( !LoadFilesystem() )
+		return EXIT_FAILURE;
+
+	mkdir( TEST_DIR, 0777 );
+
+	if( !WritePackedFile( 1 ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	g_fs.AddGameDirectory( TEST_DIR, FS_GAMEDIR_PATH );
+
+	if( !TestLoose() || !TestArchive() || !TestPersistent( ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	Benchmark();
+	Cleanup();
+
+	printf( "success\n" );
+
+	return EXIT_SUCCESS;
+}
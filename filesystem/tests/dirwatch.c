@@ -0,0 +1,158 @@
+#include "fstests.h"
+
+#define TEST_DIR "dirwatch/"
+
+static qboolean WriteFile( const char *path )
+{
+	FILE *f;
+
+	if( !( f = fopen( path, "wb" )))
+		return false;
+
+	fputs( path, f );
+	fclose( f );
+
+	return true;
+}
+
+static qboolean Expect( const char *name, qboolean exists )
+{
+	if( g_fs.FileExists( name, false ) != exists )
+	{
+		printf( "%s: %s\n", name, exists ? "not found" : "still found" );
+		return false;
+	}
+
+	return true;
+}
+
+static qboolean TestFiles( void )
+{
+	// remembered as missing by every cache
+	if( !Expect( "uploaded.bsp", false ) || !Expect( "Uploaded.BSP", false ))
+		return false;
+
+	// file appears outside of filesystem, like uploaded by another process
+	WriteFile( TEST_DIR "Uploaded.bsp" );
+	if( !Expect( "uploaded.bsp", true ) || !Expect( "UPLOADED.BSP", true ))
+		return false;
+
+	remove( TEST_DIR "Uploaded.bsp" );
+	if( !Expect( "uploaded.bsp", false ))
+		return false;
+
+	// renamed into place
+	WriteFile( TEST_DIR "temp.tmp" );
+	if( !Expect( "temp.tmp", true ))
+		return false;
+
+	rename( TEST_DIR "temp.tmp", TEST_DIR "renamed.bsp" );
+	if( !Expect( "temp.tmp", false ) || !Expect( "renamed.bsp", true ))
+		return false;
+
+	remove( TEST_DIR "renamed.bsp" );
+	return Expect( "renamed.bsp", false );
+}
+
+static qboolean TestSubdirectories( void )
+{
+	if( !Expect( "maps/new.bsp", false ) || !Expect( "maps/deeper/new.bsp", false ))
+		return false;
+
+	mkdir( TEST_DIR "Maps", 0777 );
+	WriteFile( TEST_DIR "Maps/New.bsp" );
+	if( !Expect( "maps/new.bsp", true ))
+		return false;
+
+	// directory that was already scanned gets new subdirectory
+	mkdir( TEST_DIR "Maps/Deeper", 0777 );
+	WriteFile( TEST_DIR "Maps/Deeper/new.bsp" );
+	if( !Expect( "maps/deeper/new.bsp", true ))
+		return false;
+
+	remove( TEST_DIR "Maps/Deeper/new.bsp" );
+	rmdir( TEST_DIR "Maps/Deeper" );
+	remove( TEST_DIR "Maps/New.bsp" );
+	if( !Expect( "maps/new.bsp", false ) || !Expect( "maps/deeper/new.bsp", false ))
+		return false;
+
+	// removed and created again under the same name
+	rmdir( TEST_DIR "Maps" );
+	mkdir( TEST_DIR "maps", 0777 );
+	WriteFile( TEST_DIR "maps/new.bsp" );
+	if( !Expect( "maps/new.bsp", true ))
+		return false;
+
+	remove( TEST_DIR "maps/new.bsp" );
+	rmdir( TEST_DIR "maps" );
+
+	return Expect( "maps/new.bsp", false );
+}
+
+static void Benchmark( void )
+{
+	char path[64];
+	clock_t start;
+	int i, found = 0;
+
+	mkdir( TEST_DIR "sound", 0777 );
+	WriteFile( TEST_DIR "sound/exists.wav" );
+
+	start = clock();
+	for( i = 0; i < 100000; i++ )
+		found += g_fs.FileExists( "sound/exists.wav", false );
+
+	printf( "100000 lookups: %.2f ms (%d found)\n", ( clock() - start ) * 1000.0 / CLOCKS_PER_SEC, found );
+
+	start = clock();
+	for( i = 0; i < 100000; i++ )
+	{
+		// too many names for missing files cache
+		snprintf( path, sizeof( path ), "sound/%d.wav", i );
+		found += g_fs.FileExists( path, false );
+	}
+
+	printf( "100000 missing lookups: %.2f ms (%d found)\n", ( clock() - start ) * 1000.0 / CLOCKS_PER_SEC, found );
+
+	remove( TEST_DIR "sound/exists.wav" );
+	rmdir( TEST_DIR "sound" );
+}
+
+static void Cleanup( void )
+{
+	remove( TEST_DIR "Uploaded.bsp" );
+	remove( TEST_DIR "temp.tmp" );
+	remove( TEST_DIR "renamed.bsp" );
+	remove( TEST_DIR "Maps/Deeper/new.bsp" );
+	rmdir( TEST_DIR "Maps/Deeper" );
+	remove( TEST_DIR "Maps/New.bsp" );
+	rmdir( TEST_DIR "Maps" );
+	remove( TEST_DIR "maps/new.bsp" );
+	rmdir( TEST_DIR "maps" );
+	rmdir( TEST_DIR );
+}
+
+int main( int argc, char **argv )
+{
+	if( !LoadFilesystem() )
+		return EXIT_FAILURE;
+
+	mkdir( TEST_DIR, 0777 );
+	g_fs.AddGameDirectory( TEST_DIR, FS_GAMEDIR_PATH );
+
+#if XASH_LINUX
+	// other platforms don't notice files created behind filesystem's back
+	if( !TestFiles() || !TestSubdirectories( ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+#endif
+
+	Benchmark();
+	Cleanup();
+
+	printf( "success\n" );
+
+	return EXIT_SUCCESS;
+}
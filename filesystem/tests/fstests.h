@@ -0,0 +1,297 @@
+/*
+fstests.h - common code for filesystem tests
+Copyright (C) 2024 Xash3D FWGS contributors
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#ifndef FSTESTS_H
+#define FSTESTS_H
+
+#include "port.h"
+#include "build.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include STDINT_H
+#include "filesystem.h"
+#include "miniz.h"
+#if XASH_POSIX
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define LoadLibrary( x ) dlopen( x, RTLD_NOW )
+#define GetProcAddress( x, y ) dlsym( x, y )
+#define FreeLibrary( x ) dlclose( x )
+#elif XASH_WIN32
+#include <windows.h>
+#include <direct.h>
+#define mkdir( x, y ) _mkdir( x )
+#define rmdir _rmdir
+#endif
+
+typedef struct
+{
+	int ident;
+	int dirofs;
+	int dirlen;
+} dpackheader_t;
+
+typedef struct
+{
+	char name[56];
+	int  filepos;
+	int  filelen;
+} dpackfile_t;
+
+typedef struct
+{
+	int ident;
+	int numlumps;
+	int infotableofs;
+} dwadinfo_t;
+
+typedef struct
+{
+	int         filepos;
+	int         disksize;
+	int         size;
+	signed char type;
+	signed char attribs;
+	signed char pad0;
+	signed char pad1;
+	char        name[16];
+} dlumpinfo_t;
+
+#define TYP_GFXPIC 66
+#define TYP_MIPTEX 67
+
+#pragma pack( push, 1 )
+typedef struct
+{
+	uint32_t signature;
+	uint16_t version;
+	uint16_t flags;
+	uint16_t compression;
+	uint32_t dos_date;
+	uint32_t crc32;
+	uint32_t compressed_size;
+	uint32_t uncompressed_size;
+	uint16_t filename_len;
+	uint16_t extrafield_len;
+} zip_header_t;
+
+typedef struct
+{
+	uint32_t signature;
+	uint16_t version;
+	uint16_t version_need;
+	uint16_t flags;
+	uint16_t compression;
+	uint16_t modification_time;
+	uint16_t modification_date;
+	uint32_t crc32;
+	uint32_t compressed_size;
+	uint32_t uncompressed_size;
+	uint16_t filename_len;
+	uint16_t extrafield_len;
+	uint16_t file_commentary_len;
+	uint16_t disk_start;
+	uint16_t internal_attr;
+	uint32_t external_attr;
+	uint32_t local_header_offset;
+} zip_cdf_header_t;
+
+typedef struct
+{
+	uint32_t signature;
+	uint16_t disk_number;
+	uint16_t start_disk_number;
+	uint16_t number_central_directory_record;
+	uint16_t total_central_directory_record;
+	uint32_t size_of_central_directory;
+	uint32_t central_directory_offset;
+	uint16_t commentary_len;
+} zip_header_eocd_t;
+#pragma pack( pop )
+
+// file to be stored in generated pak or zip archive
+typedef struct
+{
+	const char *name;
+	const byte *data;
+	size_t     size;
+	qboolean   deflate; // zip only
+} archentry_t;
+
+void *g_hModule;
+FSAPI g_pfnGetFSAPI;
+fs_api_t g_fs;
+fs_globals_t *g_nullglobals;
+
+static inline qboolean LoadFilesystem( void )
+{
+	g_hModule = LoadLibrary( "filesystem_stdio." OS_LIB_EXT );
+	if( !g_hModule )
+		return false;
+
+	g_pfnGetFSAPI = (void*)GetProcAddress( g_hModule, GET_FS_API );
+	if( !g_pfnGetFSAPI )
+		return false;
+
+	if( !g_pfnGetFSAPI( FS_API_VERSION, &g_fs, &g_nullglobals, NULL ))
+		return false;
+
+	return true;
+}
+
+// pad bytes go after the header, so entries can be put at odd offsets
+static inline qboolean WritePak( const char *path, const archentry_t *entries, int numentries, int pad )
+{
+	dpackfile_t *dir = calloc( numentries, sizeof( *dir ));
+	dpackheader_t hdr;
+	FILE *f;
+	int i;
+
+	if( !( f = fopen( path, "wb" )))
+	{
+		free( dir );
+		return false;
+	}
+
+	memset( &hdr, 0, sizeof( hdr ));
+	fwrite( &hdr, sizeof( hdr ), 1, f );
+
+	for( i = 0; i < pad; i++ )
+		fputc( 0, f );
+
+	for( i = 0; i < numentries; i++ )
+	{
+		strncpy( dir[i].name, entries[i].name, sizeof( dir[i].name ) - 1 );
+		dir[i].filepos = ftell( f );
+		dir[i].filelen = entries[i].size;
+		fwrite( entries[i].data, 1, entries[i].size, f );
+	}
+
+	hdr.ident = (('K'<<24)+('C'<<16)+('A'<<8)+'P');
+	hdr.dirofs = ftell( f );
+	hdr.dirlen = numentries * sizeof( *dir );
+	fwrite( dir, sizeof( *dir ), numentries, f );
+	fseek( f, 0, SEEK_SET );
+	fwrite( &hdr, sizeof( hdr ), 1, f );
+	fclose( f );
+	free( dir );
+
+	return true;
+}
+
+static inline byte *Deflate( const byte *data, size_t size, size_t *outsize )
+{
+	z_stream stream;
+	byte *out;
+
+	memset( &stream, 0, sizeof( stream ));
+	if( deflateInit2( &stream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY ) != Z_OK )
+		return NULL;
+
+	out = malloc( deflateBound( &stream, size ));
+	stream.next_in = data;
+	stream.avail_in = size;
+	stream.next_out = out;
+	stream.avail_out = deflateBound( &stream, size );
+
+	if( deflate( &stream, Z_FINISH ) != Z_STREAM_END )
+	{
+		deflateEnd( &stream );
+		free( out );
+		return NULL;
+	}
+
+	*outsize = stream.total_out;
+	deflateEnd( &stream );
+
+	return out;
+}
+
+static inline qboolean WriteZip( const char *path, const archentry_t *entries, int numentries )
+{
+	zip_cdf_header_t *cdf = calloc( numentries, sizeof( *cdf ));
+	zip_header_eocd_t eocd;
+	long cdfofs;
+	FILE *f;
+	int i;
+
+	if( !( f = fopen( path, "wb" )))
+	{
+		free( cdf );
+		return false;
+	}
+
+	for( i = 0; i < numentries; i++ )
+	{
+		size_t packedsize = entries[i].size;
+		byte *packed = NULL;
+		zip_header_t hdr;
+
+		if( entries[i].deflate && !( packed = Deflate( entries[i].data, entries[i].size, &packedsize )))
+		{
+			free( cdf );
+			fclose( f );
+			return false;
+		}
+
+		memset( &hdr, 0, sizeof( hdr ));
+		hdr.signature = 0x04034b50;
+		hdr.version = 20;
+		hdr.compression = entries[i].deflate ? 8 : 0;
+		hdr.crc32 = mz_crc32( MZ_CRC32_INIT, entries[i].data, entries[i].size );
+		hdr.compressed_size = packedsize;
+		hdr.uncompressed_size = entries[i].size;
+		hdr.filename_len = strlen( entries[i].name );
+
+		cdf[i].signature = 0x02014b50;
+		cdf[i].version = 20;
+		cdf[i].version_need = 20;
+		cdf[i].compression = hdr.compression;
+		cdf[i].crc32 = hdr.crc32;
+		cdf[i].compressed_size = hdr.compressed_size;
+		cdf[i].uncompressed_size = hdr.uncompressed_size;
+		cdf[i].filename_len = hdr.filename_len;
+		cdf[i].local_header_offset = ftell( f );
+
+		fwrite( &hdr, sizeof( hdr ), 1, f );
+		fwrite( entries[i].name, 1, hdr.filename_len, f );
+		fwrite( packed ? packed : entries[i].data, 1, packedsize, f );
+		free( packed );
+	}
+
+	cdfofs = ftell( f );
+	for( i = 0; i < numentries; i++ )
+	{
+		fwrite( &cdf[i], sizeof( cdf[i] ), 1, f );
+		fwrite( entries[i].name, 1, cdf[i].filename_len, f );
+	}
+
+	memset( &eocd, 0, sizeof( eocd ));
+	eocd.signature = 0x06054b50;
+	eocd.number_central_directory_record = numentries;
+	eocd.total_central_directory_record = numentries;
+	eocd.size_of_central_directory = ftell( f ) - cdfofs;
+	eocd.central_directory_offset = cdfofs;
+	fwrite( &eocd, sizeof( eocd ), 1, f );
+	fclose( f );
+	free( cdf );
+
+	return true;
+}
+
+#endif // FSTESTS_H
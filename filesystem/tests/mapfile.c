@@ -0,0 +1,235 @@
+#include "fstests.h"
+
+#define TEST_DIR   "mapfile/"
+#define LOOSE_SIZE ( 256 * 1024 + 17 )
+#define PAK_SIZE   ( 8 * 1024 * 1024 )
+#define SMALL_SIZE 100
+#define LUMP_SIZE  ( 128 * 1024 + 5 )
+
+static byte Pattern( int seed, int i )
+{
+	return (byte)( i * 31 + seed + ( i >> 12 ));
+}
+
+static void Fill( byte *buf, int size, int seed )
+{
+	int i;
+
+	for( i = 0; i < size; i++ )
+		buf[i] = Pattern( seed, i );
+}
+
+// single miptex lump, big enough to be mapped
+static byte *BuildWad( int seed, int *wadsize )
+{
+	dwadinfo_t hdr;
+	dlumpinfo_t lump;
+	byte *wad;
+
+	*wadsize = sizeof( hdr ) + LUMP_SIZE + sizeof( lump );
+	wad = malloc( *wadsize );
+
+	memset( &lump, 0, sizeof( lump ));
+	strncpy( lump.name, "lump", sizeof( lump.name ) - 1 );
+	lump.filepos = sizeof( hdr );
+	lump.disksize = lump.size = LUMP_SIZE;
+	lump.type = TYP_MIPTEX;
+
+	hdr.ident = (('3'<<24)+('D'<<16)+('A'<<8)+'W');
+	hdr.numlumps = 1;
+	hdr.infotableofs = sizeof( hdr ) + LUMP_SIZE;
+
+	memcpy( wad, &hdr, sizeof( hdr ));
+	Fill( wad + sizeof( hdr ), LUMP_SIZE, seed );
+	memcpy( wad + hdr.infotableofs, &lump, sizeof( lump ));
+
+	return wad;
+}
+
+static qboolean WriteFiles( void )
+{
+	archentry_t files[3];
+	byte *big, *small, *pakwad, *zipwad;
+	int pakwadsize, zipwadsize;
+	qboolean ok;
+	FILE *f;
+
+	big = malloc( PAK_SIZE );
+	small = malloc( SMALL_SIZE );
+
+	Fill( big, LOOSE_SIZE, 1 );
+	if( !( f = fopen( TEST_DIR "loose.bin", "wb" )))
+	{
+		free( big );
+		free( small );
+		return false;
+	}
+
+	fwrite( big, 1, LOOSE_SIZE, f );
+	fclose( f );
+
+	memset( files, 0, sizeof( files ));
+	Fill( big, PAK_SIZE, 2 );
+	files[0].name = "big.bin";
+	files[0].data = big;
+	files[0].size = PAK_SIZE;
+	Fill( small, SMALL_SIZE, 3 );
+	files[1].name = "small.bin";
+	files[1].data = small;
+	files[1].size = SMALL_SIZE;
+
+	// lumps are mapped relative to wad inside of pak
+	pakwad = BuildWad( 4, &pakwadsize );
+	files[2].name = "pakwad.wad";
+	files[2].data = pakwad;
+	files[2].size = pakwadsize;
+
+	// odd offsets, so entries aren't page aligned
+	ok = WritePak( TEST_DIR "pak0.pak", files, 3, 3 );
+
+	// deflated wad can't be mapped and must fall back to a normal load,
+	// stored file after it makes a wrongly mapped region look valid
+	zipwad = BuildWad( 5, &zipwadsize );
+	files[1] = files[0];
+	files[0].name = "zipwad.wad";
+	files[0].data = zipwad;
+	files[0].size = zipwadsize;
+	files[0].deflate = true;
+	files[1].name = "zipped.bin";
+
+	if( ok )
+		ok = WriteZip( TEST_DIR "pak1.pk3", files, 2 );
+
+	free( big );
+	free( small );
+	free( pakwad );
+	free( zipwad );
+	return ok;
+}
+
+static qboolean CheckMapped( const char *name, int size, int seed )
+{
+	fs_offset_t len = 0;
+	byte *data;
+	int i;
+
+	if( !( data = g_fs.MapFile( name, &len, false )))
+	{
+		printf( "%s: not mapped\n", name );
+		return false;
+	}
+
+	if( len != size )
+	{
+		printf( "%s: size %d, expected %d\n", name, (int)len, size );
+		g_fs.UnmapFile( data );
+		return false;
+	}
+
+	for( i = 0; i < size; i++ )
+	{
+		if( data[i] != Pattern( seed, i ))
+		{
+			printf( "%s: mismatch at %d\n", name, i );
+			g_fs.UnmapFile( data );
+			return false;
+		}
+	}
+
+	// private view, loaders may patch it in place
+	memset( data, 0, size );
+	g_fs.UnmapFile( data );
+
+	if( !( data = g_fs.MapFile( name, &len, false )))
+		return false;
+
+	if( data[0] != Pattern( seed, 0 ) || data[size - 1] != Pattern( seed, size - 1 ))
+	{
+		printf( "%s: writes reached the file\n", name );
+		g_fs.UnmapFile( data );
+		return false;
+	}
+
+	g_fs.UnmapFile( data );
+	return true;
+}
+
+static void Benchmark( void )
+{
+	clock_t start, loadtime, maptime;
+	fs_offset_t len;
+	uint sum = 0;
+	byte *data;
+	int i, j;
+
+	start = clock();
+	for( i = 0; i < 20; i++ )
+	{
+		data = g_fs.LoadFile( "big.bin", &len, false );
+		for( j = 0; j < len; j += 4096 )
+			sum += data[j];
+		free( data );
+	}
+	loadtime = clock() - start;
+
+	start = clock();
+	for( i = 0; i < 20; i++ )
+	{
+		data = g_fs.MapFile( "big.bin", &len, false );
+		for( j = 0; j < len; j += 4096 )
+			sum += data[j];
+		g_fs.UnmapFile( data );
+	}
+	maptime = clock() - start;
+
+	printf( "%d MB x 20: LoadFile %.2f ms, MapFile %.2f ms (%u)\n", PAK_SIZE >> 20,
+		loadtime * 1000.0 / CLOCKS_PER_SEC, maptime * 1000.0 / CLOCKS_PER_SEC, sum );
+}
+
+static void Cleanup( void )
+{
+	remove( TEST_DIR "loose.bin" );
+	remove( TEST_DIR "pak0.pak" );
+	remove( TEST_DIR "pak1.pk3" );
+	rmdir( TEST_DIR );
+}
+
+int main( int argc, char **argv )
+{
+	if( !LoadFilesystem() )
+		return EXIT_FAILURE;
+
+	mkdir( TEST_DIR, 0777 );
+
+	if( !WriteFiles( ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	g_fs.AddGameDirectory( TEST_DIR, FS_GAMEDIR_PATH );
+
+	if( !CheckMapped( "loose.bin", LOOSE_SIZE, 1 )
+		|| !CheckMapped( "big.bin", PAK_SIZE, 2 )
+		|| !CheckMapped( "small.bin", SMALL_SIZE, 3 )
+		|| !CheckMapped( "pakwad.wad/lump.mip", LUMP_SIZE, 4 )
+		|| !CheckMapped( "zipwad.wad/lump.mip", LUMP_SIZE, 5 ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	if( g_fs.MapFile( "missing.bin", NULL, false ))
+	{
+		printf( "missing file mapped\n" );
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	Benchmark();
+	Cleanup();
+
+	printf( "success\n" );
+
+	return EXIT_SUCCESS;
+}
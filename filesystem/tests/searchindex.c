@@ -0,0 +1,229 @@
+#include "fstests.h"
+
+#define TEST_DIR       "searchindex/"
+#define NUM_PAKS       256
+#define FILES_PER_PAK  64
+#define LOOKUPS        200000
+
+// every pak has it's own files, shared.txt with it's number and
+// common.txt only in even paks, so precedence can be checked
+static qboolean WriteSearchPak( int pak )
+{
+	char names[FILES_PER_PAK][56];
+	archentry_t files[FILES_PER_PAK + 2];
+	char data[16], path[64];
+	int i, numfiles = 0, len;
+
+	memset( files, 0, sizeof( files ));
+	len = snprintf( data, sizeof( data ), "%d", pak );
+
+	for( i = 0; i < FILES_PER_PAK; i++ )
+	{
+		snprintf( names[i], sizeof( names[i] ), "Maps/pak%03d_file%02d.bsp", pak, i );
+		files[numfiles++].name = names[i];
+	}
+
+	files[numfiles++].name = "shared.txt";
+
+	if( !( pak & 1 ))
+		files[numfiles++].name = "dir/Common.TXT";
+
+	for( i = 0; i < numfiles; i++ )
+	{
+		files[i].data = (const byte *)data;
+		files[i].size = len;
+	}
+
+	snprintf( path, sizeof( path ), TEST_DIR "pak%03d.pak", pak );
+	return WritePak( path, files, numfiles, 0 );
+}
+
+static qboolean CheckContents( const char *path, const char *expected )
+{
+	fs_offset_t len;
+	byte *data = g_fs.LoadFile( path, &len, false );
+	qboolean ok;
+
+	if( !data )
+	{
+		printf( "%s: not found\n", path );
+		return false;
+	}
+
+	ok = len == strlen( expected ) && !memcmp( data, expected, len );
+	if( !ok )
+		printf( "%s: expected %s, got %.*s\n", path, expected, (int)len, data );
+
+	free( data );
+	return ok;
+}
+
+static qboolean TestPrecedence( void )
+{
+	char name[64], num[16];
+	FILE *f;
+	int i;
+
+	// last pak overrides all others
+	snprintf( num, sizeof( num ), "%d", NUM_PAKS - 1 );
+	if( !CheckContents( "SHARED.txt", num ))
+		return false;
+
+	// odd paks don't have it
+	snprintf( num, sizeof( num ), "%d", ( NUM_PAKS - 1 ) & ~1 );
+	if( !CheckContents( "dir/common.txt", num ))
+		return false;
+
+	for( i = 0; i < NUM_PAKS; i += 17 )
+	{
+		snprintf( name, sizeof( name ), "maps/PAK%03d_FILE%02d.BSP", i, i % FILES_PER_PAK );
+		snprintf( num, sizeof( num ), "%d", i );
+		if( !CheckContents( name, num ))
+			return false;
+	}
+
+	if( g_fs.FileExists( "maps/missing.bsp", false ))
+	{
+		printf( "missing file found\n" );
+		return false;
+	}
+
+	// loose files in directory have priority over paks
+	f = fopen( TEST_DIR "shared.txt", "wb" );
+	fwrite( "dir", 1, 3, f );
+	fclose( f );
+
+	if( !CheckContents( "shared.txt", "dir" ))
+		return false;
+
+	remove( TEST_DIR "shared.txt" );
+
+	snprintf( num, sizeof( num ), "%d", NUM_PAKS - 1 );
+	if( !CheckContents( "shared.txt", num ))
+		return false;
+
+	return true;
+}
+
+static qboolean TestMissingCache( void )
+{
+	int cached = g_nullglobals->missingcached;
+
+	if( g_fs.FileExists( "maps/later.bsp", false ) || g_fs.FileExists( "MAPS/LATER.BSP", false ))
+	{
+		printf( "missing file found\n" );
+		return false;
+	}
+
+	if( g_nullglobals->missingcached != cached + 1 )
+	{
+		printf( "missing file wasn't cached\n" );
+		return false;
+	}
+
+	// writes must drop cached misses
+	g_fs.WriteFile( "maps/later.bsp", "x", 1 );
+	if( !g_fs.FileExists( "maps/later.bsp", false ))
+	{
+		printf( "written file not found\n" );
+		return false;
+	}
+
+	if( g_fs.FileExists( "maps/renamed.bsp", false ))
+	{
+		printf( "missing file found\n" );
+		return false;
+	}
+
+	g_fs.Rename( "maps/later.bsp", "maps/renamed.bsp" );
+	if( !g_fs.FileExists( "maps/renamed.bsp", false ))
+	{
+		printf( "renamed file not found\n" );
+		return false;
+	}
+
+	g_fs.Delete( "maps/renamed.bsp" );
+
+	return true;
+}
+
+static void Benchmark( void )
+{
+	char names[256][64];
+	clock_t start;
+	int i, found = 0;
+
+	for( i = 0; i < 256; i++ )
+	{
+		int pak = ( i * 7919 ) % NUM_PAKS;
+
+		// every 4th lookup misses, like probing for optional files does
+		if( i & 3 )
+			snprintf( names[i], sizeof( names[i] ), "maps/pak%03d_file%02d.bsp", pak, i % FILES_PER_PAK );
+		else snprintf( names[i], sizeof( names[i] ), "maps/pak%03d_file%02d.ent", pak, i % FILES_PER_PAK );
+	}
+
+	start = clock();
+	for( i = 0; i < LOOKUPS; i++ )
+		found += g_fs.FileExists( names[i & 255], false ) ? 1 : 0;
+
+	printf( "%d paks, %d files: %d lookups (%d found) in %.2f ms\n", NUM_PAKS, NUM_PAKS * FILES_PER_PAK,
+		LOOKUPS, found, ( clock() - start ) * 1000.0 / CLOCKS_PER_SEC );
+	printf( "%d of %d lookups answered from missing files cache\n", g_nullglobals->missingcached, g_nullglobals->lookups );
+}
+
+static void Cleanup( void )
+{
+	char path[64];
+	int i;
+
+	for( i = 0; i < NUM_PAKS; i++ )
+	{
+		snprintf( path, sizeof( path ), TEST_DIR "pak%03d.pak", i );
+		remove( path );
+	}
+
+	remove( TEST_DIR "maps/later.bsp" );
+	remove( TEST_DIR "maps/renamed.bsp" );
+	rmdir( TEST_DIR "maps" );
+	rmdir( TEST_DIR );
+}
+
+int main( int argc, char **argv )
+{
+	clock_t start;
+	int i;
+
+	if( !LoadFilesystem() )
+		return EXIT_FAILURE;
+
+	// game directories usually have loose maps too
+	mkdir( TEST_DIR, 0777 );
+	mkdir( TEST_DIR "maps", 0777 );
+
+	for( i = 0; i < NUM_PAKS; i++ )
+	{
+		if( !WriteSearchPak( i ))
+		{
+			Cleanup();
+			return EXIT_FAILURE;
+		}
+	}
+
+	start = clock();
+	g_fs.AddGameDirectory( TEST_DIR, FS_GAMEDIR_PATH );
+	printf( "mounted in %.2f ms\n", ( clock() - start ) * 1000.0 / CLOCKS_PER_SEC );
+
+	if( !TestPrecedence( ) || !TestMissingCache( ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	Benchmark();
+	Cleanup();
+
+	printf( "success\n" );
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+#include "fstests.h"
+
+#define TEST_DIR   "wadindex/"
+#define NUM_WADS   4
+#define NUM_LUMPS  2000
+#define LUMP_SIZE  64
+#define BIG_SIZE   ( 256 * 1024 + 5 )
+
+static byte Pattern( int seed, int i )
+{
+	return (byte)( i * 31 + seed + ( i >> 12 ));
+}
+
+// wad is written to memory, so it can be stored in pak too
+static byte *BuildWad( int wadnum, int numlumps, int lumpsize, int *wadsize )
+{
+	dwadinfo_t hdr;
+	dlumpinfo_t *lumps;
+	byte *wad, *data;
+	int i, j;
+
+	*wadsize = sizeof( hdr ) + numlumps * ( lumpsize + sizeof( *lumps ));
+	wad = calloc( 1, *wadsize );
+	data = wad + sizeof( hdr );
+	lumps = (dlumpinfo_t *)( data + numlumps * lumpsize );
+
+	for( i = 0; i < numlumps; i++ )
+	{
+		// mixed case names, last lump duplicates first one with another type
+		if( i == numlumps - 1 )
+			snprintf( lumps[i].name, sizeof( lumps[i].name ), "Tex%d_0000", wadnum );
+		else snprintf( lumps[i].name, sizeof( lumps[i].name ), "Tex%d_%04d", wadnum, i );
+		lumps[i].filepos = sizeof( hdr ) + i * lumpsize;
+		lumps[i].disksize = lumps[i].size = lumpsize;
+		lumps[i].type = ( i == numlumps - 1 ) ? TYP_GFXPIC : TYP_MIPTEX;
+
+		for( j = 0; j < lumpsize; j++ )
+			data[i * lumpsize + j] = Pattern( wadnum * 10000 + i, j );
+	}
+
+	hdr.ident = (('3'<<24)+('D'<<16)+('A'<<8)+'W');
+	hdr.numlumps = numlumps;
+	hdr.infotableofs = sizeof( hdr ) + numlumps * lumpsize;
+	memcpy( wad, &hdr, sizeof( hdr ));
+
+	return wad;
+}
+
+static qboolean WriteFiles( void )
+{
+	archentry_t file;
+	char path[64];
+	int i, size;
+	qboolean ok;
+	byte *wad;
+	FILE *f;
+
+	for( i = 0; i < NUM_WADS; i++ )
+	{
+		wad = BuildWad( i, NUM_LUMPS, LUMP_SIZE, &size );
+		snprintf( path, sizeof( path ), TEST_DIR "test%d.wad", i );
+
+		if( !( f = fopen( path, "wb" )))
+		{
+			free( wad );
+			return false;
+		}
+
+		fwrite( wad, 1, size, f );
+		fclose( f );
+		free( wad );
+	}
+
+	// wad with big lump inside of pak at odd offset, so it can be mapped
+	wad = BuildWad( 9, 2, BIG_SIZE, &size );
+
+	memset( &file, 0, sizeof( file ));
+	file.name = "packed.wad";
+	file.data = wad;
+	file.size = size;
+
+	ok = WritePak( TEST_DIR "pak0.pak", &file, 1, 3 );
+	free( wad );
+
+	return ok;
+}
+
+static qboolean CheckLump( const char *path, int seed, int size, qboolean mapped )
+{
+	fs_offset_t len = 0;
+	byte *data;
+	int i;
+
+	data = mapped ? g_fs.MapFile( path, &len, false ) : g_fs.LoadFile( path, &len, false );
+
+	if( !data )
+	{
+		printf( "%s: not loaded\n", path );
+		return false;
+	}
+
+	for( i = 0; i < size && len == size; i++ )
+	{
+		if( data[i] != Pattern( seed, i ))
+			break;
+	}
+
+	if( mapped )
+		g_fs.UnmapFile( data );
+	else free( data );
+
+	if( i != size )
+	{
+		printf( "%s: size %d, mismatch at %d\n", path, (int)len, i );
+		return false;
+	}
+
+	return true;
+}
+
+static qboolean TestLookups( void )
+{
+	const char *missing[] =
+	{
+		"test1.wad/tex2_0001.mip", // wrong wad
+		"test1.wad/tex1_0001.lmp", // wrong type
+		"test1.wad/tex1_9999.mip", // no such lump
+		"other.wad/tex1_0001.mip",
+	};
+	char path[64];
+	int i;
+
+	for( i = 0; i < NUM_LUMPS - 1; i += 97 )
+	{
+		snprintf( path, sizeof( path ), "test%d.wad/TEX%d_%04d.mip", i % NUM_WADS, i % NUM_WADS, i );
+		if( !g_fs.FileExists( path, false ))
+		{
+			printf( "%s: not found\n", path );
+			return false;
+		}
+
+		if( !CheckLump( path, ( i % NUM_WADS ) * 10000 + i, LUMP_SIZE, false ))
+			return false;
+	}
+
+	// wad name is optional
+	if( !CheckLump( "tex2_0005.mip", 20005, LUMP_SIZE, false ))
+		return false;
+
+	// same name, different types
+	if( !CheckLump( "test3.wad/tex3_0000.mip", 30000, LUMP_SIZE, false )
+		|| !CheckLump( "test3.wad/tex3_0000.lmp", 30000 + NUM_LUMPS - 1, LUMP_SIZE, false ))
+		return false;
+
+	for( i = 0; i < sizeof( missing ) / sizeof( missing[0] ); i++ )
+	{
+		if( g_fs.FileExists( missing[i], false ))
+		{
+			printf( "%s: found\n", missing[i] );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static qboolean TestPacked( void )
+{
+	return CheckLump( "packed.wad/tex9_0000.mip", 90000, BIG_SIZE, true )
+		&& CheckLump( "packed.wad/tex9_0000.lmp", 90001, BIG_SIZE, false );
+}
+
+static void Benchmark( void )
+{
+	char path[64];
+	clock_t start;
+	int i, found = 0;
+
+	start = clock();
+	for( i = 0; i < 100000; i++ )
+	{
+		// what map loader does for every texture in every wad
+		snprintf( path, sizeof( path ), "test%d.wad/tex%d_%04d.mip", i % NUM_WADS, ( i >> 2 ) % NUM_WADS, i % NUM_LUMPS );
+		found += g_fs.FileExists( path, false );
+	}
+
+	printf( "100000 wad lookups: %.2f ms (%d found)\n", ( clock() - start ) * 1000.0 / CLOCKS_PER_SEC, found );
+}
+
+static void Cleanup( void )
+{
+	char path[64];
+	int i;
+
+	for( i = 0; i < NUM_WADS; i++ )
+	{
+		snprintf( path, sizeof( path ), TEST_DIR "test%d.wad", i );
+		remove( path );
+	}
+
+	remove( TEST_DIR "pak0.pak" );
+	rmdir( TEST_DIR );
+}
+
+int main( int argc, char **argv )
+{
+	if( !LoadFilesystem() )
+		return EXIT_FAILURE;
+
+	mkdir( TEST_DIR, 0777 );
+
+	if( !WriteFiles( ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	g_fs.AddGameDirectory( TEST_DIR, FS_GAMEDIR_PATH );
+
+	if( !TestLookups() || !TestPacked( ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	Benchmark();
+	Cleanup();
+
+	printf( "success\n" );
+
+	return EXIT_SUCCESS;
+}
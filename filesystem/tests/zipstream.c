@@ -0,0 +1,236 @@
+#include "fstests.h"
+
+#define TEST_DIR  "zipstream/"
+#define TEST_ZIP  TEST_DIR "test.pk3"
+#define BIG_SIZE  ( 4 * 1024 * 1024 + 123 )
+
+static byte *g_big;
+static const char g_text[] =
+	"first line\n"
+	"second line\r\n"
+	"\n"
+	"last line without newline";
+
+static qboolean CheckRead( file_t *f, fs_offset_t pos, size_t size, const char *what )
+{
+	static byte buf[256 * 1024];
+	size_t expected = pos + size > BIG_SIZE ? BIG_SIZE - pos : size;
+	fs_offset_t nb;
+
+	if( g_fs.Tell( f ) != pos )
+	{
+		printf( "%s: at %ld, expected %ld\n", what, (long)g_fs.Tell( f ), (long)pos );
+		return false;
+	}
+
+	nb = g_fs.Read( f, buf, size );
+	if( nb != (fs_offset_t)expected || memcmp( buf, g_big + pos, expected ))
+	{
+		printf( "%s: read %ld bytes at %ld, mismatch\n", what, (long)nb, (long)pos );
+		return false;
+	}
+
+	return true;
+}
+
+static qboolean TestSequential( void )
+{
+	const size_t sizes[] = { 1, 7, 1000, 2048, 5000, 65536, 100003 };
+	fs_offset_t pos = 0;
+	file_t *f;
+	int i;
+
+	if( !( f = g_fs.Open( "big.bin", "rb", false )))
+	{
+		printf( "can't open deflated file\n" );
+		return false;
+	}
+
+	if( g_fs.FileLength( f ) != BIG_SIZE )
+	{
+		printf( "wrong length %ld\n", (long)g_fs.FileLength( f ));
+		g_fs.Close( f );
+		return false;
+	}
+
+	for( i = 0; pos < BIG_SIZE; i++ )
+	{
+		size_t size = sizes[i % ( sizeof( sizes ) / sizeof( sizes[0] ))];
+
+		if( !CheckRead( f, pos, size, "sequential" ))
+		{
+			g_fs.Close( f );
+			return false;
+		}
+
+		pos = pos + size > BIG_SIZE ? BIG_SIZE : pos + size;
+	}
+
+	if( !g_fs.Eof( f ))
+	{
+		printf( "no eof after reading everything\n" );
+		g_fs.Close( f );
+		return false;
+	}
+
+	g_fs.Close( f );
+	return true;
+}
+
+static qboolean TestSeek( void )
+{
+	file_t *f = g_fs.Open( "big.bin", "rb", false );
+	qboolean ok = false;
+
+	if( !f )
+		return false;
+
+	// forward, inside of read buffer, backward, from the end
+	if( !CheckRead( f, 0, 10, "start" ))
+		goto out;
+
+	if( g_fs.Seek( f, 100000, SEEK_CUR ) || !CheckRead( f, 100010, 5000, "forward" ))
+		goto out;
+
+	if( g_fs.Seek( f, 100020, SEEK_SET ) || !CheckRead( f, 100020, 10, "buffered" ))
+		goto out;
+
+	if( g_fs.Seek( f, 33, SEEK_SET ) || !CheckRead( f, 33, 70000, "backward" ))
+		goto out;
+
+	if( g_fs.Seek( f, -5, SEEK_END ) || !CheckRead( f, BIG_SIZE - 5, 100, "end" ))
+		goto out;
+
+	if( g_fs.Seek( f, 3 * 1024 * 1024, SEEK_SET ) || !CheckRead( f, 3 * 1024 * 1024, 1, "far" ))
+		goto out;
+
+	if( g_fs.Seek( f, BIG_SIZE + 1, SEEK_SET ) != -1 )
+	{
+		printf( "seek past the end succeeded\n" );
+		goto out;
+	}
+
+	ok = true;
+
+out:
+	g_fs.Close( f );
+	return ok;
+}
+
+static qboolean TestText( void )
+{
+	const char *lines[] = { "first line", "second line", "", "last line without newline" };
+	char line[64];
+	file_t *f;
+	int i;
+
+	if( !( f = g_fs.Open( "text.txt", "rb", false )))
+		return false;
+
+	for( i = 0; i < 4; i++ )
+	{
+		g_fs.Gets( f, line, sizeof( line ));
+
+		if( strcmp( line, lines[i] ))
+		{
+			printf( "line %d: %s\n", i, line );
+			g_fs.Close( f );
+			return false;
+		}
+	}
+
+	g_fs.Close( f );
+
+	// stored files still work as before
+	if( !( f = g_fs.Open( "stored.txt", "rb", false )))
+		return false;
+
+	g_fs.Gets( f, line, sizeof( line ));
+	g_fs.Close( f );
+
+	return !strcmp( line, "first line" );
+}
+
+static void Benchmark( void )
+{
+	static byte buf[16384];
+	clock_t start, loadtime, streamtime;
+	fs_offset_t len;
+	byte *data;
+	file_t *f;
+
+	start = clock();
+	data = g_fs.LoadFile( "big.bin", &len, false );
+	loadtime = clock() - start;
+	free( data );
+
+	start = clock();
+	f = g_fs.Open( "big.bin", "rb", false );
+	while( g_fs.Read( f, buf, sizeof( buf )) > 0 );
+	g_fs.Close( f );
+	streamtime = clock() - start;
+
+	printf( "%d KB deflated: LoadFile %.2f ms, streamed in 16 KB reads %.2f ms\n", BIG_SIZE >> 10,
+		loadtime * 1000.0 / CLOCKS_PER_SEC, streamtime * 1000.0 / CLOCKS_PER_SEC );
+}
+
+static void Cleanup( void )
+{
+	remove( TEST_ZIP );
+	rmdir( TEST_DIR );
+}
+
+int main( int argc, char **argv )
+{
+	archentry_t entries[3];
+	uint seed = 12345;
+	int i;
+
+	if( !LoadFilesystem() )
+		return EXIT_FAILURE;
+
+	// compressible, but not trivially
+	g_big = malloc( BIG_SIZE );
+	for( i = 0; i < BIG_SIZE; i++ )
+	{
+		seed = seed * 1103515245 + 12345;
+		g_big[i] = ( seed >> 16 ) & 0x0f;
+	}
+
+	entries[0].name = "big.bin";
+	entries[0].data = g_big;
+	entries[0].size = BIG_SIZE;
+	entries[0].deflate = true;
+	entries[1].name = "text.txt";
+	entries[1].data = (const byte *)g_text;
+	entries[1].size = sizeof( g_text ) - 1;
+	entries[1].deflate = true;
+	entries[2].name = "stored.txt";
+	entries[2].data = (const byte *)g_text;
+	entries[2].size = sizeof( g_text ) - 1;
+	entries[2].deflate = false;
+
+	mkdir( TEST_DIR, 0777 );
+
+	if( !WriteZip( TEST_ZIP, entries, 3 ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	g_fs.AddGameDirectory( TEST_DIR, FS_GAMEDIR_PATH );
+
+	if( !TestSequential( ) || !TestSeek( ) || !TestText( ))
+	{
+		Cleanup();
+		return EXIT_FAILURE;
+	}
+
+	Benchmark();
+	Cleanup();
+	free( g_big );
+
+	printf( "success\n" );
+
+	return EXIT_SUCCESS;
+}
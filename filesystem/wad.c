@@ -27,6 +27,7 @@ GNU General Public License for more details.
 #include "port.h"
 #include "filesystem_internal.h"
 #include "crtlib.h"
+#include "crclib.h"
 #include "common/com_strings.h"
 #include "wadfile.h"
 
@@ -49,6 +50,7 @@ infotable	dlumpinfo_t[dwadinfo_t->numlumps]
 #define WAD3_NAMELEN	16
 #define HINT_NAMELEN	5	// e.g. _mask, _norm
 #define MAX_FILES_IN_WAD	65535	// real limit as above <2Gb size not a lumpcount
+#define MIN_WAD_HASH_SIZE	16	// must be power of two
 
 #include "const.h"
 
@@ -79,6 +81,10 @@ struct wfile_s
 	file_t		*handle;
 	dlumpinfo_t	*lumps;
 	time_t		filetime;
+	string		shortname;		// wad name without path and extension
+	int		numbuckets;		// power of two, not less than numlumps
+	int		*hashbuckets;
+	int		*hashnext;		// next lump with same hash, in sorted order
 };
 
 // WAD errors
@@ -164,34 +170,19 @@ Serach for already existed lump
 */
 static dlumpinfo_t *W_FindLump( wfile_t *wad, const char *name, const signed char matchtype )
 {
-	int	left, right;
+	int	i;
 
 	if( !wad || !wad->lumps || matchtype == TYP_NONE )
 		return NULL;
 
-	// look for the file (binary search)
-	left = 0;
-	right = wad->numlumps - 1;
-
-	while( left <= right )
+	// names were lowercased on load and hash key is case-insensitive
+	for( i = wad->hashbuckets[COM_HashKey( name, wad->numbuckets )]; i >= 0; i = wad->hashnext[i] )
 	{
-		int	middle = (left + right) / 2;
-		int	diff = Q_stricmp( wad->lumps[middle].name, name );
-
-		if( !diff )
-		{
-			if(( matchtype == TYP_ANY ) || ( matchtype == wad->lumps[middle].type ))
-				return &wad->lumps[middle]; // found
-			else if( wad->lumps[middle].type < matchtype )
-				diff = 1;
-			else if( wad->lumps[middle].type > matchtype )
-				diff = -1;
-			else break; // not found
-		}
+		if( matchtype != TYP_ANY && matchtype != wad->lumps[i].type )
+			continue;
 
-		// if we're too far in the list
-		if( diff > 0 ) right = middle - 1;
-		else left = middle + 1;
+		if( !Q_stricmp( wad->lumps[i].name, name ))
+			return &wad->lumps[i]; // found
 	}
 
 	return NULL;
@@ -244,6 +235,35 @@ static dlumpinfo_t *W_AddFileToWad( const char *wadfile, const char *name, wfile
 	return plump;
 }
 
+/*
+====================
+W_BuildHash
+
+Index sorted lumps by name, so lookups don't depend on wad size
+====================
+*/
+static void W_BuildHash( wfile_t *wad )
+{
+	int	i;
+
+	for( wad->numbuckets = MIN_WAD_HASH_SIZE; wad->numbuckets < wad->numlumps; wad->numbuckets <<= 1 );
+
+	wad->hashbuckets = (int *)Mem_Malloc( wad->mempool, sizeof( *wad->hashbuckets ) * wad->numbuckets );
+	wad->hashnext = (int *)Mem_Malloc( wad->mempool, sizeof( *wad->hashnext ) * wad->numlumps );
+
+	for( i = 0; i < wad->numbuckets; i++ )
+		wad->hashbuckets[i] = -1;
+
+	// walk backwards, so chains keep the sorted order
+	for( i = wad->numlumps - 1; i >= 0; i-- )
+	{
+		uint	hash = COM_HashKey( wad->lumps[i].name, wad->numbuckets );
+
+		wad->hashnext[i] = wad->hashbuckets[hash];
+		wad->hashbuckets[hash] = i;
+	}
+}
+
 /*
 ===========
 FS_CloseWAD
@@ -314,6 +334,7 @@ static wfile_t *W_Open( const char *filename, int *error, uint flags )
 
 	// copy wad name
 	wad->filetime = FS_SysFileTime( filename );
+	COM_FileBase( filename, wad->shortname, sizeof( wad->shortname ));
 	wad->mempool = Mem_AllocPool( filename );
 
 	if( FS_Read( wad->handle, &header, sizeof( dwadinfo_t )) != sizeof( dwadinfo_t ))
@@ -399,6 +420,8 @@ static wfile_t *W_Open( const char *filename, int *error, uint flags )
 	// release source lumps
 	Mem_Free( srclumps );
 
+	W_BuildHash( wad );
+
 	// and leave the file open
 	return wad;
 }
@@ -437,36 +460,23 @@ static int FS_FindFile_WAD( searchpath_t *search, const char *path, char *fixedn
 {
 	dlumpinfo_t	*lump;
 	signed char		type = W_TypeFromExt( path );
-	qboolean		anywadname = true;
-	string		wadname, wadfolder;
-	string		shortname;
+	string		wadname, shortname;
 
 	// quick reject by filetype
 	if( type == TYP_NONE )
 		return -1;
 
 	COM_ExtractFilePath( path, wadname );
-	wadfolder[0] = '\0';
 
+	// quick reject by wadname
 	if( COM_CheckStringEmpty( wadname ))
 	{
-		string wadbasename;
-
-		COM_FileBase( wadname, wadbasename, sizeof( wadbasename ));
+		COM_FileBase( wadname, shortname, sizeof( shortname ));
 
-		Q_strncpy( wadfolder, wadbasename, sizeof( wadfolder ));
-		Q_snprintf( wadname, sizeof( wadname ), "%s.wad", wadbasename );
-		anywadname = false;
+		if( Q_stricmp( shortname, search->wad->shortname ))
+			return -1;
 	}
 
-	// make wadname from wad fullpath
-	COM_FileBase( search->filename, shortname, sizeof( shortname ));
-	COM_DefaultExtension( shortname, ".wad", sizeof( shortname ));
-
-	// quick reject by wadname
-	if( !anywadname && Q_stricmp( wadname, shortname ))
-		return -1;
-
 	// NOTE: we can't using long names for wad,
 	// because we using original wad names[16];
 	COM_FileBase( path, shortname, sizeof( shortname ));
@@ -573,6 +583,24 @@ static void FS_Search_WAD( searchpath_t *search, stringlist_t *list, const char
 }
 
 
+/*
+===========
+W_CanReadDirect
+
+true if lumps can be read straight from descriptor, bypassing wad handle
+===========
+*/
+static qboolean W_CanReadDirect( const wfile_t *wad )
+{
+#ifdef XASH_REDUCE_FD
+	// descriptor may be closed at any time
+	return false;
+#else
+	// deflated wads inside archives can only be read sequentially
+	return wad->handle->pfnReadStream == NULL;
+#endif
+}
+
 /*
 ===========
 W_ReadLump
@@ -593,12 +621,9 @@ static byte *W_ReadLump( searchpath_t *search, const char *path, int pack_ind, f
 	// no wads loaded
 	if( !wad || !lump ) return NULL;
 
-	oldpos = FS_Tell( wad->handle ); // don't forget restore original position
-
-	if( FS_Seek( wad->handle, lump->filepos, SEEK_SET ) == -1 )
+	if( lump->filepos < 0 || lump->disksize < 0 || (fs_offset_t)lump->filepos + lump->disksize > wad->handle->real_length )
 	{
 		Con_Reportf( S_ERROR "%s: %s is corrupted\n", __func__, lump->name );
-		FS_Seek( wad->handle, oldpos, SEEK_SET );
 		return NULL;
 	}
 
@@ -606,12 +631,23 @@ static byte *W_ReadLump( searchpath_t *search, const char *path, int pack_ind, f
 	if( unlikely( !buf ))
 	{
 		Con_Reportf( S_ERROR "%s: can't alloc %d bytes, no free memory\n", __func__, lump->disksize );
-		FS_Seek( wad->handle, oldpos, SEEK_SET );
 		return NULL;
 	}
 
-	size = FS_Read( wad->handle, buf, lump->disksize );
-	FS_Seek( wad->handle, oldpos, SEEK_SET );
+	if( W_CanReadDirect( wad ))
+	{
+		// single positional read, wad handle and its buffer are left untouched
+		size = FS_ReadAt( wad->handle->handle, buf, lump->disksize, wad->handle->offset + lump->filepos );
+	}
+	else
+	{
+		oldpos = FS_Tell( wad->handle ); // don't forget restore original position
+
+		if( FS_Seek( wad->handle, lump->filepos, SEEK_SET ) != -1 )
+			size = FS_Read( wad->handle, buf, lump->disksize );
+
+		FS_Seek( wad->handle, oldpos, SEEK_SET );
+	}
 
 	if( size < lump->disksize )
 	{
@@ -625,6 +661,31 @@ static byte *W_ReadLump( searchpath_t *search, const char *path, int pack_ind, f
 	return buf;
 }
 
+/*
+===========
+FS_FileHandle_WAD
+
+lumps are always read as is, see W_ReadLump
+===========
+*/
+static int FS_FileHandle_WAD( searchpath_t *search, int pack_ind, fs_offset_t *offset, fs_offset_t *size )
+{
+	const dlumpinfo_t *lump = &search->wad->lumps[pack_ind];
+
+	if( !W_CanReadDirect( search->wad ))
+		return -1;
+
+	// don't map past the wad into neighbour files of archive
+	if( lump->filepos < 0 || lump->disksize < 0 || (fs_offset_t)lump->filepos + lump->disksize > search->wad->handle->real_length )
+		return -1;
+
+	// wad itself may be stored inside of another archive
+	*offset = search->wad->handle->offset + lump->filepos;
+	*size = lump->disksize;
+
+	return search->wad->handle->handle;
+}
+
 /*
 ====================
 FS_AddWad_Fullpath
@@ -658,6 +719,7 @@ searchpath_t *FS_AddWad_Fullpath( const char *wadfile, int flags )
 	search->pfnFindFile = FS_FindFile_WAD;
 	search->pfnSearch = FS_Search_WAD;
 	search->pfnLoadFile = W_ReadLump;
+	search->pfnFileHandle = FS_FileHandle_WAD;
 
 	Con_Reportf( "Adding WAD: %s (%i files)\n", wadfile, wad->numlumps );
 	return search;
@@ -128,6 +128,18 @@ struct zip_s
 	zipfile_t files[]; // flexible
 };
 
+#define ZIP_STREAM_BUFF_SIZE ( 16 * 1024 )
+
+// inflate state of compressed file opened for reading
+typedef struct zipstream_s
+{
+	z_stream    zstream;
+	fs_offset_t in_position; // compressed bytes already read
+	fs_offset_t in_length; // compressed file size
+	qboolean    finished; // reached the end of deflate stream
+	byte        input[ZIP_STREAM_BUFF_SIZE];
+} zipstream_t;
+
 // #define ENABLE_CRC_CHECK // known to be buggy because of possible libpublic crc32 bug, disabled
 
 /*
@@ -379,6 +391,87 @@ static zip_t *FS_LoadZip( const char *zipfile, int *error )
 	return zip;
 }
 
+/*
+===========
+FS_ReadStream_ZIP
+
+Inflate next part of compressed file
+===========
+*/
+static fs_offset_t FS_ReadStream_ZIP( file_t *file, void *buffer, fs_offset_t count )
+{
+	zipstream_t *stream = file->stream;
+
+	stream->zstream.next_out = (Bytef *)buffer;
+	stream->zstream.avail_out = count;
+
+	while( stream->zstream.avail_out > 0 && !stream->finished )
+	{
+		int zlib_result;
+
+		if( stream->zstream.avail_in == 0 && stream->in_position < stream->in_length )
+		{
+			fs_offset_t nb = stream->in_length - stream->in_position;
+
+			if( nb > (fs_offset_t)sizeof( stream->input ))
+				nb = sizeof( stream->input );
+
+			nb = FS_ReadAt( file->handle, stream->input, nb, file->offset + stream->in_position );
+
+			if( nb <= 0 )
+				break;
+
+			stream->in_position += nb;
+			stream->zstream.next_in = (Bytef *)stream->input;
+			stream->zstream.avail_in = nb;
+		}
+
+		zlib_result = inflate( &stream->zstream, Z_SYNC_FLUSH );
+
+		if( zlib_result == Z_STREAM_END )
+			stream->finished = true;
+		else if( zlib_result != Z_OK )
+		{
+			// Z_BUF_ERROR here means compressed data ended too early
+			Con_Reportf( S_ERROR "%s: inflate error %d\n", __func__, zlib_result );
+			break;
+		}
+	}
+
+	return count - stream->zstream.avail_out;
+}
+
+/*
+===========
+FS_RewindStream_ZIP
+
+===========
+*/
+static void FS_RewindStream_ZIP( file_t *file )
+{
+	zipstream_t *stream = file->stream;
+
+	inflateReset( &stream->zstream );
+	stream->zstream.avail_in = 0;
+	stream->in_position = 0;
+	stream->finished = false;
+}
+
+/*
+===========
+FS_CloseStream_ZIP
+
+===========
+*/
+static void FS_CloseStream_ZIP( file_t *file )
+{
+	zipstream_t *stream = file->stream;
+
+	inflateEnd( &stream->zstream );
+	Mem_Free( stream );
+	file->stream = NULL;
+}
+
 /*
 ===========
 FS_OpenZipFile
@@ -389,15 +482,40 @@ Open a packed file using its package file descriptor
 static file_t *FS_OpenFile_ZIP( searchpath_t *search, const char *filename, const char *mode, int pack_ind )
 {
 	zipfile_t *pfile = &search->zip->files[pack_ind];
+	zipstream_t *stream;
+	file_t *file;
 
-	// compressed files handled in Zip_LoadFile
-	if( pfile->flags != ZIP_COMPRESSION_NO_COMPRESSION )
+	if( pfile->flags == ZIP_COMPRESSION_NO_COMPRESSION )
+		return FS_OpenHandle( search, search->zip->handle->handle, pfile->offset, pfile->size );
+
+	if( pfile->flags != ZIP_COMPRESSION_DEFLATED )
+	{
+		Con_Printf( S_ERROR "%s: %s uses unsupported compression method\n", __func__, pfile->name );
+		return NULL;
+	}
+
+	// deflated files are inflated while reading
+	file = FS_OpenHandle( search, search->zip->handle->handle, pfile->offset, pfile->size );
+	if( !file )
+		return NULL;
+
+	stream = (zipstream_t *)Mem_Calloc( fs_mempool, sizeof( *stream ));
+	stream->in_length = pfile->compressed_size;
+
+	if( inflateInit2( &stream->zstream, -MAX_WBITS ) != Z_OK )
 	{
-		Con_Printf( S_ERROR "%s: can't open compressed file %s\n", __func__, pfile->name );
+		Con_Printf( S_ERROR "%s: inflateInit2 failed\n", __func__ );
+		Mem_Free( stream );
+		FS_Close( file );
 		return NULL;
 	}
 
-	return FS_OpenHandle( search, search->zip->handle->handle, pfile->offset, pfile->size );
+	file->stream = stream;
+	file->pfnReadStream = FS_ReadStream_ZIP;
+	file->pfnRewindStream = FS_RewindStream_ZIP;
+	file->pfnCloseStream = FS_CloseStream_ZIP;
+
+	return file;
 }
 
 /*
@@ -601,6 +719,40 @@ static int FS_FindFile_ZIP( searchpath_t *search, const char *path, char *fixedn
 	return -1;
 }
 
+/*
+===========
+FS_FileName_ZIP
+
+===========
+*/
+static const char *FS_FileName_ZIP( searchpath_t *search, int pack_ind )
+{
+	if( pack_ind < 0 || pack_ind >= search->zip->numfiles )
+		return NULL;
+
+	return search->zip->files[pack_ind].name;
+}
+
+/*
+===========
+FS_FileHandle_ZIP
+
+===========
+*/
+static int FS_FileHandle_ZIP( searchpath_t *search, int pack_ind, fs_offset_t *offset, fs_offset_t *size )
+{
+	const zipfile_t *pfile = &search->zip->files[pack_ind];
+
+	// compressed files handled in Zip_LoadFile
+	if( pfile->flags != ZIP_COMPRESSION_NO_COMPRESSION )
+		return -1;
+
+	*offset = pfile->offset;
+	*size = pfile->size;
+
+	return search->zip->handle->handle;
+}
+
 /*
 ===========
 FS_Search_ZIP
@@ -679,6 +831,8 @@ searchpath_t *FS_AddZip_Fullpath( const char *zipfile, int flags )
 	search->pfnOpenFile = FS_OpenFile_ZIP;
 	search->pfnFileTime = FS_FileTime_ZIP;
 	search->pfnFindFile = FS_FindFile_ZIP;
+	search->pfnFileName = FS_FileName_ZIP;
+	search->pfnFileHandle = FS_FileHandle_ZIP;
 	search->pfnSearch = FS_Search_ZIP;
 	search->pfnLoadFile = FS_LoadZIPFile;
 
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "crtlib.h"
+#include "xash3d_mathlib.h"
+#include "const.h"
+#include "com_model.h"
+#include "studio.h"
+
+static mstudiobone_t	bones[MAXSTUDIOBONES];
+static vec4_t		q[MAXSTUDIOBONES];
+static float		pos[MAXSTUDIOBONES][3];
+static matrix3x4		scalar[MAXSTUDIOBONES];
+static matrix3x4		simd[MAXSTUDIOBONES];
+static uint		seed = 12345;
+
+static float Test_Random( float min, float max )
+{
+	seed = seed * 1103515245 + 12345;
+	return min + ( max - min ) * (( seed >> 8 ) & 0xffff ) / 65535.0f;
+}
+
+// same as SV_StudioSetupBones did before
+static void Test_ScalarBoneMatrices( const int *boneused, int numbones, const matrix3x4 transform )
+{
+	matrix3x4	bonematrix;
+	int	i, j;
+
+	for( j = numbones - 1; j >= 0; j-- )
+	{
+		i = boneused[j];
+
+		Matrix3x4_FromOriginQuat( bonematrix, q[i], pos[i] );
+		if( bones[i].parent == -1 )
+			Matrix3x4_ConcatTransforms( scalar[i], transform, bonematrix );
+		else Matrix3x4_ConcatTransforms( scalar[i], scalar[bones[i].parent], bonematrix );
+	}
+}
+
+static void Test_RandomSkeleton( int numbones )
+{
+	int	i;
+
+	for( i = 0; i < numbones; i++ )
+	{
+		vec3_t	angles;
+
+		bones[i].parent = i ? (int)Test_Random( -1.0f, i - 0.01f ) : -1;
+		angles[0] = Test_Random( -M_PI_F, M_PI_F );
+		angles[1] = Test_Random( -M_PI_F, M_PI_F );
+		angles[2] = Test_Random( -M_PI_F, M_PI_F );
+		AngleQuaternion( angles, q[i], true );
+		pos[i][0] = Test_Random( -16.0f, 16.0f );
+		pos[i][1] = Test_Random( -16.0f, 16.0f );
+		pos[i][2] = Test_Random( -16.0f, 16.0f );
+	}
+}
+
+static int Test_CompareBones( const int *boneused, int numbones )
+{
+	int	i, j, k, b;
+
+	for( b = 0; b < numbones; b++ )
+	{
+		i = boneused[b];
+
+		for( j = 0; j < 3; j++ )
+		{
+			for( k = 0; k < 4; k++ )
+			{
+				if( fabs( scalar[i][j][k] - simd[i][j][k] ) > 1e-5f * ( 1.0f + fabs( scalar[i][j][k] )))
+				{
+					printf( "bone %i [%i][%i]: %f != %f\n", i, j, k, scalar[i][j][k], simd[i][j][k] );
+					return 1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int Test_BoneMatrices( void )
+{
+	const int	counts[] = { 1, 3, 4, 5, 7, 24, 53, MAXSTUDIOBONES };
+	int	boneused[MAXSTUDIOBONES];
+	matrix3x4	transform;
+	vec3_t	angles = { 15.0f, 240.0f, -5.0f }, origin = { 128.0f, -64.0f, 32.0f };
+	size_t	c;
+	int	i, n;
+
+	Matrix3x4_CreateFromEntity( transform, angles, origin, 1.0f );
+
+	for( c = 0; c < sizeof( counts ) / sizeof( counts[0] ); c++ )
+	{
+		Test_RandomSkeleton( counts[c] );
+
+		// all bones, like iBone == -1
+		for( i = 0; i < counts[c]; i++ )
+			boneused[(counts[c] - i) - 1] = i;
+
+		Test_ScalarBoneMatrices( boneused, counts[c], transform );
+		R_StudioBoneMatrices( simd, bones, boneused, counts[c], q, pos, transform );
+
+		if( Test_CompareBones( boneused, counts[c] ))
+			return c * 2 + 1;
+
+		// only the parents of the last bone
+		for( n = 0, i = counts[c] - 1; i != -1; i = bones[i].parent )
+			boneused[n++] = i;
+
+		Test_ScalarBoneMatrices( boneused, n, transform );
+		R_StudioBoneMatrices( simd, bones, boneused, n, q, pos, transform );
+
+		if( Test_CompareBones( boneused, n ))
+			return c * 2 + 2;
+	}
+
+	return 0;
+}
+
+static void Test_Benchmark( const char *name, int numbones, int iterations )
+{
+	int	boneused[MAXSTUDIOBONES];
+	matrix3x4	transform;
+	clock_t	start, scalartime, simdtime;
+	int	i;
+
+	Matrix3x4_LoadIdentity( transform );
+
+	for( i = 0; i < numbones; i++ )
+		boneused[(numbones - i) - 1] = i;
+
+	start = clock();
+	for( i = 0; i < iterations; i++ )
+		Test_ScalarBoneMatrices( boneused, numbones, transform );
+	scalartime = clock() - start;
+
+	start = clock();
+	for( i = 0; i < iterations; i++ )
+		R_StudioBoneMatrices( simd, bones, boneused, numbones, q, pos, transform );
+	simdtime = clock() - start;
+
+	printf( "%s: %i bones, %i iterations, scalar %.2f ms, R_StudioBoneMatrices %.2f ms\n", name, numbones, iterations,
+		scalartime * 1000.0 / CLOCKS_PER_SEC, simdtime * 1000.0 / CLOCKS_PER_SEC );
+}
+
+// sequence 0 frame 0 pose of studio model from disk
+static int Test_LoadModelPose( const char *filename )
+{
+	mstudioseqdesc_t	*pseqdesc;
+	mstudioanim_t	*panim;
+	studiohdr_t	*phdr;
+	mstudiobone_t	*pbone;
+	float		adj[MAXSTUDIOCONTROLLERS] = { 0 };
+	byte		*buf;
+	long		size;
+	FILE		*f;
+	int		i, numbones;
+
+	if( !( f = fopen( filename, "rb" )))
+		return 0;
+
+	fseek( f, 0, SEEK_END );
+	size = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	buf = malloc( size );
+
+	if( size < (long)sizeof( *phdr ) || fread( buf, 1, size, f ) != (size_t)size )
+	{
+		free( buf );
+		fclose( f );
+		return 0;
+	}
+	fclose( f );
+
+	phdr = (studiohdr_t *)buf;
+	if( phdr->ident != IDSTUDIOHEADER || phdr->numseq <= 0 || phdr->numbones <= 0 || phdr->numbones > MAXSTUDIOBONES )
+	{
+		free( buf );
+		return 0;
+	}
+
+	pseqdesc = (mstudioseqdesc_t *)(buf + phdr->seqindex);
+	pbone = (mstudiobone_t *)(buf + phdr->boneindex);
+	panim = pseqdesc->seqgroup == 0 ? (mstudioanim_t *)(buf + pseqdesc->animindex) : NULL;
+	numbones = phdr->numbones;
+
+	for( i = 0; i < numbones; i++ )
+	{
+		bones[i] = pbone[i];
+		R_StudioCalcBoneQuaternion( 0, 0.0f, &pbone[i], panim ? &panim[i] : NULL, adj, q[i] );
+		R_StudioCalcBonePosition( 0, 0.0f, &pbone[i], panim ? &panim[i] : NULL, adj, pos[i] );
+	}
+
+	free( buf );
+	return numbones;
+}
+
+int main( int argc, char **argv )
+{
+	int	i, numbones;
+
+	if( Test_BoneMatrices( ))
+		return EXIT_FAILURE;
+
+	// benchmark: test_bones [models/player.mdl ...]
+	if( argc < 2 )
+	{
+		Test_RandomSkeleton( MAXSTUDIOBONES );
+		Test_Benchmark( "random skeleton", MAXSTUDIOBONES, 2000 );
+		return EXIT_SUCCESS;
+	}
+
+	for( i = 1; i < argc; i++ )
+	{
+		if(( numbones = Test_LoadModelPose( argv[i] )) <= 0 )
+		{
+			printf( "%s: not a studio model\n", argv[i] );
+			continue;
+		}
+
+		Test_Benchmark( argv[i], numbones, 200000 );
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "crclib.h"
+#include "crtlib.h"
+
+#define BUFFER_SIZE 4096
+#define BENCH_SIZE  ( 16 * 1024 * 1024 )
+
+static uint32_t reftable[256];
+
+static void RefCRC_Init( void )
+{
+	uint32_t i, j, c;
+
+	for( i = 0; i < 256; i++ )
+	{
+		for( c = i, j = 0; j < 8; j++ )
+			c = ( c & 1 ) ? ( c >> 1 ) ^ 0xEDB88320 : ( c >> 1 );
+		reftable[i] = c;
+	}
+}
+
+static uint32_t RefCRC_Buffer( uint32_t crc, const byte *buf, int len )
+{
+	while( len-- )
+		crc = reftable[(byte)crc ^ *buf++] ^ ( crc >> 8 );
+	return crc;
+}
+
+static int Test_CRC32( void )
+{
+	static byte buf[BUFFER_SIZE + 16];
+	uint32_t crc;
+	int i, len, ofs;
+
+	for( i = 0; i < sizeof( buf ); i++ )
+		buf[i] = (byte)( i * 7 + ( i >> 8 ));
+
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, "123456789", 9 );
+	if( CRC32_Final( crc ) != 0xCBF43926 )
+		return 1;
+
+	// every length around the vector path thresholds, at every alignment
+	for( ofs = 0; ofs < 16; ofs++ )
+	{
+		for( len = 0; len <= BUFFER_SIZE; len += ( len < 300 ) ? 1 : 61 )
+		{
+			uint32_t ref = RefCRC_Buffer( 0xFFFFFFFF ^ ofs, buf + ofs, len );
+
+			crc = 0xFFFFFFFF ^ ofs;
+			CRC32_ProcessBuffer( &crc, buf + ofs, len );
+
+			if( crc != ref )
+			{
+				printf( "CRC32 mismatch: offset %d length %d\n", ofs, len );
+				return 2;
+			}
+		}
+	}
+
+	// bytewise and buffered calls must be interchangeable
+	CRC32_Init( &crc );
+	for( i = 0; i < 100; i++ )
+		CRC32_ProcessByte( &crc, buf[i] );
+	CRC32_ProcessBuffer( &crc, buf + 100, 1000 );
+
+	if( crc != RefCRC_Buffer( 0xFFFFFFFF, buf, 1100 ))
+		return 3;
+
+	return 0;
+}
+
+static int Test_MD5( void )
+{
+	struct {
+		const char *str;
+		const char *hash;
+	} test_data[] = {
+		{ "", "d41d8cd98f00b204e9800998ecf8427e" },
+		{ "a", "0cc175b9c0f1b6a831c399e269772661" },
+		{ "abc", "900150983cd24fb0d6963f7d28e17f72" },
+		{ "message digest", "f96b697d7cb7938d525a2f31aaf161d0" },
+		{ "abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b" },
+		{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "d174ab98d277d9f5a5611c2c9f419d9f" },
+		{ "12345678901234567890123456789012345678901234567890123456789012345678901234567890", "57edf4a22be3c955ac49da2e2107b67a" },
+	};
+	static byte buf[BUFFER_SIZE + 16];
+	byte digest[16], digest2[16];
+	MD5Context_t ctx;
+	int i, len, split;
+
+	for( i = 0; i < sizeof( test_data ) / sizeof( test_data[0] ); i++ )
+	{
+		MD5Init( &ctx );
+		MD5Update( &ctx, (const byte *)test_data[i].str, Q_strlen( test_data[i].str ));
+		MD5Final( digest, &ctx );
+
+		if( Q_stricmp( MD5_Print( digest ), test_data[i].hash ))
+			return i + 1;
+	}
+
+	for( i = 0; i < sizeof( buf ); i++ )
+		buf[i] = (byte)( i * 13 + ( i >> 7 ));
+
+	// unaligned and split updates must give the same digest
+	for( len = 0; len < 1024; len += 37 )
+	{
+		MD5Init( &ctx );
+		MD5Update( &ctx, buf, len );
+		MD5Final( digest, &ctx );
+
+		for( split = 1; split < 130; split += 11 )
+		{
+			int pos;
+
+			memmove( buf + 3, buf, len );
+
+			MD5Init( &ctx );
+			for( pos = 0; pos < len; pos += split )
+				MD5Update( &ctx, buf + 3 + pos, ( len - pos < split ) ? len - pos : split );
+			MD5Final( digest2, &ctx );
+
+			memmove( buf, buf + 3, len );
+
+			if( memcmp( digest, digest2, sizeof( digest )))
+			{
+				printf( "MD5 mismatch: length %d split %d\n", len, split );
+				return 100;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void Benchmark( void )
+{
+	byte *buf = malloc( BENCH_SIZE );
+	clock_t start, ref, fast, md5;
+	MD5Context_t ctx;
+	byte digest[16];
+	uint32_t crc;
+	int i;
+
+	if( !buf )
+		return;
+
+	for( i = 0; i < BENCH_SIZE; i++ )
+		buf[i] = (byte)i;
+
+	start = clock();
+	crc = RefCRC_Buffer( 0xFFFFFFFF, buf, BENCH_SIZE );
+	ref = clock() - start;
+
+	start = clock();
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, buf, BENCH_SIZE );
+	fast = clock() - start;
+
+	start = clock();
+	MD5Init( &ctx );
+	MD5Update( &ctx, buf, BENCH_SIZE );
+	MD5Final( digest, &ctx );
+	md5 = clock() - start;
+
+	printf( "%d MB: bytewise CRC32 %.2f ms, CRC32_ProcessBuffer %.2f ms, MD5 %.2f ms\n", BENCH_SIZE >> 20,
+		ref * 1000.0 / CLOCKS_PER_SEC, fast * 1000.0 / CLOCKS_PER_SEC, md5 * 1000.0 / CLOCKS_PER_SEC );
+
+	free( buf );
+}
+
+int main( void )
+{
+	int ret;
+
+	RefCRC_Init();
+
+	if(( ret = Test_CRC32( )))
+	{
+		printf( "Test_CRC32 failed: %d\n", ret );
+		return EXIT_FAILURE;
+	}
+
+	if(( ret = Test_MD5( )))
+	{
+		printf( "Test_MD5 failed: %d\n", ret );
+		return EXIT_FAILURE;
+	}
+
+	Benchmark();
+
+	return EXIT_SUCCESS;
+}
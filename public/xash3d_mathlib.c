@@ -20,6 +20,14 @@ GNU General Public License for more details.
 #include "eiface.h"
 #include "studio.h"
 
+#if XASH_AMD64 || defined( __SSE2__ ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define XASH_SIMD_SSE2 1
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define XASH_SIMD_NEON 1
+#endif
+
 #define NUM_HULL_ROUNDS	ARRAYSIZE( hull_table )
 #define HULL_PRECISION	4
 
@@ -624,3 +632,206 @@ void R_StudioCalcBonePosition( int frame, float s, const mstudiobone_t *pbone, c
 		VectorCopy( origin1, pos );
 	}
 }
+
+/*
+===============================================================================
+
+	STUDIO BONE MATRICES
+
+	bone matrices are built in two passes: local matrices from quaternions
+	are independent, so they're converted four at a time, then they are
+	concatenated with the parents in hierarchy order. Both SIMD paths repeat
+	the scalar operations order, so results only may differ in the sign of zero
+===============================================================================
+*/
+#if XASH_SIMD_SSE2 || XASH_SIMD_NEON
+#if XASH_SIMD_SSE2
+typedef __m128 simd4f_t;
+#define S4_Set1( x )	_mm_set1_ps( x )
+#define S4_Add( a, b )	_mm_add_ps( a, b )
+#define S4_Sub( a, b )	_mm_sub_ps( a, b )
+#define S4_Mul( a, b )	_mm_mul_ps( a, b )
+#define S4_Load( p )	_mm_loadu_ps( p )
+#define S4_Store( p, a )	_mm_storeu_ps( p, a )
+#else
+typedef float32x4_t simd4f_t;
+#define S4_Set1( x )	vdupq_n_f32( x )
+#define S4_Add( a, b )	vaddq_f32( a, b )
+#define S4_Sub( a, b )	vsubq_f32( a, b )
+#define S4_Mul( a, b )	vmulq_f32( a, b )
+#define S4_Load( p )	vld1q_f32( p )
+#define S4_Store( p, a )	vst1q_f32( p, a )
+#endif
+
+/*
+====================
+S4_Transpose
+
+four rows of four floats into four columns
+====================
+*/
+static inline void S4_Transpose( simd4f_t *r0, simd4f_t *r1, simd4f_t *r2, simd4f_t *r3 )
+{
+#if XASH_SIMD_SSE2
+	_MM_TRANSPOSE4_PS( *r0, *r1, *r2, *r3 );
+#else
+	float32x4x2_t	t0 = vtrnq_f32( *r0, *r1 );
+	float32x4x2_t	t1 = vtrnq_f32( *r2, *r3 );
+
+	*r0 = vcombine_f32( vget_low_f32( t0.val[0] ), vget_low_f32( t1.val[0] ));
+	*r1 = vcombine_f32( vget_low_f32( t0.val[1] ), vget_low_f32( t1.val[1] ));
+	*r2 = vcombine_f32( vget_high_f32( t0.val[0] ), vget_high_f32( t1.val[0] ));
+	*r3 = vcombine_f32( vget_high_f32( t0.val[1] ), vget_high_f32( t1.val[1] ));
+#endif
+}
+
+/*
+====================
+Matrix3x4_FromOriginQuat4
+
+same as Matrix3x4_FromOriginQuat for four bones at once
+====================
+*/
+static inline void Matrix3x4_FromOriginQuat4( matrix3x4 out[4], const float *q[4], const float *origin[4] )
+{
+	simd4f_t	x = S4_Load( q[0] ), y = S4_Load( q[1] ), z = S4_Load( q[2] ), w = S4_Load( q[3] );
+	simd4f_t	ox = S4_Load( origin[0] ), oy = S4_Load( origin[1] ), oz = S4_Load( origin[2] ), ow = S4_Load( origin[3] );
+	simd4f_t	one = S4_Set1( 1.0f ), two = S4_Set1( 2.0f );
+	simd4f_t	x2, y2, z2, w2;
+	simd4f_t	m0, m1, m2;
+
+	// components of every quaternion and origin into own register
+	S4_Transpose( &x, &y, &z, &w );
+	S4_Transpose( &ox, &oy, &oz, &ow );
+
+	x2 = S4_Mul( two, x );
+	y2 = S4_Mul( two, y );
+	z2 = S4_Mul( two, z );
+	w2 = S4_Mul( two, w );
+
+	// first row
+	m0 = S4_Sub( S4_Sub( one, S4_Mul( y2, y )), S4_Mul( z2, z ));
+	m1 = S4_Sub( S4_Mul( x2, y ), S4_Mul( w2, z ));
+	m2 = S4_Add( S4_Mul( x2, z ), S4_Mul( w2, y ));
+	ow = ox;
+	S4_Transpose( &m0, &m1, &m2, &ow );
+	S4_Store( out[0][0], m0 );
+	S4_Store( out[1][0], m1 );
+	S4_Store( out[2][0], m2 );
+	S4_Store( out[3][0], ow );
+
+	// second row
+	m0 = S4_Add( S4_Mul( x2, y ), S4_Mul( w2, z ));
+	m1 = S4_Sub( S4_Sub( one, S4_Mul( x2, x )), S4_Mul( z2, z ));
+	m2 = S4_Sub( S4_Mul( y2, z ), S4_Mul( w2, x ));
+	ow = oy;
+	S4_Transpose( &m0, &m1, &m2, &ow );
+	S4_Store( out[0][1], m0 );
+	S4_Store( out[1][1], m1 );
+	S4_Store( out[2][1], m2 );
+	S4_Store( out[3][1], ow );
+
+	// third row
+	m0 = S4_Sub( S4_Mul( x2, z ), S4_Mul( w2, y ));
+	m1 = S4_Add( S4_Mul( y2, z ), S4_Mul( w2, x ));
+	m2 = S4_Sub( S4_Sub( one, S4_Mul( x2, x )), S4_Mul( y2, y ));
+	ow = oz;
+	S4_Transpose( &m0, &m1, &m2, &ow );
+	S4_Store( out[0][2], m0 );
+	S4_Store( out[1][2], m1 );
+	S4_Store( out[2][2], m2 );
+	S4_Store( out[3][2], ow );
+}
+
+/*
+====================
+Matrix3x4_ConcatTransformsSIMD
+
+every row of result is a sum of in2 rows scaled by in1 row
+====================
+*/
+static inline void Matrix3x4_ConcatTransformsSIMD( matrix3x4 out, const matrix3x4 in1, const matrix3x4 in2 )
+{
+	simd4f_t	b0 = S4_Load( in2[0] ), b1 = S4_Load( in2[1] ), b2 = S4_Load( in2[2] );
+	const float	last[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	simd4f_t	b3 = S4_Load( last );
+	simd4f_t	r0, r1, r2;
+
+	r0 = S4_Add( S4_Mul( S4_Set1( in1[0][0] ), b0 ), S4_Mul( S4_Set1( in1[0][1] ), b1 ));
+	r1 = S4_Add( S4_Mul( S4_Set1( in1[1][0] ), b0 ), S4_Mul( S4_Set1( in1[1][1] ), b1 ));
+	r2 = S4_Add( S4_Mul( S4_Set1( in1[2][0] ), b0 ), S4_Mul( S4_Set1( in1[2][1] ), b1 ));
+	r0 = S4_Add( r0, S4_Mul( S4_Set1( in1[0][2] ), b2 ));
+	r1 = S4_Add( r1, S4_Mul( S4_Set1( in1[1][2] ), b2 ));
+	r2 = S4_Add( r2, S4_Mul( S4_Set1( in1[2][2] ), b2 ));
+
+	// translation only goes to the last column
+	r0 = S4_Add( r0, S4_Mul( S4_Set1( in1[0][3] ), b3 ));
+	r1 = S4_Add( r1, S4_Mul( S4_Set1( in1[1][3] ), b3 ));
+	r2 = S4_Add( r2, S4_Mul( S4_Set1( in1[2][3] ), b3 ));
+
+	S4_Store( out[0], r0 );
+	S4_Store( out[1], r1 );
+	S4_Store( out[2], r2 );
+}
+#endif // XASH_SIMD_SSE2 || XASH_SIMD_NEON
+
+/*
+====================
+R_StudioBoneMatrices
+
+build world matrices for bones listed in boneused, from last to first,
+so the parents are always processed before their children
+====================
+*/
+void R_StudioBoneMatrices( matrix3x4 bones[], const mstudiobone_t *pbones, const int boneused[], int numbones, const vec4_t q[], const float pos[][3], const matrix3x4 transform )
+{
+	matrix3x4	local[4];
+	int	i, j, k, n;
+
+	numbones = Q_min( numbones, MAXSTUDIOBONES );
+
+	for( j = numbones - 1; j >= 0; j -= n )
+	{
+#if XASH_SIMD_SSE2 || XASH_SIMD_NEON
+		if( j >= 3 )
+		{
+			const float	*quats[4], *origins[4];
+			float		padded[4][4];
+
+			// vec3_t can't be loaded as is, last one may be at the end of array
+			for( k = 0; k < 4; k++ )
+			{
+				i = boneused[j - k];
+				quats[k] = q[i];
+				padded[k][0] = pos[i][0];
+				padded[k][1] = pos[i][1];
+				padded[k][2] = pos[i][2];
+				padded[k][3] = 0.0f;
+				origins[k] = padded[k];
+			}
+
+			Matrix3x4_FromOriginQuat4( local, quats, origins );
+			n = 4;
+		}
+		else
+#endif
+		{
+			Matrix3x4_FromOriginQuat( local[0], q[boneused[j]], pos[boneused[j]] );
+			n = 1;
+		}
+
+		for( k = 0; k < n; k++ )
+		{
+			const float	(*parent)[4];
+
+			i = boneused[j - k];
+			parent = ( pbones[i].parent == -1 ) ? transform : bones[pbones[i].parent];
+
+#if XASH_SIMD_SSE2 || XASH_SIMD_NEON
+			Matrix3x4_ConcatTransformsSIMD( bones[i], parent, local[k] );
+#else
+			Matrix3x4_ConcatTransforms( bones[i], parent, local[k] );
+#endif
+		}
+	}
+}
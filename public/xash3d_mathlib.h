@@ -179,6 +179,7 @@ qboolean SphereIntersect( const vec3_t vSphereCenter, float fSphereRadiusSquared
 void QuaternionSlerp( const vec4_t p, const vec4_t q, float t, vec4_t qt );
 void R_StudioCalcBoneQuaternion( int frame, float s, const mstudiobone_t *pbone, const mstudioanim_t *panim, const float *adj, vec4_t q );
 void R_StudioCalcBonePosition( int frame, float s, const mstudiobone_t *pbone, const mstudioanim_t *panim, const vec3_t adj, vec3_t pos );
+void R_StudioBoneMatrices( matrix3x4 bones[], const mstudiobone_t *pbones, const int boneused[], int numbones, const vec4_t q[], const float pos[][3], const matrix3x4 transform );
 int BoxOnPlaneSide( const vec3_t emins, const vec3_t emaxs, const mplane_t *p );
 #define BOX_ON_PLANE_SIDE( emins, emaxs, p )           \
 	((( p )->type < 3 ) ?                              \